@@ -7,7 +7,27 @@
 #include <locale>
 #include <codecvt>
 #include <regex>
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <atomic>
+#include <csignal>
 #include "queries.cpp"
+#include "repository.cpp"
+#include "importer.cpp"
+#include "columnar.cpp"
+#include "planner.cpp"
+#include "booking.cpp"
+#include "loadgen.cpp"
+#include "replay.cpp"
+#include "bench.cpp"
+#include "metrics.cpp"
+#include "executor.cpp"
+#include "snapshot.cpp"
+#include "cities.cpp"
+#include "partitions.cpp"
+#include "deadline.cpp"
 using namespace std;
 
 /**********************************************************
@@ -23,13 +43,113 @@ using namespace std;
 
 const char* pathDB = "internal/db/database.db";
 
-// exitWithError prints an error with FAILURE code
+// columnarIndex answers searches from memory instead of SQLite when `--engine columnar` is set
+ColumnarRouteIndex* columnarIndex = nullptr;
+
+// routeIndex answers lists from memory: the columnar index or a snapshot set by `--snapshot`
+RouteIndex* routeIndex = nullptr;
+
+// snapshotPath is a snapshot of `--snapshot`, lists are answered from it and the database is not opened
+string snapshotPath;
+
+// outputFormat is how query results are printed, it is set by `--output`
+OutputFormat outputFormat = OutputFormat::Table;
+
+// streamWidths are column widths of Stream output, computed on first use
+vector<size_t> streamWidths;
+
+// routeHeaders are headers of printed route tables
+const vector<string> routeHeaders = {"ID", "Flight", "Source", "Destination", "Distance", "Departure Time", 
+                                     "Arrival Time", "Price", "Seats", "Transport"};
+
+// pageSize is number of rows per page set by `--page-size`, 0 prints whole results
+int pageSize = 0;
+
+// journeyPlanner keeps timetable for multi-leg journeys, it is loaded on first use
+JourneyPlanner journeyPlanner;
+
+// cityIndex resolves typed city names and completes them, it is loaded on first use
+CityIndex cityIndex;
+
+// slowQueryMs is the slow query threshold set by `--slow-ms`, 0 disables the slow query log
+double slowQueryMs = 0;
+
+// queryMetrics aggregates every query execution, slow ones are logged to stderr
+QueryMetrics* queryMetrics = nullptr;
+
+// metricsPath is where `--metrics` dumps query metrics, empty prints them
+string metricsPath;
+
+// queryTimeoutMs is the deadline of a query set by `--timeout-ms`, 0 lets queries run to the end
+double queryTimeoutMs = 0;
+
+// runningQuery is the deadline of the console query being executed, Ctrl-C cancels it
+atomic<QueryDeadline*> runningQuery(nullptr);
+
+// secondsSince returns seconds elapsed since `start`
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// exitWithError prints an error with FAILURE code, `db` is null without a database
 void exitWithError(sqlite3* db, const string& message) {
+    if (!db) {
+        cerr << "error: " << message << endl;
+        exit(EXIT_FAILURE);
+    }
     cerr << "error: " << message << ": " << sqlite3_errmsg(db) << endl;
     sqlite3_close(db);
     exit(EXIT_FAILURE);
 }
 
+// ConsoleDeadline puts statements of a console operation under `--timeout-ms`
+// and lets Ctrl-C cancel them while it is in scope
+class ConsoleDeadline : public QueryDeadline {
+public:
+    explicit ConsoleDeadline(RouteRepository& repo) : QueryDeadline(repo.handle(), queryTimeoutMs / 1000) {
+        runningQuery = this;
+    }
+
+    ~ConsoleDeadline() {
+        runningQuery = nullptr;
+    }
+};
+
+// cancelQuery cancels the running query on Ctrl-C, without one Ctrl-C ends the
+// console as before
+void cancelQuery(int signal) {
+    QueryDeadline* query = runningQuery;
+    if (query) {
+        query->cancel();
+        return;
+    }
+    std::signal(signal, SIG_DFL);
+    raise(signal);
+}
+
+// interruptReason describes why a statement was stopped by `deadline`
+string interruptReason(const QueryDeadline& deadline) {
+    if (!deadline.timedOut()) {
+        return "query cancelled";
+    }
+    char milliseconds[32];
+    snprintf(milliseconds, sizeof(milliseconds), "%g", queryTimeoutMs);
+    return string("query timed out after ") + milliseconds + " ms";
+}
+
+// queryInterrupted reports a query `name` stopped by its deadline or by Ctrl-C,
+// the console goes on with the next operation. False if the query failed otherwise
+bool queryInterrupted(RouteRepository& repo, const QueryDeadline& deadline, const char* name) {
+    if (!deadline.interrupted() || sqlite3_errcode(repo.handle()) != SQLITE_INTERRUPT) {
+        return false;
+    }
+    if (deadline.timedOut()) {
+        queryMetrics->recordTimeout(name);
+    }
+    cerr << "error: " << interruptReason(deadline) << "\n";
+    return true;
+}
+
 bool isValidDate(const string& date) {
     // Regexp for "dd.mm.yyyy"
     regex dateRegex(R"(^(\d{2})\.(\d{2})\.(\d{4})$)");
@@ -76,9 +196,9 @@ string convertToSQLiteFormat(const string& date) {
 
 // readSelectRouteParameters prints a Menu and reads corresponding fields
 void readSelectRouteParameters(string& source, string& destination, string& date, string& transportType, string& ticketPrice) {
-    cout << "Enter source location: ";
+    cout << "Enter source location (or leave empty for any): ";
     getline(cin, source);
-    cout << "Enter destination location: ";
+    cout << "Enter destination location (or leave empty for any): ";
     getline(cin, destination);
     cout << "Enter preferred departure date (DD.MM.YYYY): ";
     getline(cin, date);
@@ -90,7 +210,7 @@ void readSelectRouteParameters(string& source, string& destination, string& date
     getline(cin, transportType);
     cout << "Enter higher ticket price (or leave empty for any): ";
     getline(cin, ticketPrice);
-    if (!isNonNegativeNumber(ticketPrice)) {
+    if (!ticketPrice.empty() && !isNonNegativeNumber(ticketPrice)) {
         cerr << "invalid price\n";
         exit(1);
     }
@@ -160,7 +280,7 @@ int utf8StringLen(const string& str) {
 }
 
 // printRaw print table's data row with separators
-void printRaw(vector<string> row, vector<size_t> widths){
+void printRaw(const vector<string>& row, const vector<size_t>& widths){
     cout << "|";
         for (size_t i = 0; i < row.size(); ++i) {
             cout << " " << row[i];
@@ -173,7 +293,7 @@ void printRaw(vector<string> row, vector<size_t> widths){
 }
 
 // printLine print tabel's separators
-void printLine(vector<size_t> column_widths){
+void printLine(const vector<size_t>& column_widths){
     cout << "+";
     for (size_t width : column_widths) {
         cout << string(width, '-') << "+";
@@ -181,32 +301,24 @@ void printLine(vector<size_t> column_widths){
     cout << "\n";
 }
 
-// doAndPrintQueryResult do sql-request and prints it to stdout as result table
-void doAndPrintQueryResult(sqlite3_stmt *stmt) {
+// printQueryResult prints rows to stdout as result table
+void printQueryResult(const vector<vector<string>>& rows) {
     const int column_count = 10;
     vector<size_t> column_widths(column_count, 0);
     // Headers
-    const vector<string> headers = {"ID", "Flight", "Source", "Destination", "Distance", "Departure Time", 
-                                    "Arrival Time", "Price", "Seats", "Transport"};
+    const vector<string>& headers = routeHeaders;
     // Get max columns widths
     for (size_t i = 0; i < headers.size(); ++i) {
         column_widths[i] = utf8StringLen(headers[i]) + 2;
     }
-    // Do sql request, write results into `rows`
-    vector<vector<string>> rows;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        vector<string> row;
+    for (const auto& row : rows) {
         for (int i = 0; i < column_count; ++i) {
-            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-            string value = text ? text : "N/A"; // not assigned
-            row.push_back(value);
             // Update max columns widths
-            size_t display_width = utf8StringLen(value) + 2;
+            size_t display_width = utf8StringLen(row[i]) + 2;
             if (display_width > column_widths[i]) {
                 column_widths[i] = display_width;
             }
         }
-        rows.push_back(row);
     }
     // Print separators with headers
     printLine(column_widths);
@@ -219,196 +331,1176 @@ void doAndPrintQueryResult(sqlite3_stmt *stmt) {
     printLine(column_widths);
 }
 
-// showAllRoutes makes sql query statement for selecting all routes
-void showAllRoutes(sqlite3* db, string queryTemplate) {
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare statement");
+// setStreamWidths sets widths of Stream output columns from widths of the longest values
+void setStreamWidths(const vector<size_t>& widths) {
+    streamWidths.assign(routeHeaders.size(), 0);
+    for (size_t i = 0; i < routeHeaders.size(); ++i) {
+        streamWidths[i] = max(widths[i], size_t(utf8StringLen(routeHeaders[i]))) + 2;
+    }
+}
+
+// computeStreamWidths precomputes widths of Stream output columns from the longest
+// stored values, so rows can be printed without looking at the whole result.
+// False if the scan is stopped by `deadline`
+bool computeStreamWidths(RouteRepository& repo, const QueryDeadline& deadline) {
+    sqlite3_stmt* stmt = repo.routesStatement(SelectRouteWidthsQuery);
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to prepare statement");
+    }
+    QueryTimer timer(stmt);
+    if (timer.step() != SQLITE_ROW) {
+        if (queryInterrupted(repo, deadline, "route_widths")) {
+            sqlite3_reset(stmt);
+            return false;
+        }
+        exitWithError(repo.handle(), "failed to execute statement");
+    }
+    queryMetrics->record("route_widths", timer);
+    vector<size_t> widths(routeHeaders.size());
+    for (size_t i = 0; i < routeHeaders.size(); ++i) {
+        widths[i] = sqlite3_column_int(stmt, i);
+    }
+    sqlite3_reset(stmt);
+    setStreamWidths(widths);
+    return true;
+}
+
+// doAndPrintQueryResult do sql-request and prints it to stdout in `outputFormat`,
+// returns number of rows. The execution is recorded as `name` query.
+// `dayFirstDeparture` prints departure as "dd.mm.yyyy HH:MM:SS",
+// `cursor` gets cursor of the last row of a page statement. A query stopped by
+// `--timeout-ms` or Ctrl-C returns -1: a table prints no rows, other formats keep
+// the rows printed so far, they are never held, and end with a truncation marker
+long doAndPrintQueryResult(RouteRepository& repo, sqlite3_stmt *stmt, const char* name, bool dayFirstDeparture,
+                           string* cursor = nullptr) {
+    Route route;
+    ConsoleDeadline deadline(repo);
+    QueryTimer timer(stmt);
+    if (outputFormat != OutputFormat::Table) {
+        if (outputFormat == OutputFormat::Stream && streamWidths.empty() && !computeStreamWidths(repo, deadline)) {
+            return -1;
+        }
+        // Print rows as they come
+        RowWriter writer(cout, outputFormat, routeHeaders, streamWidths);
+        writer.begin();
+        while (timer.step() == SQLITE_ROW) {
+            RouteColumns::read(stmt, route);
+            writer.row(route, dayFirstDeparture);
+            if (cursor) {
+                *cursor = repo.cursor(stmt);
+            }
+        }
+        queryMetrics->record(name, timer);
+        if (queryInterrupted(repo, deadline, name)) {
+            sqlite3_reset(stmt);
+            writer.truncate(interruptReason(deadline));
+            return -1;
+        }
+        writer.end();
+        return writer.count();
+    }
+    // Do sql request, write results into `rows`
+    vector<vector<string>> rows;
+    while (timer.step() == SQLITE_ROW) {
+        RouteColumns::read(stmt, route);
+        rows.emplace_back();
+        routeCells(route, dayFirstDeparture, rows.back());
+        if (cursor) {
+            *cursor = repo.cursor(stmt);
+        }
+    }
+    queryMetrics->record(name, timer);
+    if (queryInterrupted(repo, deadline, name)) {
+        sqlite3_reset(stmt);
+        return -1;
+    }
+    printQueryResult(rows);
+    return rows.size();
+}
+
+// printPages prints result of `query` page by page, the next page is fetched
+// by cursor of the previous one only when it is asked for. Pages are index
+// seeks, so they are answered by SQLite with any engine
+void printPages(RouteRepository& repo, const char* name, const function<sqlite3_stmt*(const RoutePage&)>& query,
+                bool dayFirstDeparture) {
+    RoutePage page;
+    page.limit = pageSize;
+    string answer;
+    while (true) {
+        sqlite3_stmt* stmt = query(page);
+        if (!stmt) {
+            exitWithError(repo.handle(), "failed to bind parameters");
+        }
+        if (doAndPrintQueryResult(repo, stmt, name, dayFirstDeparture, &page.cursor) < page.limit) {
+            return;
+        }
+        cout << "Next page cursor: " << page.cursor << "\n";
+        cout << "Show next page? (y/n): ";
+        if (!getline(cin, answer) || (answer != "y" && answer != "Y")) {
+            return;
+        }
+    }
+}
+
+// printColumnarResult prints rows selected by `routeIndex` in `outputFormat`
+void printColumnarResult(RouteRepository& repo, const vector<uint32_t>& selected, bool dayFirstDeparture) {
+    if (outputFormat == OutputFormat::Table) {
+        vector<vector<string>> rows(selected.size());
+        for (size_t i = 0; i < selected.size(); ++i) {
+            routeCells(routeIndex->route(selected[i]), dayFirstDeparture, rows[i]);
+        }
+        printQueryResult(rows);
+        return;
+    }
+    if (outputFormat == OutputFormat::Stream && streamWidths.empty()) {
+        ConsoleDeadline deadline(repo);
+        if (!computeStreamWidths(repo, deadline)) {
+            return;
+        }
+    }
+    RowWriter writer(cout, outputFormat, routeHeaders, streamWidths);
+    writer.begin();
+    for (uint32_t position : selected) {
+        writer.row(routeIndex->route(position), dayFirstDeparture);
+    }
+    writer.end();
+}
+
+// showAllRoutes selects and prints all routes
+void showAllRoutes(RouteRepository& repo) {
+    if (pageSize > 0) {
+        printPages(repo, "all_routes_page", [&repo](const RoutePage& page) { return repo.allRoutes(page); }, false);
+        return;
+    }
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->allRoutes(false), false);
+        return;
+    }
+    sqlite3_stmt* stmt = repo.allRoutes();
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to prepare statement");
     }
     // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
+    doAndPrintQueryResult(repo, stmt, "all_routes", false);
 }
 
-// showAllAvaliableRoutes makes sql query statement for selecting all available routes (there is avaliable seats) 
-void showAllAvaliableRoutes(sqlite3* db, string queryTemplate) {
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare statement");
+// showAllAvaliableRoutes selects and prints all available routes (there is avaliable seats) 
+void showAllAvaliableRoutes(RouteRepository& repo) {
+    if (pageSize > 0) {
+        printPages(repo, "available_routes_page", [&repo](const RoutePage& page) { return repo.allAvaliableRoutes(page); }, false);
+        return;
+    }
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->allRoutes(true), false);
+        return;
+    }
+    sqlite3_stmt* stmt = repo.allAvaliableRoutes();
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to prepare statement");
     }
     // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
+    doAndPrintQueryResult(repo, stmt, "available_routes", false);
+}
+
+// loadCities loads cities from the snapshot or the database once
+void loadCities(RouteRepository& repo) {
+    if (cityIndex.isLoaded()) {
+        return;
+    }
+    if (!snapshotPath.empty()) {
+        cityIndex.load(*routeIndex);
+    } else if (!cityIndex.load(repo)) {
+        exitWithError(repo.handle(), "failed to load cities");
+    }
+}
+
+// resolveCity replaces a typed city name with the name of the city it means and
+// returns its id, 0 if it means none and the name is searched as it is
+int64_t resolveCity(RouteRepository& repo, string& name) {
+    if (name.empty()) {
+        return 0;
+    }
+    loadCities(repo);
+    City city;
+    if (!cityIndex.resolve(name, city)) {
+        return 0;
+    }
+    if (city.name != name) {
+        cerr << "Matched " << name << " to " << city.name << "\n";
+        name = city.name;
+    }
+    return city.id;
 }
 
-// findRoutes makes sql query statement for selecting all available routes with specified fields
+// completeCity prints names of cities starting with `prefix`
+void completeCity(RouteRepository& repo, const string& prefix) {
+    loadCities(repo);
+    for (const City& city : cityIndex.complete(prefix, 10)) {
+        cout << city.name << "\n";
+    }
+}
+
+// findRoutes selects and prints all available routes with specified fields
 void findRoutes(
-    sqlite3* db, 
-    string queryTemplate, 
+    RouteRepository& repo, 
     const string& source, 
     const string& destination, 
     const string& date, 
     const string& transportType,
     const string& ticketPrice) {
     // Format date from 'dd.mm.yyyy' to 'yyyy-dd-mm'
-    string formatted_date = convertToSQLiteFormat(date);
-    sqlite3_stmt* stmt;
-    // Inserting query parameters into query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
-    }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, formatted_date.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 2, source.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 3, destination.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 4, transportType.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 5, transportType.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 6, ticketPrice.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 7, ticketPrice.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
+    RouteSearch search;
+    search.date = convertToSQLiteFormat(date);
+    search.source = source;
+    search.destination = destination;
+    search.transportType = transportType;
+    search.ticketPrice = ticketPrice;
+    // Cities are searched by ids of the cities the names mean
+    search.sourceId = resolveCity(repo, search.source);
+    search.destinationId = resolveCity(repo, search.destination);
+    if (pageSize > 0) {
+        printPages(repo, "search_routes_page", [&](const RoutePage& page) { return repo.searchRoutes(search, page); }, true);
+        return;
     }
-    // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
-}
-
-// findRoutesByTransport makes sql query statement for selecting 
-// available routes with specified `transport_type`
-void findRoutesByTransport(
-    sqlite3* db, 
-    string queryTemplate, 
-    const string& transportType) {
-    sqlite3_stmt* stmt;
-    // Inserting query parameters into query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->search(search), true);
+        return;
     }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, transportType.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
+    sqlite3_stmt* stmt = repo.searchRoutes(search);
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to bind parameters");
     }
     // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
+    doAndPrintQueryResult(repo, stmt, "search_routes", true);
 }
 
-void findRoutesByDestination(
-    sqlite3* db, 
-    string queryTemplate, 
-    const string& destination) {
-    sqlite3_stmt* stmt;
-    // Inserting query parameters into query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
+// findRoutesByTransport selects and prints available routes with specified `transport_type`
+void findRoutesByTransport(RouteRepository& repo, const string& transportType) {
+    if (pageSize > 0) {
+        printPages(repo, "routes_by_transport_page", [&](const RoutePage& page) { return repo.routesByTransport(transportType, page); }, true);
+        return;
     }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, destination.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->routesByTransport(transportType), true);
+        return;
+    }
+    sqlite3_stmt* stmt = repo.routesByTransport(transportType);
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to bind parameters");
     }
     // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
+    doAndPrintQueryResult(repo, stmt, "routes_by_transport", true);
 }
 
-// findRoutesByPrice makes sql query statement for selecting 
-// available routes with specified `ticket_price`
-void findRoutesByPrice(
-    sqlite3* db, 
-    string queryTemplate, 
-    const string& ticketPrice) {
-    sqlite3_stmt* stmt;
-    // Inserting query parameters into query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
+// findRoutesByDestination selects and prints available routes with specified destination
+void findRoutesByDestination(RouteRepository& repo, string destination) {
+    int64_t destinationId = resolveCity(repo, destination);
+    if (pageSize > 0) {
+        printPages(repo, "routes_by_destination_page", [&](const RoutePage& page) { return repo.routesByDestination(destination, page, destinationId); }, true);
+        return;
     }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, ticketPrice.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->routesByDestination(destination), true);
+        return;
+    }
+    sqlite3_stmt* stmt = repo.routesByDestination(destination, destinationId);
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to bind parameters");
     }
     // Do query and print th results
-    doAndPrintQueryResult(stmt);
-    sqlite3_finalize(stmt);
+    doAndPrintQueryResult(repo, stmt, "routes_by_destination", true);
 }
 
-// insertIfNotExists inserts value into table is value not exists
-void insertIfNotExists(sqlite3* db, const string& queryTemplate, const string& field) {
-    sqlite3_stmt* stmt = nullptr;
-    // Preparing query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
+// findRoutesByPrice selects and prints available routes with specified `ticket_price`
+void findRoutesByPrice(RouteRepository& repo, const string& ticketPrice) {
+    if (pageSize > 0) {
+        printPages(repo, "routes_by_price_page", [&](const RoutePage& page) { return repo.routesByPrice(ticketPrice, page); }, true);
+        return;
     }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, field.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
-        sqlite3_bind_text(stmt, 2, field.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
+    if (routeIndex) {
+        printColumnarResult(repo, routeIndex->routesByPrice(ticketPrice), true);
+        return;
     }
-    // Do query
-    int rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        exitWithError(db, "failed to execute statement");
+    sqlite3_stmt* stmt = repo.routesByPrice(ticketPrice);
+    if (!stmt) {
+        exitWithError(repo.handle(), "failed to bind parameters");
     }
-    // Free resources
-    sqlite3_finalize(stmt);
+    // Do query and print th results
+    doAndPrintQueryResult(repo, stmt, "routes_by_price", true);
 }
 
 // insertRoute inserts a new route by specified parameters
 void insertRoute(
-    sqlite3* db, 
-    string queryTemplate, 
-    string& flight,
-    string& source, 
-    string& destination, 
-    string& departureDate, 
-    string& arrivalDate,
-    string& transportType, 
-    string& ticketPrice, 
-    string& distance, 
-    string& seatsAvaliable) {
+    RouteRepository& repo, 
+    const string& flight,
+    const string& source, 
+    const string& destination, 
+    const string& departureDate, 
+    const string& arrivalDate,
+    const string& transportType, 
+    const string& ticketPrice, 
+    const string& distance, 
+    const string& seatsAvaliable) {
+    NewRoute route;
+    route.flight = flight;
+    route.source = source;
+    route.destination = destination;
+    route.transportType = transportType;
+    route.distance = atoll(distance.c_str());
+    route.seats = atoll(seatsAvaliable.c_str());
     // Format date from 'dd.mm.yyyy' to 'yyyy-dd-mm'
-    string departureDateFormatted = convertToSQLiteFormat(departureDate);
-    string arrivalDateFormatted = convertToSQLiteFormat(arrivalDate);
-    // Insert specified transport_type, source and destination cities 
-    // if they are not exists in corresponding tables
-    insertIfNotExists(db, InsertInTranportTypesIfNotExists, transportType);
-    insertIfNotExists(db, InsertInDestinationsIfNotExists, source);
-    insertIfNotExists(db, InsertInDestinationsIfNotExists, destination);
-
-    sqlite3_stmt* stmt;
-    // Inserting query parameters into query
-    if (sqlite3_prepare_v2(db, queryTemplate.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        exitWithError(db, "failed to prepare query");
-    }
-    // Bind parameters
-    if (sqlite3_bind_text(stmt, 1, flight.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 2, transportType.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 3, source.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 4, destination.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 5, distance.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 6, departureDateFormatted.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 7, arrivalDateFormatted.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 8, seatsAvaliable.c_str(), -1, SQLITE_STATIC)!= SQLITE_OK ||
-        sqlite3_bind_text(stmt, 9, ticketPrice.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        exitWithError(db, "failed to bind parameters");
-    }
-    // Do query
-    int rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        exitWithError(db, "failed to execute statement");
-    }
-    // Free resources
-    sqlite3_finalize(stmt);
-}
-
-int main() {
-    sqlite3* db;
-    if (sqlite3_open(pathDB, &db) != SQLITE_OK) {
-        exitWithError(db, "cannot open database");
+    if (!parseSQLiteTime(convertToSQLiteFormat(departureDate), route.departure) ||
+        !parseSQLiteTime(convertToSQLiteFormat(arrivalDate), route.arrival) ||
+        !parseCents(ticketPrice, route.priceCents)) {
+        cerr << "invalid route\n";
+        exit(1);
+    }
+    auto start = chrono::steady_clock::now();
+    if (!repo.insertRoute(route)) {
+        exitWithError(repo.handle(), "failed to execute statement");
+    }
+    queryMetrics->record("insert_route", nullptr, secondsSince(start), 1);
+    // Keep columnar index up to date
+    sqlite3_int64 id = sqlite3_last_insert_rowid(repo.handle());
+    // New values may be wider than precomputed
+    streamWidths.clear();
+    if (columnarIndex && !columnarIndex->append(repo, id)) {
+        exitWithError(repo.handle(), "failed to update columnar index");
+    }
+    if (!journeyPlanner.add(repo, id)) {
+        exitWithError(repo.handle(), "failed to update journey planner");
+    }
+    // The route may have added cities
+    if (!cityIndex.refresh(repo)) {
+        exitWithError(repo.handle(), "failed to update cities");
+    }
+}
+
+// refreshSeats keeps columnar index and journey planner up to date after seats of routes changed
+void refreshSeats(RouteRepository& repo, const vector<sqlite3_int64>& routeIds) {
+    // Fewer seats may be narrower than precomputed and more may be wider
+    streamWidths.clear();
+    for (sqlite3_int64 id : routeIds) {
+        if (columnarIndex && !columnarIndex->updateSeats(repo, id)) {
+            exitWithError(repo.handle(), "failed to update columnar index");
+        }
+        if (!journeyPlanner.update(repo, id)) {
+            exitWithError(repo.handle(), "failed to update journey planner");
+        }
+    }
+}
+
+// bookRoutes books seats on every route of `routes`, a journey is booked as a whole
+void bookRoutes(RouteRepository& repo, const string& routes, const string& seats) {
+    vector<sqlite3_int64> routeIds;
+    if (!parseRouteIds(routes, routeIds)) {
+        cerr << "invalid route ids\n";
+        exit(1);
+    }
+    if (seats.find_first_not_of("0123456789") != string::npos || seats.size() > 9) {
+        cerr << "invalid number of seats\n";
+        exit(1);
+    }
+    auto start = chrono::steady_clock::now();
+    BookingResult result = bookSeats(repo, routeIds, seats.empty() ? 1 : atoi(seats.c_str()));
+    queryMetrics->record("book_seats", nullptr, secondsSince(start), result.routeIds.size());
+    if (result.status == BookingStatus::Failed) {
+        exitWithError(repo.handle(), "failed to book seats: " + result.error);
+    }
+    if (result.status != BookingStatus::Done) {
+        cout << "Booking rejected: " << result.error << "\n";
+        return;
+    }
+    refreshSeats(repo, result.routeIds);
+    cout << "Booked, booking id: " << result.bookingId << "\n";
+}
+
+// cancelRouteBooking cancels a booking and returns its seats
+void cancelRouteBooking(RouteRepository& repo, const string& booking) {
+    if (booking.empty() || booking.find_first_not_of("0123456789") != string::npos || booking.size() > 18) {
+        cerr << "invalid booking id\n";
+        exit(1);
+    }
+    auto start = chrono::steady_clock::now();
+    BookingResult result = cancelBooking(repo, strtoll(booking.c_str(), nullptr, 10));
+    queryMetrics->record("cancel_booking", nullptr, secondsSince(start), result.routeIds.size());
+    if (result.status == BookingStatus::Failed) {
+        exitWithError(repo.handle(), "failed to cancel booking: " + result.error);
+    }
+    if (result.status != BookingStatus::Done) {
+        cout << "Cancellation rejected: " << result.error << "\n";
+        return;
+    }
+    refreshSeats(repo, result.routeIds);
+    cout << "Booking " << result.bookingId << " cancelled\n";
+}
+
+// showRouteAggregate prints number of routes, available seats and the cheapest
+// fare between two cities on a day, they are read from route aggregates
+void showRouteAggregate(
+    RouteRepository& repo,
+    string source,
+    string destination,
+    const string& date,
+    const string& transportType) {
+    int64_t sourceId = resolveCity(repo, source);
+    int64_t destinationId = resolveCity(repo, destination);
+    int64_t departure = 0;
+    parseSQLiteTime(convertToSQLiteFormat(date), departure);
+    RouteAggregate aggregate;
+    ConsoleDeadline deadline(repo);
+    auto start = chrono::steady_clock::now();
+    if (!repo.routeAggregate(sourceId, destinationId, departure / 86400, transportType, aggregate)) {
+        if (queryInterrupted(repo, deadline, "route_aggregate")) {
+            return;
+        }
+        exitWithError(repo.handle(), "failed to read route aggregates");
+    }
+    queryMetrics->record("route_aggregate", nullptr, secondsSince(start), 1);
+    cout << "Routes: " << aggregate.routes << "\n";
+    cout << "Routes with available seats: " << aggregate.availableRoutes << "\n";
+    cout << "Seats available: " << aggregate.seats << "\n";
+    cout << "Cheapest fare: " << (aggregate.minPrice < 0 ? "sold out" : formatCents(aggregate.minPrice)) << "\n";
+}
+
+// showFareCalendar prints the cheapest fare and number of routes with available
+// seats between two cities for every day from `firstDate` to `lastDate`
+void showFareCalendar(
+    RouteRepository& repo,
+    string source,
+    string destination,
+    const string& firstDate,
+    const string& lastDate,
+    const string& transportType) {
+    int64_t sourceId = resolveCity(repo, source);
+    int64_t destinationId = resolveCity(repo, destination);
+    int64_t first = 0, last = 0;
+    parseSQLiteTime(convertToSQLiteFormat(firstDate), first);
+    if (lastDate.empty()) {
+        last = first + 29 * 86400;
+    } else {
+        parseSQLiteTime(convertToSQLiteFormat(lastDate), last);
+    }
+    if (last < first || last - first >= 366 * 86400) {
+        cerr << "invalid date range\n";
+        exit(1);
+    }
+    vector<FareDay> days;
+    ConsoleDeadline deadline(repo);
+    auto start = chrono::steady_clock::now();
+    if (!repo.fareCalendar(sourceId, destinationId, first / 86400, last / 86400, transportType, days)) {
+        if (queryInterrupted(repo, deadline, "fare_calendar")) {
+            return;
+        }
+        exitWithError(repo.handle(), "failed to read fare calendar");
+    }
+    queryMetrics->record("fare_calendar", nullptr, secondsSince(start), days.size());
+    for (const FareDay& day : days) {
+        cout << formatSQLiteTime(day.day * 86400).substr(0, 10) << "  " << setw(4) << day.availableRoutes << "  "
+             << (day.minPrice < 0 ? "-" : formatCents(day.minPrice)) << "\n";
+    }
+}
+
+// planJourney finds and prints journeys with connections between two cities
+void planJourney(
+    RouteRepository& repo,
+    string source,
+    string destination,
+    const string& date,
+    const string& objective,
+    const string& minTransfer,
+    const string& maxLegs) {
+    JourneyRequest request;
+    request.source = resolveCity(repo, source);
+    request.destination = resolveCity(repo, destination);
+    parseSQLiteTime(convertToSQLiteFormat(date), request.departAfter);
+    request.minTransfer = atoll(minTransfer.c_str()) * 60;
+    if (!maxLegs.empty()) {
+        request.maxLegs = atoi(maxLegs.c_str());
+    }
+    if (objective == "cheapest") {
+        request.objective = JourneyObjective::Cheapest;
+    } else if (objective == "pareto") {
+        request.objective = JourneyObjective::Pareto;
+    }
+    if (!journeyPlanner.isLoaded()) {
+        ConsoleDeadline deadline(repo);
+        if (!journeyPlanner.load(repo)) {
+            if (queryInterrupted(repo, deadline, "load_timetable")) {
+                return;
+            }
+            exitWithError(repo.handle(), "failed to load timetable");
+        }
+    }
+    auto start = chrono::steady_clock::now();
+    vector<Journey> journeys = journeyPlanner.plan(request);
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (journeys.empty()) {
+        cout << "No journeys found\n";
+    }
+    for (size_t i = 0; i < journeys.size(); ++i) {
+        const Journey& journey = journeys[i];
+        cout << "Journey " << i + 1 << ": departure " << formatEpoch(journey.departure)
+             << ", arrival " << formatEpoch(journey.arrival)
+             << ", price " << formatCents(journey.price) << ", legs " << journey.routeIds.size() << "\n";
+        vector<vector<string>> rows;
+        for (int64_t routeId : journey.routeIds) {
+            // Legs may be in partitions, the planner reads them as well
+            sqlite3_stmt* stmt = repo.routesStatement(SelectRouteByIdQuery);
+            if (!stmt || sqlite3_bind_int64(stmt, 1, routeId) != SQLITE_OK) {
+                exitWithError(repo.handle(), "failed to bind parameters");
+            }
+            Route route;
+            QueryTimer timer(stmt);
+            const size_t legs = rows.size();
+            while (timer.step() == SQLITE_ROW) {
+                RouteColumns::read(stmt, route);
+                rows.emplace_back();
+                routeCells(route, true, rows.back());
+            }
+            queryMetrics->record("route_by_id", timer);
+            if (rows.size() == legs) {
+                exitWithError(nullptr,
+                              "route " + to_string(routeId) + " of journey " + to_string(i + 1) + " not found");
+            }
+        }
+        printQueryResult(rows);
+    }
+    cout << "Planned over " << journeyPlanner.size() << " routes in "
+         << fixed << setprecision(3) << elapsed << " ms\n";
+    cout.unsetf(ios::floatfield);
+}
+
+// showStatementStats prints how many statements were prepared and how many were reused
+void showStatementStats(const RouteRepository& repo) {
+    cout << "Prepared statements: " << repo.prepares() << "\n";
+    cout << "Reused statements: " << repo.reuses() << "\n";
+}
+
+// dumpQueryMetrics writes query metrics in Prometheus text format to `--metrics`
+// file, replacing the previous dump, or prints them
+void dumpQueryMetrics() {
+    string text;
+    queryMetrics->writePrometheus(text);
+    if (metricsPath.empty()) {
+        cout << text;
+        return;
+    }
+    ofstream file(metricsPath, ios::trunc);
+    if (!(file << text)) {
+        cerr << "error: cannot write " << metricsPath << "\n";
+        return;
+    }
+    cout << "Query metrics written to " << metricsPath << "\n";
+}
+
+// runImport imports routes without interaction:
+// import [FILE|-] [--format csv|jsonl] [--batch N]
+int runImport(RouteRepository& repo, int argc, char* argv[]) {
+    string path = "-";
+    ImportFormat format = ImportFormat::CSV;
+    bool formatSet = false;
+    size_t batchSize = 10000;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            string name = argv[++i];
+            if (name != "csv" && name != "jsonl") {
+                cerr << "invalid import format: " << name << "\n";
+                return EXIT_FAILURE;
+            }
+            format = name == "csv" ? ImportFormat::CSV : ImportFormat::JSONL;
+            formatSet = true;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchSize = strtoul(argv[++i], nullptr, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    // Guess format by file extension
+    if (!formatSet && path.size() > 6 && path.compare(path.size() - 6, 6, ".jsonl") == 0) {
+        format = ImportFormat::JSONL;
+    }
+    ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "error: cannot open " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    RouteImporter importer(repo, batchSize);
+    ImportStats stats;
+    bool ok = importer.run(path == "-" ? cin : file, format, stats);
+    if (!ok) {
+        cerr << "error: import failed: " << sqlite3_errmsg(repo.handle()) << "\n";
+    }
+    cout << "Imported routes: " << stats.imported << "\n";
+    cout << "Rejected records: " << stats.rejected << "\n";
+    cout << "Committed batches: " << stats.batches << "\n";
+    if (ok && stats.seconds > 0) {
+        cout << "Rows per second: " << fixed << setprecision(0) << stats.imported / stats.seconds << "\n";
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runReplay replays a stream of operations without interaction and prints
+// latency percentiles per operation: replay [FILE|-] [--hdr]
+int runReplay(RouteRepository& repo, int argc, char* argv[]) {
+    string path = "-";
+    bool distribution = false;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--hdr") == 0) {
+            distribution = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "error: cannot open " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    WorkloadReplayer replayer(repo, columnarIndex, journeyPlanner);
+    replayer.run(path == "-" ? cin : file, cerr);
+    replayer.report(cout, distribution);
+    return EXIT_SUCCESS;
+}
+
+// printSearchResult prints a result of a search batch as a JSON line
+void printSearchResult(size_t index, const SearchResult& result) {
+    string line = "{\"request\":" + to_string(index);
+    if (!result.error.empty()) {
+        line += ",\"error\":";
+        appendJSONString(line, result.error);
+    } else {
+        line += ",\"rows\":" + to_string(result.rows) + ",\"routes\":" + result.body;
+    }
+    cout << line << "}\n";
+}
+
+// runSearchBatch runs independent searches concurrently on a pool of read
+// connections and prints results as JSON lines in request order, or in order
+// of completion with `--stream`: search-batch [FILE|-] [--workers N] [--stream].
+// Every input line is a search {"date":...,"source":...,"destination":...,"transport":...,"price":...}
+int runSearchBatch(int argc, char* argv[]) {
+    string path = "-";
+    int workers = 0;
+    bool stream = false;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "error: cannot open " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    istream& in = path == "-" ? cin : file;
+    vector<RouteSearch> searches;
+    string line, error;
+    for (long lineNumber = 1; getline(in, line); ++lineNumber) {
+        if (line.find_first_not_of(" \t\r") == string::npos) {
+            continue;
+        }
+        RouteSearch search;
+        bool parsed = RouteImporter::parseJSONObject(line, error, [&search](const string& key, const string& value) {
+            if (key == "date") {
+                search.date = value;
+            } else if (key == "source") {
+                search.source = value;
+            } else if (key == "destination") {
+                search.destination = value;
+            } else if (key == "transport") {
+                search.transportType = value;
+            } else if (key == "price") {
+                search.ticketPrice = value;
+            }
+        });
+        if (parsed && !search.date.empty() && !RouteImporter::normalizeDate(search.date)) {
+            parsed = false;
+            error = "invalid date format";
+        }
+        if (parsed && !search.ticketPrice.empty() && !RouteImporter::isNumber(search.ticketPrice)) {
+            parsed = false;
+            error = "invalid price";
+        }
+        if (!parsed) {
+            cerr << "error: line " << lineNumber << ": " << error << "\n";
+            return EXIT_FAILURE;
+        }
+        searches.push_back(search);
+    }
+    SearchExecutor executor(workers, queryMetrics, queryTimeoutMs / 1000);
+    if (!executor.open(pathDB, error)) {
+        cerr << "error: cannot open database: " << error << "\n";
+        return EXIT_FAILURE;
+    }
+    auto start = chrono::steady_clock::now();
+    size_t searched = 0;
+    long rows = 0;
+    executor.run(searches, [&](size_t index, SearchResult& result) {
+        printSearchResult(index, result);
+        ++searched;
+        rows += result.rows;
+    }, stream);
+    double seconds = secondsSince(start);
+    cerr << "Searches: " << searched << ", rows: " << rows << ", connections: " << executor.size()
+         << ", wall time " << fixed << setprecision(3) << seconds << " s, throughput " << setprecision(0)
+         << (seconds > 0 ? searched / seconds : 0) << " searches/s\n";
+    return EXIT_SUCCESS;
+}
+
+// runMigrate converts the database to the current schema version in place: migrate
+int runMigrate(RouteRepository& repo) {
+    MigrationStats stats;
+    if (!migrateSchema(repo, "internal/migrations", stats)) {
+        exitWithError(repo.handle(), "failed to migrate database");
+    }
+    if (stats.fromVersion >= RouteSchemaVersion) {
+        cout << "Schema is up to date, version " << stats.fromVersion << "\n";
+        return EXIT_SUCCESS;
+    }
+    cout << "Migrated schema from version " << stats.fromVersion << " to " << RouteSchemaVersion << " in "
+         << fixed << setprecision(1) << stats.seconds << " s\n";
+    cout << "Database size: " << stats.bytesBefore / 1e6 << " MB -> " << stats.bytesAfter / 1e6 << " MB\n";
+    return EXIT_SUCCESS;
+}
+
+// runPartition moves routes departing before a month into monthly partitions:
+// partition --before yyyy-mm
+int runPartition(RouteRepository& repo, int argc, char* argv[]) {
+    if (argc != 4 || strcmp(argv[2], "--before") != 0) {
+        cerr << "usage: partition --before yyyy-mm\n";
+        return EXIT_FAILURE;
+    }
+    PartitionStats stats;
+    string error;
+    if (!partitionRoutes(repo, argv[3], stats, error)) {
+        exitWithError(nullptr, "failed to partition routes: " + error);
+    }
+    cout << "Moved " << stats.routes << " routes into " << stats.partitions << " partitions in " << fixed
+         << setprecision(1) << stats.seconds << " s\n";
+    return EXIT_SUCCESS;
+}
+
+// runListPartitions prints partitions of routes: partitions
+int runListPartitions(RouteRepository& repo) {
+    vector<RoutePartition> partitions;
+    if (!listPartitions(repo, partitions)) {
+        exitWithError(repo.handle(), "failed to list partitions");
+    }
+    for (const RoutePartition& partition : partitions) {
+        cout << partition.name << "  " << formatSQLiteTime(partition.monthStart).substr(0, 10) << " - "
+             << formatSQLiteTime(partition.monthEnd - 1).substr(0, 10) << "  " << partition.routes << " routes\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+// runArchivePartition moves a partition into a database file of its own:
+// archive-partition NAME FILE
+int runArchivePartition(RouteRepository& repo, int argc, char* argv[]) {
+    if (argc != 4) {
+        cerr << "usage: archive-partition NAME FILE\n";
+        return EXIT_FAILURE;
+    }
+    string error;
+    if (!archivePartition(repo, argv[2], argv[3], error)) {
+        exitWithError(nullptr, "failed to archive partition: " + error);
+    }
+    cout << "Archived " << argv[2] << " into " << argv[3] << "\n";
+    return EXIT_SUCCESS;
+}
+
+// runRestorePartition brings partitions of an archive file back: restore-partition FILE
+int runRestorePartition(RouteRepository& repo, int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "usage: restore-partition FILE\n";
+        return EXIT_FAILURE;
+    }
+    vector<RoutePartition> restored;
+    string error;
+    if (!restorePartition(repo, argv[2], restored, error)) {
+        exitWithError(nullptr, "failed to restore partition: " + error);
+    }
+    for (const RoutePartition& partition : restored) {
+        cout << "Restored " << partition.name << ", " << partition.routes << " routes\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+// runGenerate writes a synthetic timetable into the database or into an import file:
+// generate [--cities N] [--transports N] [--days N] [--routes-per-day N] [--seed S]
+//          [--start yyyy-mm-dd] [--out FILE|-] [--format csv|jsonl]
+int runGenerate(RouteRepository& repo, int argc, char* argv[]) {
+    TimetableOptions options;
+    string out;
+    ImportFormat format = ImportFormat::CSV;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--cities") == 0) {
+            options.cities = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--transports") == 0) {
+            options.transports = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--days") == 0) {
+            options.days = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--routes-per-day") == 0) {
+            options.routesPerDay = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            options.seed = strtoull(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "--start") == 0) {
+            options.start = argv[i + 1];
+        } else if (strcmp(argv[i], "--out") == 0) {
+            out = argv[i + 1];
+        } else if (strcmp(argv[i], "--format") == 0) {
+            format = strcmp(argv[i + 1], "jsonl") == 0 ? ImportFormat::JSONL : ImportFormat::CSV;
+        }
+    }
+    if (options.cities < 2 || options.days < 1 || options.routesPerDay < 1 || !RouteImporter::normalizeDate(options.start)) {
+        cerr << "invalid generator options\n";
+        return EXIT_FAILURE;
+    }
+    if (out.empty()) {
+        ImportStats stats;
+        if (!generateTimetable(repo, options, "internal/migrations", stats)) {
+            exitWithError(repo.handle(), "failed to generate timetable");
+        }
+        cout << "Generated routes: " << stats.imported << "\n";
+        cout << "Rows per second: " << fixed << setprecision(0) << stats.imported / stats.seconds << "\n";
+        return EXIT_SUCCESS;
+    }
+    // Guess format by file extension
+    if (out.size() > 6 && out.compare(out.size() - 6, 6, ".jsonl") == 0) {
+        format = ImportFormat::JSONL;
+    }
+    ofstream file;
+    if (out != "-") {
+        file.open(out);
+        if (!file) {
+            cerr << "error: cannot open " << out << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    ostream& stream = out == "-" ? cout : file;
+    TimetableGenerator generator(options);
+    RouteRecord record;
+    TimetableGenerator::writeHeader(stream, format);
+    while (generator.next(record)) {
+        TimetableGenerator::writeRecord(stream, format, record);
+    }
+    return stream ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runBench runs microbenchmarks of every query at several dataset sizes and
+// appends results as JSON lines: bench [--sizes N,N,...] [--iterations N]
+// [--budget SECONDS] [--workdir DIR] [--label TEXT] [--out FILE]
+int runBench(int argc, char* argv[]) {
+    BenchOptions options;
+    string out = "-";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--sizes") == 0) {
+            options.sizes.clear();
+            stringstream sizes(argv[i + 1]);
+            string size;
+            while (getline(sizes, size, ',')) {
+                options.sizes.push_back(atol(size.c_str()));
+            }
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            options.iterations = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            options.budget = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--workdir") == 0) {
+            options.workdir = argv[i + 1];
+        } else if (strcmp(argv[i], "--label") == 0) {
+            options.label = argv[i + 1];
+        } else if (strcmp(argv[i], "--out") == 0) {
+            out = argv[i + 1];
+        }
+    }
+    ofstream file;
+    if (out != "-") {
+        file.open(out, ios::app);
+        if (!file) {
+            cerr << "error: cannot open " << out << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    return runBenchmarks(options, out == "-" ? cout : file) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runExportSnapshot exports the timetable into a snapshot file:
+// export-snapshot FILE
+int runExportSnapshot(RouteRepository& repo, int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "usage: main export-snapshot FILE\n";
+        return EXIT_FAILURE;
+    }
+    SnapshotStats stats;
+    string error;
+    if (!writeSnapshot(repo, argv[2], stats, error)) {
+        cerr << "error: failed to export snapshot: " << error << "\n";
+        return EXIT_FAILURE;
+    }
+    char checksum[17];
+    snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)stats.checksum);
+    cout << "Exported " << stats.routes << " routes, " << stats.bytes << " bytes, checksum " << checksum
+         << " in " << fixed << setprecision(3) << stats.seconds << " s\n";
+    return EXIT_SUCCESS;
+}
+
+// runCheckPlans explains every combination of search filters and fails when one
+// of them scans routes: check-plans
+int runCheckPlans(RouteRepository& repo) {
+    return checkSearchPlans(repo, cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runVerifySnapshot checks header and checksum of a snapshot file:
+// verify-snapshot FILE
+int runVerifySnapshot(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "usage: main verify-snapshot FILE\n";
+        return EXIT_FAILURE;
+    }
+    RouteSnapshot snapshot;
+    string error;
+    if (!snapshot.open(argv[2], error) || !snapshot.verify(error)) {
+        cerr << "error: invalid snapshot: " << error << "\n";
+        return EXIT_FAILURE;
+    }
+    char checksum[17];
+    snprintf(checksum, sizeof(checksum), "%016llx", (unsigned long long)snapshot.checksum());
+    cout << "Snapshot is valid: " << snapshot.size() << " routes, checksum " << checksum << "\n";
+    return EXIT_SUCCESS;
+}
+
+// openSnapshot maps the snapshot of `--snapshot`, it is checked by its header,
+// so pages of the file are only read when lists touch them
+bool openSnapshot(RouteSnapshot& snapshot) {
+    string error;
+    if (!snapshot.open(snapshotPath, error)) {
+        cerr << "error: cannot open snapshot: " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+// stopServer stops event loop of the server on SIGINT and SIGTERM
+void stopServer(int) {
+    serverStopping = 1;
+}
+
+// runServer serves route operations over HTTP/JSON:
+// serve [--port P] [--workers N] [--batch B] [--cache-mb M] [--heavy H] [--heavy-queue Q].
+// At most H heavy reads run at once and Q more wait, `--timeout-ms` bounds reads.
+// At least one worker is kept for cheap reads, so serve needs 2 workers and H
+// below N, by default N is the number of cores but at least 2. With `--snapshot` it is a read-only replica that serves lists from the snapshot
+int runServer(int argc, char* argv[]) {
+    int port = 8080;
+    int workers = max(2, int(thread::hardware_concurrency()));
+    int batch = 64;
+    long cacheMB = 64;
+    int heavy = 0;
+    long heavyQueue = 64;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--port") == 0) {
+            port = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--workers") == 0) {
+            workers = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--cache-mb") == 0) {
+            cacheMB = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--heavy") == 0) {
+            heavy = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--heavy-queue") == 0) {
+            heavyQueue = atol(argv[i + 1]);
+        }
+    }
+    if (workers < 2) {
+        cerr << "error: serve needs at least 2 workers, one is kept for cheap reads\n";
+        return EXIT_FAILURE;
+    }
+    if (heavy >= workers) {
+        cerr << "error: --heavy must be below --workers, one worker is kept for cheap reads\n";
+        return EXIT_FAILURE;
+    }
+    RouteSnapshot snapshot;
+    if (!snapshotPath.empty() && !openSnapshot(snapshot)) {
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    RouteServer server(pathDB, port, workers, batch, size_t(max(0L, cacheMB)) << 20, slowQueryMs / 1000,
+                       snapshotPath.empty() ? nullptr : &snapshot, queryTimeoutMs / 1000, heavy,
+                       size_t(max(0L, heavyQueue)));
+    return server.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runLoad drives a running server:
+// loadgen [--port P] [--connections C] [--requests N] [--insert-every K] [--book ROUTE_ID]
+int runLoad(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--port") == 0) {
+            options.port = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            options.connections = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--requests") == 0) {
+            options.requests = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--insert-every") == 0) {
+            options.insertEvery = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--book") == 0) {
+            options.bookRoute = atol(argv[i + 1]);
+        }
+    }
+    return runLoadGenerator(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    // Leading options: `--db PATH` overrides database path,
+    // `--engine sqlite|columnar` selects how searches are answered,
+    // `--output table|stream|csv|jsonl` selects how results are printed,
+    // `--page-size N` prints lists by pages of N rows,
+    // `--slow-ms N` logs queries slower than N ms with their plans to stderr,
+    // `--metrics FILE` is where query metrics are dumped,
+    // `--timeout-ms N` stops queries running longer than N ms, the operation fails and the rest go on,
+    // `--snapshot FILE` answers lists from a snapshot read-only, without the database
+    string engine = "sqlite";
+    string output = "table";
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--db") == 0) {
+            pathDB = argv[2];
+        } else if (strcmp(argv[1], "--engine") == 0) {
+            engine = argv[2];
+        } else if (strcmp(argv[1], "--output") == 0) {
+            output = argv[2];
+        } else if (strcmp(argv[1], "--page-size") == 0) {
+            pageSize = atoi(argv[2]);
+        } else if (strcmp(argv[1], "--slow-ms") == 0) {
+            slowQueryMs = atof(argv[2]);
+        } else if (strcmp(argv[1], "--metrics") == 0) {
+            metricsPath = argv[2];
+        } else if (strcmp(argv[1], "--timeout-ms") == 0) {
+            queryTimeoutMs = atof(argv[2]);
+        } else if (strcmp(argv[1], "--snapshot") == 0) {
+            snapshotPath = argv[2];
+        } else {
+            break;
+        }
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+    if (output == "stream") {
+        outputFormat = OutputFormat::Stream;
+    } else if (output == "csv") {
+        outputFormat = OutputFormat::CSV;
+    } else if (output == "jsonl") {
+        outputFormat = OutputFormat::JSONL;
+    } else if (output != "table") {
+        cerr << "invalid output format: " << output << "\n";
+        return EXIT_FAILURE;
+    }
+    QueryMetrics metrics(slowQueryMs / 1000);
+    queryMetrics = &metrics;
+    // Server and load generator open their own connections
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return runServer(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "loadgen") == 0) {
+        return runLoad(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return runBench(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "verify-snapshot") == 0) {
+        return runVerifySnapshot(argc, argv);
+    }
+    RouteRepository repo;
+    RouteSnapshot snapshot;
+    if (!snapshotPath.empty()) {
+        // Lists are answered from the snapshot, pages and writes need the database
+        if (argc > 1) {
+            cerr << "error: " << argv[1] << " needs the database, not a snapshot\n";
+            return EXIT_FAILURE;
+        }
+        if (pageSize > 0) {
+            cerr << "error: pages are not supported by a snapshot\n";
+            return EXIT_FAILURE;
+        }
+        if (!openSnapshot(snapshot)) {
+            return EXIT_FAILURE;
+        }
+        routeIndex = &snapshot;
+        setStreamWidths(snapshot.streamWidths());
+    } else if (!repo.open(pathDB)) {
+        cerr << "error: cannot open database: " << repo.error() << endl;
+        return EXIT_FAILURE;
+    }
+    if (argc > 1 && strcmp(argv[1], "migrate") == 0) {
+        return runMigrate(repo);
+    }
+    if (snapshotPath.empty() && repo.hasSchema() && repo.schemaVersion() < RouteSchemaVersion) {
+        cerr << "error: database schema is outdated, run `main migrate` first\n";
+        return EXIT_FAILURE;
+    }
+    // Search batches open their own pool of connections
+    if (argc > 1 && strcmp(argv[1], "search-batch") == 0) {
+        return runSearchBatch(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "check-plans") == 0) {
+        return runCheckPlans(repo);
+    }
+    if (argc > 1 && strcmp(argv[1], "export-snapshot") == 0) {
+        return runExportSnapshot(repo, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "partition") == 0) {
+        return runPartition(repo, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "partitions") == 0) {
+        return runListPartitions(repo);
+    }
+    if (argc > 1 && strcmp(argv[1], "archive-partition") == 0) {
+        return runArchivePartition(repo, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "restore-partition") == 0) {
+        return runRestorePartition(repo, argc, argv);
+    }
+    ColumnarRouteIndex columnar;
+    if (engine == "columnar" && !routeIndex) {
+        if (!columnar.load(repo)) {
+            exitWithError(repo.handle(), "failed to load columnar index");
+        }
+        columnarIndex = &columnar;
+        routeIndex = &columnar;
+    } else if (engine != "sqlite") {
+        cerr << "invalid engine: " << engine << "\n";
+        return EXIT_FAILURE;
+    }
+    if (argc > 1 && strcmp(argv[1], "import") == 0) {
+        return runImport(repo, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "generate") == 0) {
+        return runGenerate(repo, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "replay") == 0) {
+        return runReplay(repo, argc, argv);
     }
     // Define query parameters
     string source, flight, destination, departureDate, arrivalDate, 
     transportType, ticketPrice, distance, seatsAvaliable;
 
     cout << "Welcome to the Route Finder!\n";
+    signal(SIGINT, cancelQuery);
 
     string operatoinRaw;
     int operation;
@@ -421,29 +1513,42 @@ int main() {
         cout << "Find route by transport type - 5\n";
         cout << "Find route by ticket price - 6\n";
         cout << "Insert a new route - 7\n";
+        cout << "Show statement cache statistics - 9\n";
+        cout << "Plan a journey with connections - 10\n";
+        cout << "Book seats - 11\n";
+        cout << "Cancel a booking - 12\n";
+        cout << "Dump query metrics - 13\n";
+        cout << "Complete city name - 14\n";
+        cout << "Show fares and seats between cities - 15\n";
+        cout << "Show fare calendar between cities - 16\n";
         cout << "Exit - 8\n";
         getline(cin, operatoinRaw);
         operation = atoi(operatoinRaw.c_str());
+        // Writes, journeys and aggregates need the database
+        if (!snapshotPath.empty() &&
+            (operation == 7 || (operation >= 10 && operation <= 12) || operation == 15 || operation == 16)) {
+            exitWithError(nullptr, "operation needs the database, not a snapshot");
+        }
         switch (operation){
             case 1:
-                showAllRoutes(db, SelectAllRoutesQuery);
+                showAllRoutes(repo);
                 break;
             case 2:
-                showAllAvaliableRoutes(db, SelectAllAvaliableRoutesQuery);
+                showAllAvaliableRoutes(repo);
                 break; 
             case 3:
                 cout << "Enter destination: ";
                 getline(cin, destination);
-                findRoutesByDestination(db, SelectRoutesByDestinationQuery, destination);
+                findRoutesByDestination(repo, destination);
                 break;   
             case 4:
                 readSelectRouteParameters(source, destination, departureDate, transportType, ticketPrice);
-                findRoutes(db, SelectRoutesQuery, source, destination, departureDate, transportType, ticketPrice);
+                findRoutes(repo, source, destination, departureDate, transportType, ticketPrice);
                 break;
             case 5:
                 cout << "Enter preferred transport type: ";
                 getline(cin, transportType);
-                findRoutesByTransport(db, SelectRoutesByTransportTypeQuery, transportType);
+                findRoutesByTransport(repo, transportType);
                 break;
             case 6:
                 cout << "Enter ticket price: ";
@@ -452,7 +1557,7 @@ int main() {
                     cerr << "invalid price\n";
                     exit(1);
                 }
-                findRoutesByPrice(db, SelectRoutesByTicketPriceQuery, ticketPrice);
+                findRoutesByPrice(repo, ticketPrice);
                 break;
             case 7:
                 readInsertRouteParameters(
@@ -466,8 +1571,7 @@ int main() {
                     distance,
                     seatsAvaliable);
                 insertRoute(
-                    db, 
-                    InsertRouteQuery,
+                    repo, 
                     flight,
                     source, 
                     destination, 
@@ -479,9 +1583,97 @@ int main() {
                     seatsAvaliable);
                 break;
             case 8:
+                if (!metricsPath.empty()) {
+                    dumpQueryMetrics();
+                }
                 return 0;
+            case 9:
+                showStatementStats(repo);
+                break;
+            case 10: {
+                string objective, minTransfer, maxLegs;
+                cout << "Enter source location: ";
+                getline(cin, source);
+                cout << "Enter destination location: ";
+                getline(cin, destination);
+                cout << "Enter earliest departure date (DD.MM.YYYY): ";
+                getline(cin, departureDate);
+                if (!isValidDate(departureDate)) {
+                    cerr << "invalid date format\n";
+                    exit(1);
+                }
+                cout << "Optimize for earliest, cheapest or pareto (or leave empty for earliest): ";
+                getline(cin, objective);
+                cout << "Enter minimum transfer time in minutes (or leave empty for 0): ";
+                getline(cin, minTransfer);
+                cout << "Enter maximum number of legs (or leave empty for 3): ";
+                getline(cin, maxLegs);
+                if ((!minTransfer.empty() && !isNonNegativeNumber(minTransfer)) ||
+                    (!maxLegs.empty() && !isNonNegativeNumber(maxLegs))) {
+                    cerr << "invalid number\n";
+                    exit(1);
+                }
+                planJourney(repo, source, destination, departureDate, objective, minTransfer, maxLegs);
+                break;
+            }
+            case 11: {
+                string routes, seats;
+                cout << "Enter route ids of the journey separated by spaces: ";
+                getline(cin, routes);
+                cout << "Enter number of seats (or leave empty for 1): ";
+                getline(cin, seats);
+                bookRoutes(repo, routes, seats);
+                break;
+            }
+            case 12: {
+                string booking;
+                cout << "Enter booking id: ";
+                getline(cin, booking);
+                cancelRouteBooking(repo, booking);
+                break;
+            }
+            case 13:
+                dumpQueryMetrics();
+                break;
+            case 14:
+                cout << "Enter beginning of city name: ";
+                getline(cin, source);
+                completeCity(repo, source);
+                break;
+            case 15:
+                cout << "Enter source location: ";
+                getline(cin, source);
+                cout << "Enter destination location: ";
+                getline(cin, destination);
+                cout << "Enter departure date (DD.MM.YYYY): ";
+                getline(cin, departureDate);
+                if (!isValidDate(departureDate)) {
+                    cerr << "invalid date format\n";
+                    exit(1);
+                }
+                cout << "Enter transport type (or leave empty for any): ";
+                getline(cin, transportType);
+                showRouteAggregate(repo, source, destination, departureDate, transportType);
+                break;
+            case 16:
+                cout << "Enter source location: ";
+                getline(cin, source);
+                cout << "Enter destination location: ";
+                getline(cin, destination);
+                cout << "Enter first date (DD.MM.YYYY): ";
+                getline(cin, departureDate);
+                cout << "Enter last date (DD.MM.YYYY) (or leave empty for 30 days): ";
+                getline(cin, arrivalDate);
+                if (!isValidDate(departureDate) || (!arrivalDate.empty() && !isValidDate(arrivalDate))) {
+                    cerr << "invalid date format\n";
+                    exit(1);
+                }
+                cout << "Enter transport type (or leave empty for any): ";
+                getline(cin, transportType);
+                showFareCalendar(repo, source, destination, departureDate, arrivalDate, transportType);
+                break;
             default:
-                exitWithError(db, "invalid operation");
+                exitWithError(repo.handle(), "invalid operation");
                 break;
         }
     }
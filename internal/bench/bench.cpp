@@ -0,0 +1,347 @@
+#pragma once
+#include <sqlite3.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "generator.cpp"
+#include "replay.cpp"
+using namespace std;
+
+// BenchOptions configures the benchmark suite
+struct BenchOptions {
+    vector<long> sizes = {1000, 10000, 100000};
+    int iterations = 50;       // at most per case
+    double budget = 2.0;       // seconds per case, at least 3 iterations run anyway
+    string workdir = "bench";  // generated databases are kept here between runs
+    string migrations = "internal/migrations";
+    string label;              // e.g. commit of the build, written into every result
+};
+
+// BenchCase is a single microbenchmark: `run` executes the query once and returns
+// number of rows or -1 on error
+struct BenchCase {
+    string name;
+    string query; // name of the query in queries.cpp
+    function<long()> run;
+};
+
+// stepAll reads every row of the statement, returns number of rows or -1
+inline long stepAll(sqlite3_stmt* stmt) {
+    if (!stmt) {
+        return -1;
+    }
+    const int columns = sqlite3_column_count(stmt);
+    long rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (int i = 0; i < columns; ++i) {
+            sqlite3_column_text(stmt, i);
+        }
+        ++rows;
+    }
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? rows : -1;
+}
+
+// bindStatement returns statement of the query with text parameters bound
+inline sqlite3_stmt* bindStatement(RouteRepository& repo, const string& query, const vector<string>& values) {
+    sqlite3_stmt* stmt = repo.statement(query);
+    for (size_t i = 0; stmt && i < values.size(); ++i) {
+        if (sqlite3_bind_text(stmt, i + 1, values[i].c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK) {
+            return nullptr;
+        }
+    }
+    return stmt;
+}
+
+// middleCursor walks half of a paged result and returns cursor of its last row,
+// so a deep page can be measured
+inline string middleCursor(RouteRepository& repo, const function<sqlite3_stmt*(const RoutePage&)>& query, long total) {
+    RoutePage page;
+    page.limit = max(1L, total / 2);
+    sqlite3_stmt* stmt = query(page);
+    string cursor;
+    while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+        cursor = repo.cursor(stmt);
+    }
+    if (stmt) {
+        sqlite3_reset(stmt);
+    }
+    return cursor;
+}
+
+// benchCases lists a case for every query of queries.cpp, parameters are taken
+// from the generated dataset. Writing cases go last, they change the data
+inline vector<BenchCase> benchCases(RouteRepository& repo, const TimetableOptions& dataset, long size) {
+    TimetableGenerator generator(dataset);
+    const vector<string> cities = generator.cityNames();
+    const string big = cities[0];
+    const string other = cities[1];
+    int64_t first;
+    parseSQLiteTime(dataset.start, first);
+    const string date = formatSQLiteTime(first + dataset.days / 2 * 86400).substr(0, 10);
+    const string middleId = to_string(size / 2);
+
+    RouteSearch full;
+    full.source = big;
+    full.destination = other;
+    full.date = date;
+    RouteSearch bySource;
+    bySource.source = big;
+    bySource.date = date;
+    RouteSearch byPrice;
+    byPrice.date = date;
+    byPrice.ticketPrice = "1000";
+    RouteSearch everything = full;
+    everything.transportType = "Самолет";
+    everything.ticketPrice = "20000";
+
+    // A fare calendar of the whole dataset, and the same days searched one by one
+    auto cityId = [&repo](const string& name) {
+        sqlite3_stmt* stmt = bindStatement(repo, SelectDestinationIdQuery, {name});
+        int64_t id = stmt && sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        if (stmt) {
+            sqlite3_reset(stmt);
+        }
+        return id;
+    };
+    const int64_t bigId = cityId(big), otherId = cityId(other);
+    const int64_t firstDay = first / 86400, lastDay = firstDay + dataset.days - 1;
+    vector<RouteSearch> daily;
+    for (int64_t day = firstDay; day <= lastDay; ++day) {
+        RouteSearch search = full;
+        search.date = formatSQLiteTime(day * 86400).substr(0, 10);
+        daily.push_back(search);
+    }
+
+    auto searchPage = [&repo, bySource](const RoutePage& page) { return repo.searchRoutes(bySource, page); };
+    auto allPage = [&repo](const RoutePage& page) { return repo.allRoutes(page); };
+    RoutePage firstPage;
+    firstPage.limit = 50;
+    RoutePage deepRoutes = firstPage;
+    deepRoutes.cursor = middleCursor(repo, allPage, size);
+    RoutePage deepSearch = firstPage;
+    deepSearch.cursor = middleCursor(repo, searchPage, stepAll(repo.searchRoutes(bySource)));
+
+    vector<BenchCase> cases = {
+        {"all_routes", "SelectAllRoutesQuery", [&repo] { return stepAll(repo.allRoutes()); }},
+        {"available_routes", "SelectAllAvaliableRoutesQuery",
+         [&repo] { return stepAll(repo.allAvaliableRoutes()); }},
+        {"search_source_destination_date", "buildSelectRoutesQuery",
+         [&repo, full] { return stepAll(repo.searchRoutes(full)); }},
+        {"search_source_date", "buildSelectRoutesQuery",
+         [&repo, bySource] { return stepAll(repo.searchRoutes(bySource)); }},
+        {"search_date_price", "buildSelectRoutesQuery",
+         [&repo, byPrice] { return stepAll(repo.searchRoutes(byPrice)); }},
+        {"search_all_filters", "buildSelectRoutesQuery",
+         [&repo, everything] { return stepAll(repo.searchRoutes(everything)); }},
+        {"routes_by_transport", "SelectRoutesByTransportTypeQuery",
+         [&repo] { return stepAll(repo.routesByTransport("Самолет")); }},
+        {"routes_by_destination", "SelectRoutesByDestinationQuery",
+         [&repo, big] { return stepAll(repo.routesByDestination(big)); }},
+        {"routes_by_price", "SelectRoutesByTicketPriceQuery",
+         [&repo] { return stepAll(repo.routesByPrice("1000")); }},
+        {"page_routes_first", "SelectAllRoutesFirstPageQuery",
+         [&repo, firstPage] { return stepAll(repo.allRoutes(firstPage)); }},
+        {"page_routes_deep", "SelectAllRoutesNextPageQuery",
+         [&repo, deepRoutes] { return stepAll(repo.allRoutes(deepRoutes)); }},
+        {"page_search_deep", "buildSelectRoutesPageQuery",
+         [&repo, bySource, deepSearch] { return stepAll(repo.searchRoutes(bySource, deepSearch)); }},
+        {"page_destination_first", "SelectRoutesByDestinationFirstPageQuery",
+         [&repo, big, firstPage] { return stepAll(repo.routesByDestination(big, firstPage)); }},
+        {"route_by_id", "SelectRouteByIdQuery",
+         [&repo, middleId] { return stepAll(bindStatement(repo, SelectRouteByIdQuery, {middleId})); }},
+        {"destination_id", "SelectDestinationIdQuery",
+         [&repo, other] { return stepAll(bindStatement(repo, SelectDestinationIdQuery, {other})); }},
+        {"destinations", "SelectDestinationsQuery",
+         [&repo] { return stepAll(repo.statement(SelectDestinationsQuery)); }},
+        {"transport_types", "SelectTransportTypesQuery",
+         [&repo] { return stepAll(repo.statement(SelectTransportTypesQuery)); }},
+        {"route_columns", "SelectRouteColumnsQuery",
+         [&repo] { return stepAll(repo.statement(SelectRouteColumnsQuery)); }},
+        {"route_columns_by_id", "SelectRouteColumnsByIdQuery",
+         [&repo, middleId] { return stepAll(bindStatement(repo, SelectRouteColumnsByIdQuery, {middleId})); }},
+        {"connections", "SelectConnectionsQuery",
+         [&repo] { return stepAll(repo.statement(SelectConnectionsQuery)); }},
+        {"connection_by_id", "SelectConnectionByIdQuery",
+         [&repo, middleId] { return stepAll(bindStatement(repo, SelectConnectionByIdQuery, {middleId})); }},
+        {"route_widths", "SelectRouteWidthsQuery",
+         [&repo] { return stepAll(repo.statement(SelectRouteWidthsQuery)); }},
+        {"fare_calendar", "SelectFareCalendarQuery", [&repo, bigId, otherId, firstDay, lastDay] {
+             vector<FareDay> days;
+             return repo.fareCalendar(bigId, otherId, firstDay, lastDay, "", days) ? long(days.size()) : -1L;
+         }},
+        {"fare_calendar_per_day", "buildSelectRoutesQuery", [&repo, daily] {
+             long rows = 0;
+             for (const RouteSearch& search : daily) {
+                 long found = stepAll(repo.searchRoutes(search));
+                 if (found < 0) {
+                     return -1L;
+                 }
+                 rows += found;
+             }
+             return rows;
+         }},
+    };
+    // insertRoute as the menu calls it, every route is committed on its own
+    NewRoute route;
+    route.flight = "BENCH";
+    route.source = big;
+    route.destination = other;
+    route.transportType = "Поезд";
+    parseSQLiteTime("2024-12-01 10:00:00", route.departure);
+    route.arrival = route.departure + 7200;
+    route.priceCents = 100000;
+    route.distance = 700;
+    route.seats = 100;
+    cases.push_back({"insert_route", "InsertRouteQuery", [&repo, route] {
+        return repo.insertRoute(route) ? 1L : -1L;
+    }});
+    return cases;
+}
+
+// searchLabel names the filters of a search, e.g. "source_id date price"
+inline string searchLabel(const RouteSearch& search) {
+    string label;
+    auto add = [&label](const char* filter) {
+        label += label.empty() ? filter : string(" ") + filter;
+    };
+    if (!search.source.empty()) {
+        add(search.sourceId > 0 ? "source_id" : "source");
+    }
+    if (!search.destination.empty()) {
+        add(search.destinationId > 0 ? "destination_id" : "destination");
+    }
+    if (!search.date.empty()) {
+        add("date");
+    }
+    if (!search.transportType.empty()) {
+        add("transport");
+    }
+    if (!search.ticketPrice.empty()) {
+        add("price");
+    }
+    return label.empty() ? "no filters" : label;
+}
+
+// checkSearchPlans explains every combination of search filters and writes the
+// plans into `out`. A search scanning routes fails the check, except the one
+// without filters, which reads every route anyway
+inline bool checkSearchPlans(RouteRepository& repo, ostream& out) {
+    int failed = 0;
+    vector<QueryBind> binds;
+    for (const RouteSearch& search : searchCombinations()) {
+        const string query = buildSelectRoutesQuery(search, binds);
+        sqlite3_stmt* plan = nullptr;
+        if (sqlite3_prepare_v2(repo.handle(), ("EXPLAIN QUERY PLAN " + query).c_str(), -1, &plan, nullptr) !=
+            SQLITE_OK) {
+            cerr << "check-plans: " << searchLabel(search) << ": " << sqlite3_errmsg(repo.handle()) << "\n";
+            return false;
+        }
+        string lines;
+        bool scans = false;
+        // Rows are id, parent, notused, detail; children follow their parent
+        map<int, int> depth;
+        while (sqlite3_step(plan) == SQLITE_ROW) {
+            int level = depth.count(sqlite3_column_int(plan, 1)) ? depth[sqlite3_column_int(plan, 1)] + 1 : 0;
+            depth[sqlite3_column_int(plan, 0)] = level;
+            const string detail = reinterpret_cast<const char*>(sqlite3_column_text(plan, 3));
+            scans = scans || detail == "SCAN r" || detail.compare(0, 7, "SCAN r ") == 0 ||
+                detail.compare(0, 11, "SCAN routes") == 0;
+            lines += string(2 * level + 2, ' ') + detail + "\n";
+        }
+        sqlite3_finalize(plan);
+        const bool fails = scans && binds.size() > 0;
+        failed += fails;
+        out << (fails ? "FAIL " : "ok   ") << searchLabel(search) << "\n" << lines;
+    }
+    out << failed << " of " << searchCombinations().size() << " searches scan routes\n";
+    return failed == 0;
+}
+
+// runBenchmarks generates a dataset of every size, runs all cases against it and
+// writes one JSON object per case into `results`
+inline bool runBenchmarks(const BenchOptions& options, ostream& results) {
+    for (long size : options.sizes) {
+        TimetableOptions dataset;
+        dataset.days = 30;
+        dataset.routesPerDay = max(1L, size / dataset.days);
+        dataset.cities = int(min(1000.0, max(10.0, sqrt(double(size)) / 3)));
+        // Datasets are deterministic, an existing one of the same schema version is reused
+        const string path =
+            options.workdir + "/routes-" + to_string(size) + "-v" + to_string(RouteSchemaVersion) + ".db";
+        const string pristine = path + ".orig";
+        RouteRepository repo;
+        ifstream existing(pristine);
+        if (!existing) {
+            remove(path.c_str());
+            ImportStats stats;
+            if (!repo.open(path.c_str()) || !generateTimetable(repo, dataset, options.migrations, stats)) {
+                cerr << "bench: cannot generate " << path << ": " << sqlite3_errmsg(repo.handle()) << "\n";
+                return false;
+            }
+            repo.close();
+            cout << "Generated " << stats.imported << " routes in " << fixed << setprecision(1)
+                 << stats.seconds << " s\n";
+            cout.unsetf(ios::floatfield);
+            ifstream source(path, ios::binary);
+            ofstream copy(pristine, ios::binary);
+            copy << source.rdbuf();
+        } else {
+            ifstream source(pristine, ios::binary);
+            ofstream copy(path, ios::binary | ios::trunc);
+            copy << source.rdbuf();
+        }
+        if (!repo.open(path.c_str())) {
+            cerr << "bench: cannot open " << path << "\n";
+            return false;
+        }
+        const long routes = dataset.days * dataset.routesPerDay;
+        cout << "Dataset " << size << ": " << routes << " routes, " << dataset.cities << " cities\n";
+        for (const BenchCase& benchCase : benchCases(repo, dataset, routes)) {
+            LatencyHistogram latency;
+            long rows = 0;
+            auto started = chrono::steady_clock::now();
+            for (int i = 0; i < options.iterations; ++i) {
+                auto start = chrono::steady_clock::now();
+                rows = benchCase.run();
+                auto end = chrono::steady_clock::now();
+                if (rows < 0) {
+                    cerr << "bench: " << benchCase.name << ": " << sqlite3_errmsg(repo.handle()) << "\n";
+                    break;
+                }
+                latency.record(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+                if (i >= 2 && chrono::duration<double>(end - started).count() > options.budget) {
+                    break;
+                }
+            }
+            string line = "{\"label\":";
+            appendJSONString(line, options.label);
+            line += ",\"size\":" + to_string(size) + ",\"routes\":" + to_string(routes) + ",\"case\":";
+            appendJSONString(line, benchCase.name);
+            line += ",\"query\":";
+            appendJSONString(line, benchCase.query);
+            char numbers[256];
+            snprintf(numbers, sizeof(numbers),
+                     ",\"iterations\":%llu,\"rows\":%ld,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+                     "\"p99_us\":%.1f,\"max_us\":%.1f}",
+                     (unsigned long long)latency.count(), rows, latency.mean() / 1e3,
+                     latency.percentile(50) / 1e3, latency.percentile(90) / 1e3,
+                     latency.percentile(99) / 1e3, latency.max() / 1e3);
+            line += numbers;
+            results << line << "\n";
+            cout << "  " << left << setw(32) << benchCase.name << right << setw(10) << rows << " rows  p50 "
+                 << fixed << setprecision(1) << setw(10) << latency.percentile(50) / 1e3 << " us  p99 "
+                 << setw(10) << latency.percentile(99) / 1e3 << " us\n";
+            cout.unsetf(ios::floatfield);
+        }
+        results.flush();
+    }
+    return true;
+}
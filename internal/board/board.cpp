@@ -0,0 +1,298 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "repository.cpp"
+#include "render.cpp"
+using namespace std;
+
+// BoardEvent is a message of the departure board for one subscriber, framed as
+// a server-sent event
+struct BoardEvent {
+    uint64_t subscriber;
+    string data;
+};
+
+// DepartureBoard keeps upcoming routes of every origin in memory ordered by
+// departure, so next departures after a time are a binary search and a walk of
+// at most N routes, and the database is not read per request. Subscribers of
+// an origin keep its first N routes: they get them once and then only events
+// of routes among their first N, "insert" of a new route, "seats" of a route
+// whose seats changed and "departed" of a route that left, followed by "insert"
+// of the routes taking its place. A subscriber drops routes past its first N
+// itself. The board is changed by one thread and read by any
+class DepartureBoard {
+public:
+    DepartureBoard() : clock(0), lastId(0), loaded(false) {}
+
+    bool isLoaded() const {
+        shared_lock<shared_mutex> lock(guard);
+        return loaded;
+    }
+
+    // load reads routes departing at or after `now`, routes inserted later are
+    // read by refresh
+    bool load(RouteRepository& repo, int64_t now) {
+        unique_lock<shared_mutex> lock(guard);
+        origins.clear();
+        clock = now;
+        sqlite3_stmt* stmt = repo.statement(SelectLastRouteIdQuery);
+        if (!stmt || sqlite3_step(stmt) != SQLITE_ROW) {
+            return false;
+        }
+        lastId = sqlite3_column_int64(stmt, 0);
+        sqlite3_reset(stmt);
+        stmt = repo.statement(SelectUpcomingRouteColumnsQuery);
+        if (!stmt || !bindParams(stmt, now)) {
+            return false;
+        }
+        KeyedRoute route;
+        int rc;
+        // Rows come ordered by departure, every origin is appended in order
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            KeyedRouteColumns::read(stmt, route);
+            origins[route.sourceId].push_back(entry(route));
+        }
+        sqlite3_reset(stmt);
+        loaded = rc == SQLITE_DONE;
+        return loaded;
+    }
+
+    // next renders up to `limit` routes of `sourceId` departing at or after
+    // `after` as a JSON array in order of departure, returns number of routes
+    size_t next(int64_t sourceId, int64_t after, size_t limit, string& body) const {
+        shared_lock<shared_mutex> lock(guard);
+        body = "[";
+        size_t rows = 0;
+        auto it = origins.find(sourceId);
+        if (it != origins.end()) {
+            const vector<Entry>& routes = it->second;
+            auto first = lower_bound(routes.begin(), routes.end(), after,
+                                     [](const Entry& entry, int64_t value) { return entry.departure < value; });
+            for (; first != routes.end() && rows < limit; ++first, ++rows) {
+                if (rows > 0) {
+                    body += ',';
+                }
+                appendJSON(body, sourceId, *first);
+            }
+        }
+        body += "]";
+        return rows;
+    }
+
+    // subscribe adds subscriber of `sourceId` keeping its first `limit` routes and
+    // returns the "board" event with them
+    string subscribe(uint64_t subscriber, int64_t sourceId, size_t limit) {
+        unique_lock<shared_mutex> lock(guard);
+        subscribers[subscriber] = Subscriber{sourceId, limit};
+        bySource[sourceId].push_back(subscriber);
+        string data = "[";
+        auto it = origins.find(sourceId);
+        if (it != origins.end()) {
+            for (size_t i = 0; i < it->second.size() && i < limit; ++i) {
+                if (i > 0) {
+                    data += ',';
+                }
+                appendJSON(data, sourceId, it->second[i]);
+            }
+        }
+        data += "]";
+        return event("board", data);
+    }
+
+    void unsubscribe(uint64_t subscriber) {
+        unique_lock<shared_mutex> lock(guard);
+        auto it = subscribers.find(subscriber);
+        if (it == subscribers.end()) {
+            return;
+        }
+        vector<uint64_t>& list = bySource[it->second.source];
+        list.erase(find(list.begin(), list.end(), subscriber));
+        subscribers.erase(it);
+    }
+
+    size_t subscriberCount() const {
+        shared_lock<shared_mutex> lock(guard);
+        return subscribers.size();
+    }
+
+    // refresh adds routes inserted since the last load or refresh that have not
+    // departed yet. Without new routes it is one seek of the primary key
+    bool refresh(RouteRepository& repo, vector<BoardEvent>& events) {
+        unique_lock<shared_mutex> lock(guard);
+        sqlite3_stmt* stmt = repo.statement(SelectRouteColumnsAfterIdQuery);
+        if (!stmt || !bindParams(stmt, lastId)) {
+            return false;
+        }
+        KeyedRoute route;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            KeyedRouteColumns::read(stmt, route);
+            lastId = route.id;
+            if (route.departure < clock) {
+                continue;
+            }
+            vector<Entry>& routes = origins[route.sourceId];
+            Entry added = entry(route);
+            auto at = routes.insert(upper_bound(routes.begin(), routes.end(), added, lessEntry), move(added));
+            notify(route.sourceId, size_t(at - routes.begin()), "insert", events);
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // update reads routes `ids` again after their seats changed
+    bool update(RouteRepository& repo, const vector<sqlite3_int64>& ids, vector<BoardEvent>& events) {
+        unique_lock<shared_mutex> lock(guard);
+        KeyedRoute route;
+        for (sqlite3_int64 id : ids) {
+            sqlite3_stmt* stmt = repo.statement(SelectRouteColumnsByIdQuery);
+            if (!stmt || !bindParams(stmt, id)) {
+                return false;
+            }
+            int rc = sqlite3_step(stmt);
+            if (rc == SQLITE_ROW) {
+                KeyedRouteColumns::read(stmt, route);
+                auto origin = origins.find(route.sourceId);
+                if (origin != origins.end()) {
+                    vector<Entry>& routes = origin->second;
+                    Entry key = entry(route);
+                    auto at = lower_bound(routes.begin(), routes.end(), key, lessEntry);
+                    if (at != routes.end() && at->id == route.id) {
+                        at->seats = route.seats;
+                        notify(route.sourceId, size_t(at - routes.begin()), "seats", events);
+                    }
+                }
+            }
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // expire removes routes departed before `now`
+    void expire(int64_t now, vector<BoardEvent>& events) {
+        unique_lock<shared_mutex> lock(guard);
+        clock = now;
+        for (auto& origin : origins) {
+            vector<Entry>& routes = origin.second;
+            size_t departed = 0;
+            while (departed < routes.size() && routes[departed].departure < now) {
+                ++departed;
+            }
+            if (departed == 0) {
+                continue;
+            }
+            auto subscribed = bySource.find(origin.first);
+            if (subscribed != bySource.end()) {
+                for (uint64_t subscriber : subscribed->second) {
+                    const size_t limit = subscribers[subscriber].limit;
+                    const size_t left = min(departed, limit);
+                    string data;
+                    for (size_t i = 0; i < left; ++i) {
+                        data += event("departed", "{\"id\":" + to_string(routes[i].id) + "}");
+                    }
+                    // Routes behind the departed ones move into the first `limit`
+                    for (size_t i = max(limit, departed); i < departed + limit && i < routes.size(); ++i) {
+                        string route;
+                        appendJSON(route, origin.first, routes[i]);
+                        data += event("insert", route);
+                    }
+                    if (!data.empty()) {
+                        events.push_back(BoardEvent{subscriber, move(data)});
+                    }
+                }
+            }
+            routes.erase(routes.begin(), routes.begin() + departed);
+        }
+    }
+
+    // event frames a server-sent event
+    static string event(const char* name, const string& data) {
+        return string("event: ") + name + "\ndata: " + data + "\n\n";
+    }
+
+private:
+    // Entry is a route of an origin, names are kept once per id
+    struct Entry {
+        int64_t departure;
+        int64_t id;
+        int64_t destinationId;
+        int64_t transportId;
+        int64_t distance;
+        int64_t arrival;
+        int64_t priceCents;
+        int64_t seats;
+        string flight;
+    };
+
+    struct Subscriber {
+        int64_t source;
+        size_t limit;
+    };
+
+    static bool lessEntry(const Entry& a, const Entry& b) {
+        return a.departure != b.departure ? a.departure < b.departure : a.id < b.id;
+    }
+
+    Entry entry(const KeyedRoute& route) {
+        names[route.sourceId] = string(route.source);
+        names[route.destinationId] = string(route.destination);
+        transports[route.transportId] = string(route.transport);
+        return Entry{route.departure, route.id, route.destinationId, route.transportId, route.distance,
+                     route.arrival, route.priceCents, route.seats, string(route.flight)};
+    }
+
+    void appendJSON(string& out, int64_t sourceId, const Entry& entry) const {
+        Route route;
+        route.id = entry.id;
+        route.flight = entry.flight;
+        route.source = names.at(sourceId);
+        route.destination = names.at(entry.destinationId);
+        route.distance = entry.distance;
+        route.departure = entry.departure;
+        route.arrival = entry.arrival;
+        route.priceCents = entry.priceCents;
+        route.seats = entry.seats;
+        route.transport = transports.at(entry.transportId);
+        appendRouteJSON(out, route, true);
+    }
+
+    // notify sends `name` event of the route at `rank` of origin `sourceId` to its
+    // subscribers keeping that many routes
+    void notify(int64_t sourceId, size_t rank, const char* name, vector<BoardEvent>& events) {
+        auto subscribed = bySource.find(sourceId);
+        if (subscribed == bySource.end()) {
+            return;
+        }
+        string data;
+        for (uint64_t subscriber : subscribed->second) {
+            if (rank >= subscribers[subscriber].limit) {
+                continue;
+            }
+            if (data.empty()) {
+                string route;
+                appendJSON(route, sourceId, origins[sourceId][rank]);
+                data = event(name, route);
+            }
+            events.push_back(BoardEvent{subscriber, data});
+        }
+    }
+
+    mutable shared_mutex guard;
+    unordered_map<int64_t, vector<Entry>> origins; // sorted by departure, then id
+    unordered_map<int64_t, string> names;          // cities by id
+    unordered_map<int64_t, string> transports;     // transport types by id
+    unordered_map<uint64_t, Subscriber> subscribers;
+    unordered_map<int64_t, vector<uint64_t>> bySource;
+    int64_t clock;  // routes departing before it are removed
+    int64_t lastId; // the last route read
+    bool loaded;
+};
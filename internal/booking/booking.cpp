@@ -0,0 +1,202 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "repository.cpp"
+using namespace std;
+
+// Limits of a single booking
+const size_t MaxBookingLegs = 8;
+const int MaxBookingSeats = 100;
+
+// BookingStatus is the outcome of a booking operation
+enum class BookingStatus {
+    Done,
+    SoldOut,          // a route has fewer seats left than requested
+    NotFound,         // no such route or booking
+    AlreadyCancelled,
+    Invalid,          // malformed request
+    Failed,           // database error
+};
+
+// BookingResult describes what a booking operation did
+struct BookingResult {
+    BookingStatus status = BookingStatus::Failed;
+    sqlite3_int64 bookingId = 0;
+    sqlite3_int64 routeId = 0;        // route that failed the booking
+    vector<sqlite3_int64> routeIds;   // legs of the booking, their seats have changed
+    string error;
+};
+
+// abortBooking rolls back the booking savepoint, the error of a failed statement
+// is kept before rollback overwrites it
+inline BookingResult& abortBooking(RouteRepository& repo, BookingResult& result, BookingStatus status) {
+    result.status = status;
+    if (status == BookingStatus::Failed) {
+        result.error = sqlite3_errmsg(repo.handle());
+    }
+    repo.execute("ROLLBACK TO booking;");
+    repo.execute("RELEASE booking;");
+    return result;
+}
+
+// bindInts binds integer parameters in order
+inline bool bindInts(sqlite3_stmt* stmt, const vector<sqlite3_int64>& values) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (sqlite3_bind_int64(stmt, i + 1, values[i]) != SQLITE_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// executeWith runs a statement without result rows with integer parameters
+inline bool executeWith(RouteRepository& repo, const string& query, const vector<sqlite3_int64>& values) {
+    sqlite3_stmt* stmt = repo.statement(query);
+    return stmt && bindInts(stmt, values) && sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// bookSeats reserves `seats` seats on every route of a multi-leg journey, either
+// all legs are booked or none. It runs in a savepoint, so it is a transaction on
+// its own and a nested one inside a group commit of the server
+inline BookingResult bookSeats(RouteRepository& repo, const vector<sqlite3_int64>& routeIds, int seats) {
+    BookingResult result;
+    result.routeIds = routeIds;
+    if (routeIds.empty() || routeIds.size() > MaxBookingLegs || seats < 1 || seats > MaxBookingSeats) {
+        result.status = BookingStatus::Invalid;
+        result.error = "a booking takes 1 to " + to_string(MaxBookingLegs) + " routes and 1 to " +
+            to_string(MaxBookingSeats) + " seats";
+        return result;
+    }
+    for (size_t i = 0; i < routeIds.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (routeIds[i] == routeIds[j]) {
+                result.status = BookingStatus::Invalid;
+                result.error = "route " + to_string(routeIds[i]) + " is booked twice";
+                return result;
+            }
+        }
+    }
+    if (!repo.execute("SAVEPOINT booking;")) {
+        result.error = sqlite3_errmsg(repo.handle());
+        return result;
+    }
+    if (!executeWith(repo, InsertBookingQuery, {seats})) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    result.bookingId = sqlite3_last_insert_rowid(repo.handle());
+    for (size_t leg = 0; leg < routeIds.size(); ++leg) {
+        const sqlite3_int64 id = routeIds[leg];
+        if (!executeWith(repo, ReserveSeatsQuery, {seats, id, seats})) {
+            return abortBooking(repo, result, BookingStatus::Failed);
+        }
+        if (sqlite3_changes(repo.handle()) == 0) {
+            result.routeId = id;
+            sqlite3_stmt* stmt = repo.statement(SelectRouteExistsQuery);
+            if (!stmt || !bindInts(stmt, {id})) {
+                return abortBooking(repo, result, BookingStatus::Failed);
+            }
+            int rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+                return abortBooking(repo, result, BookingStatus::Failed);
+            }
+            result.error = rc == SQLITE_ROW
+                ? "route " + to_string(id) + " has not enough seats"
+                : "route " + to_string(id) + " not found";
+            return abortBooking(repo, result, rc == SQLITE_ROW ? BookingStatus::SoldOut : BookingStatus::NotFound);
+        }
+        if (!executeWith(repo, InsertBookingLegQuery, {result.bookingId, sqlite3_int64(leg), id})) {
+            return abortBooking(repo, result, BookingStatus::Failed);
+        }
+    }
+    if (!repo.execute("RELEASE booking;")) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    result.status = BookingStatus::Done;
+    return result;
+}
+
+// cancelBooking cancels an active booking and returns its seats to every leg
+inline BookingResult cancelBooking(RouteRepository& repo, sqlite3_int64 bookingId) {
+    BookingResult result;
+    result.bookingId = bookingId;
+    if (!repo.execute("SAVEPOINT booking;")) {
+        result.error = sqlite3_errmsg(repo.handle());
+        return result;
+    }
+    if (!executeWith(repo, CancelBookingQuery, {bookingId})) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    if (sqlite3_changes(repo.handle()) == 0) {
+        sqlite3_stmt* stmt = repo.statement(SelectBookingStatusQuery);
+        if (!stmt || !bindInts(stmt, {bookingId})) {
+            return abortBooking(repo, result, BookingStatus::Failed);
+        }
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            return abortBooking(repo, result, BookingStatus::Failed);
+        }
+        result.error = rc == SQLITE_ROW
+            ? "booking " + to_string(bookingId) + " is already cancelled"
+            : "booking " + to_string(bookingId) + " not found";
+        return abortBooking(repo, result, rc == SQLITE_ROW ? BookingStatus::AlreadyCancelled : BookingStatus::NotFound);
+    }
+    if (!executeWith(repo, ReleaseSeatsQuery, {bookingId, bookingId})) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    const size_t released = sqlite3_changes(repo.handle());
+    sqlite3_stmt* stmt = repo.statement(SelectBookingLegsQuery);
+    if (!stmt || !bindInts(stmt, {bookingId})) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        result.routeIds.push_back(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    // Seats go back to every route of the booking or to none
+    vector<sqlite3_int64> routes = result.routeIds;
+    sort(routes.begin(), routes.end());
+    if (released != size_t(unique(routes.begin(), routes.end()) - routes.begin())) {
+        result.error = "routes of booking " + to_string(bookingId) + " not found";
+        result.routeIds.clear();
+        return abortBooking(repo, result, BookingStatus::NotFound);
+    }
+    if (!repo.execute("RELEASE booking;")) {
+        return abortBooking(repo, result, BookingStatus::Failed);
+    }
+    result.status = BookingStatus::Done;
+    return result;
+}
+
+// parseRouteIds parses route ids separated by commas or spaces, optionally in
+// brackets as a JSON array
+inline bool parseRouteIds(const string& text, vector<sqlite3_int64>& ids) {
+    ids.clear();
+    string digits;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        char c = i < text.size() ? text[i] : ' ';
+        if (c >= '0' && c <= '9') {
+            digits += c;
+            continue;
+        }
+        if (c != ' ' && c != ',' && c != '\t' && !(c == '[' && i == 0) && !(c == ']' && i + 1 == text.size())) {
+            return false;
+        }
+        if (!digits.empty()) {
+            if (digits.size() > 18) {
+                return false;
+            }
+            ids.push_back(strtoll(digits.c_str(), nullptr, 10));
+            digits.clear();
+        }
+    }
+    return !ids.empty();
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// CachedResult is a rendered result of a read operation
+struct CachedResult {
+    string body;
+    string nextCursor;
+};
+
+// ResultCacheStats are counters of ResultCache
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;      // results dropped to fit into capacity
+    uint64_t invalidations = 0;  // times all results were dropped by a write
+    uint64_t generation = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity = 0;
+};
+
+// ResultCache is an LRU cache of rendered results bounded by bytes and shared by
+// worker threads. Every result belongs to the data generation it was read at,
+// a write bumps the generation, so a result read before the write is never
+// returned after it
+class ResultCache {
+public:
+    explicit ResultCache(size_t capacity)
+        : capacity(capacity), used(0), current(0), cached(0),
+          hits(0), misses(0), evictions(0), invalidations(0) {}
+
+    bool enabled() const {
+        return capacity > 0;
+    }
+
+    // generation must be taken before the result is read from the database
+    uint64_t generation() const {
+        return current.load();
+    }
+
+    // invalidate is called after data was changed
+    void invalidate() {
+        ++current;
+    }
+
+    // get finds result of the key and marks it as recently used, results are
+    // shared, so large ones are not copied under the lock
+    bool get(const string& key, shared_ptr<const CachedResult>& result) {
+        lock_guard<mutex> lock(guard);
+        dropStale();
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++misses;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        result = it->second->result;
+        ++hits;
+        return true;
+    }
+
+    // put stores result read at `generation`, results of an outdated generation are dropped
+    void put(const string& key, uint64_t generation, CachedResult result) {
+        const size_t bytes = entryBytes(key, result);
+        auto shared = make_shared<const CachedResult>(move(result));
+        lock_guard<mutex> lock(guard);
+        dropStale();
+        if (generation != cached || bytes > capacity) {
+            return;
+        }
+        auto it = index.find(key);
+        if (it != index.end()) {
+            used -= it->second->bytes;
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        entries.push_front(Entry{key, shared, bytes});
+        index[key] = entries.begin();
+        used += bytes;
+        while (used > capacity) {
+            used -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+            ++evictions;
+        }
+    }
+
+    ResultCacheStats stats() {
+        lock_guard<mutex> lock(guard);
+        ResultCacheStats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.evictions = evictions;
+        stats.invalidations = invalidations;
+        stats.generation = current.load();
+        stats.entries = entries.size();
+        stats.bytes = used;
+        stats.capacity = capacity;
+        return stats;
+    }
+
+private:
+    struct Entry {
+        string key;
+        shared_ptr<const CachedResult> result;
+        size_t bytes;
+    };
+
+    // entryBytes approximates memory of an entry: the key is kept twice, plus
+    // nodes of the list and the map
+    static size_t entryBytes(const string& key, const CachedResult& result) {
+        return 2 * key.size() + result.body.size() + result.nextCursor.size() + 128;
+    }
+
+    // dropStale drops every result once the generation has changed
+    void dropStale() {
+        const uint64_t generation = current.load();
+        if (generation == cached) {
+            return;
+        }
+        cached = generation;
+        if (!entries.empty()) {
+            entries.clear();
+            index.clear();
+            used = 0;
+            ++invalidations;
+        }
+    }
+
+    const size_t capacity;
+    size_t used;
+    atomic<uint64_t> current;
+    uint64_t cached; // generation of the stored results
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    mutex guard;
+    list<Entry> entries; // most recently used first
+    unordered_map<string, list<Entry>::iterator> index;
+};
@@ -0,0 +1,258 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "columnar.cpp"
+#include "repository.cpp"
+using namespace std;
+
+// decodeUTF8 returns code points of UTF-8 text, a malformed byte is taken as a code point
+inline u32string decodeUTF8(string_view text) {
+    u32string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = text[i];
+        size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (length == 0 || i + length > text.size()) {
+            out += char32_t(c);
+            ++i;
+            continue;
+        }
+        char32_t code = length == 1 ? c : c & (0x7F >> length);
+        for (size_t j = 1; j < length; ++j) {
+            code = (code << 6) | (text[i + j] & 0x3F);
+        }
+        out += code;
+        i += length;
+    }
+    return out;
+}
+
+inline bool isNameSeparator(char32_t c) {
+    return c == ' ' || c == '\t' || c == '-' || (c >= 0x2010 && c <= 0x2015);
+}
+
+// foldCityName folds a city name for matching: Latin and Cyrillic letters are
+// lowercased, ё is taken as е, hyphens and runs of spaces become one space and
+// leading and trailing ones are dropped, so "санкт петербург" is "Санкт-Петербург"
+inline u32string foldCityName(string_view name) {
+    u32string folded;
+    bool separator = false;
+    for (char32_t c : decodeUTF8(name)) {
+        if (isNameSeparator(c)) {
+            separator = !folded.empty();
+            continue;
+        }
+        if (separator) {
+            folded += ' ';
+            separator = false;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        } else if (c >= 0x410 && c <= 0x42F) {
+            c += 0x20;
+        } else if (c == 0x401 || c == 0x451) {
+            c = 0x435;
+        } else if (c >= 0x400 && c <= 0x40F) {
+            c += 0x50;
+        }
+        folded += c;
+    }
+    return folded;
+}
+
+// editDistance returns Levenshtein distance of `a` and `b` when it is at most
+// `limit` and limit + 1 otherwise, a row past the limit stops the computation
+inline size_t editDistance(const u32string& a, const u32string& b, size_t limit) {
+    if ((a.size() > b.size() ? a.size() - b.size() : b.size() - a.size()) > limit) {
+        return limit + 1;
+    }
+    vector<size_t> previous(b.size() + 1), current(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        previous[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        current[0] = i;
+        size_t best = current[0];
+        for (size_t j = 1; j <= b.size(); ++j) {
+            current[j] = min({previous[j] + 1, current[j - 1] + 1, previous[j - 1] + (a[i - 1] != b[j - 1])});
+            best = min(best, current[j]);
+        }
+        if (best > limit) {
+            return limit + 1;
+        }
+        swap(previous, current);
+    }
+    return min(previous[b.size()], limit + 1);
+}
+
+// City is a city found by CityIndex
+struct City {
+    int64_t id = 0;
+    string name;
+};
+
+// CityIndex keeps names of cities folded by foldCityName in a sorted array, so
+// a prefix is completed by a binary search and a name typed with another case,
+// a hyphen or a typo is resolved to the id of the city before routes are
+// searched. New cities are picked up by id, the index is never rebuilt.
+// Lookups share a lock, so server workers use one index
+class CityIndex {
+public:
+    CityIndex() : lastId(0), loaded(false) {}
+
+    bool isLoaded() const {
+        shared_lock<shared_mutex> lock(guard);
+        return loaded;
+    }
+
+    size_t size() const {
+        shared_lock<shared_mutex> lock(guard);
+        return entries.size();
+    }
+
+    // load reads all cities of the database
+    bool load(RouteRepository& repo) {
+        unique_lock<shared_mutex> lock(guard);
+        entries.clear();
+        lastId = 0;
+        loaded = readAfter(repo);
+        return loaded;
+    }
+
+    // load takes cities of an in-memory index, such an index has no new cities
+    void load(const RouteIndex& index) {
+        unique_lock<shared_mutex> lock(guard);
+        entries.clear();
+        index.forEachCity([this](int64_t id, string_view name) {
+            entries.push_back(Entry{foldCityName(name), id, string(name)});
+            lastId = max(lastId, id);
+        });
+        sort(entries.begin(), entries.end(), lessEntry);
+        loaded = true;
+    }
+
+    // refresh adds cities inserted since the last load or refresh, e.g. by
+    // insertIfNotExists of a new route. Without new cities it is one index seek
+    bool refresh(RouteRepository& repo) {
+        unique_lock<shared_mutex> lock(guard);
+        return !loaded || readAfter(repo);
+    }
+
+    // complete returns up to `limit` cities whose folded names start with the
+    // folded `prefix` in order of folded names
+    vector<City> complete(string_view prefix, size_t limit) const {
+        const u32string key = foldCityName(prefix);
+        shared_lock<shared_mutex> lock(guard);
+        vector<City> cities;
+        for (auto it = lowerBound(key); it != entries.end() && cities.size() < limit && startsWith(it->key, key); ++it) {
+            cities.push_back(City{it->id, it->name});
+        }
+        return cities;
+    }
+
+    // resolve finds the city `name` means: the one with this name or the same
+    // folded name, the only one starting with it when it has 3 letters or more,
+    // or the only nearest one within a typo per 4 letters. False if there is
+    // no such city or the name is ambiguous
+    bool resolve(string_view name, City& city) const {
+        const u32string key = foldCityName(name);
+        if (key.empty()) {
+            return false;
+        }
+        shared_lock<shared_mutex> lock(guard);
+        auto first = lowerBound(key);
+        auto same = first;
+        while (same != entries.end() && same->key == key) {
+            ++same;
+        }
+        if (same != first) {
+            auto exact = find_if(first, same, [name](const Entry& entry) { return entry.name == name; });
+            if (exact == same && same - first > 1) {
+                return false;
+            }
+            return found(exact != same ? *exact : *first, city);
+        }
+        if (key.size() >= 3) {
+            auto prefixed = first;
+            while (prefixed != entries.end() && startsWith(prefixed->key, key) && prefixed - first < 2) {
+                ++prefixed;
+            }
+            if (prefixed - first == 1) {
+                return found(*first, city);
+            }
+        }
+        const size_t limit = max(size_t(1), key.size() / 4);
+        size_t best = limit + 1;
+        const Entry* nearest = nullptr;
+        bool ambiguous = false;
+        for (const Entry& entry : entries) {
+            size_t distance = editDistance(key, entry.key, best == limit + 1 ? limit : best);
+            if (distance < best) {
+                best = distance;
+                nearest = &entry;
+                ambiguous = false;
+            } else if (distance == best && best <= limit) {
+                ambiguous = true;
+            }
+        }
+        return nearest && !ambiguous && found(*nearest, city);
+    }
+
+private:
+    struct Entry {
+        u32string key; // folded name
+        int64_t id;
+        string name;
+    };
+
+    static bool lessEntry(const Entry& a, const Entry& b) {
+        return a.key != b.key ? a.key < b.key : a.id < b.id;
+    }
+
+    static bool startsWith(const u32string& key, const u32string& prefix) {
+        return key.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    static bool found(const Entry& entry, City& city) {
+        city.id = entry.id;
+        city.name = entry.name;
+        return true;
+    }
+
+    vector<Entry>::const_iterator lowerBound(const u32string& key) const {
+        return lower_bound(entries.begin(), entries.end(), key,
+                           [](const Entry& entry, const u32string& value) { return entry.key < value; });
+    }
+
+    // readAfter adds cities with ids above the last one, they are sorted and
+    // merged into the array
+    bool readAfter(RouteRepository& repo) {
+        sqlite3_stmt* stmt = repo.statement(SelectDestinationsAfterQuery);
+        if (!stmt || !bindParams(stmt, lastId)) {
+            return false;
+        }
+        const size_t known = entries.size();
+        CityRow row;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            CityColumns::read(stmt, row);
+            entries.push_back(Entry{foldCityName(row.name), row.id, string(row.name)});
+            lastId = row.id;
+        }
+        sqlite3_reset(stmt);
+        sort(entries.begin() + known, entries.end(), lessEntry);
+        inplace_merge(entries.begin(), entries.begin() + known, entries.end(), lessEntry);
+        return rc == SQLITE_DONE;
+    }
+
+    mutable shared_mutex guard;
+    vector<Entry> entries; // sorted by folded name, then id
+    int64_t lastId;
+    bool loaded;
+};
@@ -0,0 +1,421 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "money.cpp"
+#include "repository.cpp"
+#include "timeutil.cpp"
+using namespace std;
+
+// StringColumn stores strings of a column back to back in a single buffer
+class StringColumn {
+public:
+    void append(string_view value) {
+        bytes.append(value.data(), value.size());
+        ends.push_back(bytes.size());
+    }
+
+    // at returns a view of value i, it is valid until the next append
+    string_view at(size_t i) const {
+        size_t begin = i == 0 ? 0 : ends[i - 1];
+        return string_view(bytes).substr(begin, ends[i] - begin);
+    }
+
+    void clear() {
+        bytes.clear();
+        ends.clear();
+    }
+
+private:
+    string bytes;
+    vector<uint32_t> ends;
+};
+
+// Filter loops are kept free of branches and aliasing, so they compile to SIMD.
+// Each keeps in `mask` only rows of the column passing the comparison
+inline void filterEqual(const int32_t* __restrict column, size_t n, int32_t value, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= column[i] == value;
+    }
+}
+
+inline void filterLessEqual(const int32_t* __restrict column, size_t n, int32_t value, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= column[i] <= value;
+    }
+}
+
+inline void filterGreater(const int32_t* __restrict column, size_t n, int32_t value, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= column[i] > value;
+    }
+}
+
+inline void filterGreaterEqual(const int64_t* __restrict column, size_t n, int64_t value, uint8_t* __restrict mask) {
+    for (size_t i = 0; i < n; ++i) {
+        mask[i] &= column[i] >= value;
+    }
+}
+
+// collectRows walks n rows in `order` and keeps the ones selected by mask
+inline vector<uint32_t> collectRows(const uint32_t* order, size_t n, const vector<uint8_t>& mask) {
+    vector<uint32_t> selected;
+    for (size_t i = 0; i < n; ++i) {
+        if (mask[order[i]]) {
+            selected.push_back(order[i]);
+        }
+    }
+    return selected;
+}
+
+// cityCode converts a city id into the code of city columns, an id out of range matches nothing
+inline int32_t cityCode(int64_t id) {
+    return id > INT32_MAX ? -1 : int32_t(id);
+}
+
+// priceLimit converts higher price into cents as priceBind does, a malformed
+// price matches nothing
+inline int32_t priceLimit(const string& ticketPrice) {
+    int64_t limit;
+    if (!parseCents(ticketPrice, limit)) {
+        return INT32_MIN;
+    }
+    return limit > INT32_MAX ? INT32_MAX : int32_t(limit);
+}
+
+// RouteIndex answers the route lists from memory: searches return positions of
+// rows in the order of the corresponding SQL query and route reads a row,
+// forEachCity visits ids and names of cities of the routes
+class RouteIndex {
+public:
+    virtual ~RouteIndex() {}
+    virtual vector<uint32_t> allRoutes(bool avaliableOnly) const = 0;
+    virtual vector<uint32_t> search(const RouteSearch& search) const = 0;
+    virtual vector<uint32_t> routesByTransport(const string& transportType) const = 0;
+    virtual vector<uint32_t> routesByDestination(const string& destination) const = 0;
+    virtual vector<uint32_t> routesByPrice(const string& ticketPrice) const = 0;
+    virtual Route route(uint32_t position) const = 0;
+    virtual void forEachCity(const function<void(int64_t, string_view)>& visit) const = 0;
+};
+
+// ColumnarRouteIndex keeps the routes table in memory as a structure of arrays.
+// Cities and transport types are encoded by their ids, times as epoch seconds
+// and price as cents as they are stored, so filters are branch-free loops over
+// contiguous columns which the compiler vectorizes. Rows are emitted in the
+// order of the corresponding SQL query through permutations sorted once at load
+// time and returned as the same Route rows SQLite results decode into, so both
+// engines produce identical tables.
+class ColumnarRouteIndex : public RouteIndex {
+public:
+    // load reads all routes, partitions included
+    bool load(RouteRepository& repo) {
+        clear();
+        sqlite3_stmt* stmt = repo.routesStatement(SelectRouteColumnsQuery);
+        if (!stmt) {
+            return false;
+        }
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            appendRow(stmt);
+        }
+        if (rc != SQLITE_DONE) {
+            return false;
+        }
+        sortPermutations();
+        return true;
+    }
+
+    // append adds a just inserted route to the index
+    bool append(RouteRepository& repo, sqlite3_int64 id) {
+        sqlite3_stmt* stmt = repo.statement(SelectRouteColumnsByIdQuery);
+        if (!stmt || sqlite3_bind_int64(stmt, 1, id) != SQLITE_OK) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_DONE) {
+            return true;
+        }
+        if (rc != SQLITE_ROW) {
+            return false;
+        }
+        size_t transportsBefore = transportNames.size();
+        uint32_t row = appendRow(stmt);
+        sqlite3_reset(stmt);
+        insertSorted(byPrice, row, [this](uint32_t a, uint32_t b) {
+            return prices[a] != prices[b] ? prices[a] < prices[b] : ids[a] < ids[b];
+        });
+        insertSorted(byDeparture, row, [this](uint32_t a, uint32_t b) {
+            return departures[a] != departures[b] ? departures[a] < departures[b] : ids[a] < ids[b];
+        });
+        if (transportNames.size() != transportsBefore) {
+            // A new transport type changes ranks of names
+            sortByTransport();
+        } else {
+            insertSorted(byTransport, row, [this](uint32_t a, uint32_t b) {
+                return lessByTransport(a, b);
+            });
+        }
+        return true;
+    }
+
+    // updateSeats reloads seats of a booked or cancelled route, other columns never change
+    bool updateSeats(RouteRepository& repo, sqlite3_int64 id) {
+        auto it = lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id) {
+            return true;
+        }
+        sqlite3_stmt* stmt = repo.statement(SelectRouteColumnsByIdQuery);
+        if (!stmt || sqlite3_bind_int64(stmt, 1, id) != SQLITE_OK) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            KeyedRoute route;
+            KeyedRouteColumns::read(stmt, route);
+            seats[it - ids.begin()] = route.seats;
+            sqlite3_reset(stmt);
+        }
+        return rc == SQLITE_ROW || rc == SQLITE_DONE;
+    }
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    // allRoutes mirrors SelectAllRoutesQuery and SelectAllAvaliableRoutesQuery
+    vector<uint32_t> allRoutes(bool avaliableOnly) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (avaliableOnly) {
+            filterGreater(seats.data(), size(), 0, mask.data());
+        }
+        return collectRows(byPrice.data(), size(), mask);
+    }
+
+    // search mirrors buildSelectRoutesQuery
+    vector<uint32_t> search(const RouteSearch& search) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (search.sourceId > 0) {
+            filterEqual(sourceIds.data(), size(), cityCode(search.sourceId), mask.data());
+        } else if (!search.source.empty() && !filterCity(search.source, sourceIds, mask)) {
+            return vector<uint32_t>();
+        }
+        if (search.destinationId > 0) {
+            filterEqual(destinationIds.data(), size(), cityCode(search.destinationId), mask.data());
+        } else if (!search.destination.empty() && !filterCity(search.destination, destinationIds, mask)) {
+            return vector<uint32_t>();
+        }
+        if (!search.date.empty()) {
+            int64_t epoch;
+            if (!parseSQLiteTime(search.date, epoch)) {
+                return vector<uint32_t>();
+            }
+            filterGreaterEqual(departures.data(), size(), epoch, mask.data());
+        }
+        if (!search.transportType.empty() && !filterTransport(search.transportType, mask)) {
+            return vector<uint32_t>();
+        }
+        if (!search.ticketPrice.empty()) {
+            filterLessEqual(prices.data(), size(), priceLimit(search.ticketPrice), mask.data());
+        }
+        return collectRows(byDeparture.data(), size(), mask);
+    }
+
+    // routesByTransport mirrors SelectRoutesByTransportTypeQuery
+    vector<uint32_t> routesByTransport(const string& transportType) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (!filterTransport(transportType, mask)) {
+            return vector<uint32_t>();
+        }
+        return collectRows(byTransport.data(), size(), mask);
+    }
+
+    // routesByDestination mirrors SelectRoutesByDestinationQuery
+    vector<uint32_t> routesByDestination(const string& destination) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (!filterCity(destination, destinationIds, mask)) {
+            return vector<uint32_t>();
+        }
+        return collectRows(byTransport.data(), size(), mask);
+    }
+
+    // routesByPrice mirrors SelectRoutesByTicketPriceQuery
+    vector<uint32_t> routesByPrice(const string& ticketPrice) const override {
+        vector<uint8_t> mask(size(), 1);
+        filterLessEqual(prices.data(), size(), priceLimit(ticketPrice), mask.data());
+        return collectRows(byPrice.data(), size(), mask);
+    }
+
+    // route returns a selected row, its names are valid until the index changes
+    Route route(uint32_t position) const override {
+        Route route;
+        route.id = ids[position];
+        route.flight = flights.at(position);
+        route.source = cityNames[sourceIds[position]];
+        route.destination = cityNames[destinationIds[position]];
+        route.distance = distances[position];
+        route.departure = departures[position];
+        route.arrival = arrivals[position];
+        route.priceCents = prices[position];
+        route.seats = seats[position];
+        route.transport = transportNames[transportIds[position]];
+        return route;
+    }
+
+    void forEachCity(const function<void(int64_t, string_view)>& visit) const override {
+        for (size_t id = 0; id < cityNames.size(); ++id) {
+            if (!cityNames[id].empty()) {
+                visit(id, cityNames[id]);
+            }
+        }
+    }
+
+private:
+    void clear() {
+        ids.clear();
+        sourceIds.clear();
+        destinationIds.clear();
+        transportIds.clear();
+        departures.clear();
+        arrivals.clear();
+        prices.clear();
+        seats.clear();
+        distances.clear();
+        flights.clear();
+        cityNames.clear();
+        transportNames.clear();
+        cities.clear();
+        transports.clear();
+    }
+
+    // appendRow appends row of SelectRouteColumnsQuery and returns its position
+    uint32_t appendRow(sqlite3_stmt* stmt) {
+        KeyedRoute route;
+        KeyedRouteColumns::read(stmt, route);
+        addName(cityNames, cities, route.sourceId, route.source);
+        addName(cityNames, cities, route.destinationId, route.destination);
+        addName(transportNames, transports, route.transportId, route.transport);
+        ids.push_back(route.id);
+        sourceIds.push_back(route.sourceId);
+        destinationIds.push_back(route.destinationId);
+        transportIds.push_back(route.transportId);
+        distances.push_back(route.distance);
+        departures.push_back(route.departure);
+        arrivals.push_back(route.arrival);
+        prices.push_back(route.priceCents);
+        seats.push_back(route.seats);
+        flights.append(route.flight);
+        return ids.size() - 1;
+    }
+
+    static void addName(vector<string>& names, unordered_map<string, int32_t>& codes,
+                        int32_t id, string_view name) {
+        if (id < 0) {
+            return;
+        }
+        if (names.size() <= size_t(id)) {
+            names.resize(id + 1);
+        }
+        if (names[id].empty()) {
+            names[id] = name;
+            codes[names[id]] = id;
+        }
+    }
+
+    bool lessByTransport(uint32_t a, uint32_t b) const {
+        int32_t rankA = transportRanks[transportIds[a]];
+        int32_t rankB = transportRanks[transportIds[b]];
+        return rankA != rankB ? rankA < rankB : ids[a] < ids[b];
+    }
+
+    // sortByTransport orders rows by transport name as SQLite BINARY collation does
+    void sortByTransport() {
+        vector<int32_t> byName;
+        for (size_t id = 0; id < transportNames.size(); ++id) {
+            if (!transportNames[id].empty()) {
+                byName.push_back(id);
+            }
+        }
+        sort(byName.begin(), byName.end(), [this](int32_t a, int32_t b) {
+            return transportNames[a] < transportNames[b];
+        });
+        transportRanks.assign(transportNames.size(), 0);
+        for (size_t rank = 0; rank < byName.size(); ++rank) {
+            transportRanks[byName[rank]] = rank;
+        }
+        byTransport.resize(size());
+        for (size_t i = 0; i < size(); ++i) {
+            byTransport[i] = i;
+        }
+        sort(byTransport.begin(), byTransport.end(), [this](uint32_t a, uint32_t b) {
+            return lessByTransport(a, b);
+        });
+    }
+
+    void sortPermutations() {
+        byPrice.resize(size());
+        byDeparture.resize(size());
+        for (size_t i = 0; i < size(); ++i) {
+            byPrice[i] = byDeparture[i] = i;
+        }
+        sort(byPrice.begin(), byPrice.end(), [this](uint32_t a, uint32_t b) {
+            return prices[a] != prices[b] ? prices[a] < prices[b] : ids[a] < ids[b];
+        });
+        sort(byDeparture.begin(), byDeparture.end(), [this](uint32_t a, uint32_t b) {
+            return departures[a] != departures[b] ? departures[a] < departures[b] : ids[a] < ids[b];
+        });
+        sortByTransport();
+    }
+
+    template <typename Less>
+    static void insertSorted(vector<uint32_t>& order, uint32_t row, Less less) {
+        order.insert(upper_bound(order.begin(), order.end(), row, less), row);
+    }
+
+    bool filterCity(const string& name, const vector<int32_t>& column, vector<uint8_t>& mask) const {
+        auto it = cities.find(name);
+        if (it == cities.end()) {
+            return false;
+        }
+        filterEqual(column.data(), size(), it->second, mask.data());
+        return true;
+    }
+
+    bool filterTransport(const string& name, vector<uint8_t>& mask) const {
+        auto it = transports.find(name);
+        if (it == transports.end()) {
+            return false;
+        }
+        filterEqual(transportIds.data(), size(), it->second, mask.data());
+        return true;
+    }
+
+    // Filter columns
+    vector<int64_t> ids;
+    vector<int32_t> sourceIds;
+    vector<int32_t> destinationIds;
+    vector<int32_t> transportIds;
+    vector<int64_t> departures;
+    vector<int64_t> arrivals;
+    vector<int32_t> prices;
+    vector<int32_t> seats;
+    vector<int32_t> distances;
+    StringColumn flights;
+    // Dictionaries, names are indexed by ids
+    vector<string> cityNames;
+    vector<string> transportNames;
+    vector<int32_t> transportRanks;
+    unordered_map<string, int32_t> cities;
+    unordered_map<string, int32_t> transports;
+    // Row positions in order of corresponding queries
+    vector<uint32_t> byPrice;
+    vector<uint32_t> byDeparture;
+    vector<uint32_t> byTransport;
+};
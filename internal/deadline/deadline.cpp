@@ -0,0 +1,66 @@
+#pragma once
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+using namespace std;
+
+// QueryDeadline bounds the time statements of a connection run while it is in
+// scope: a progress handler checks the clock every 1000 virtual machine
+// operations and interrupts the statement once the deadline passes, so
+// sqlite3_step returns SQLITE_INTERRUPT and the statement stops without
+// finishing its scan. cancel interrupts the statements at once from another
+// thread or a signal handler. 0 seconds sets no deadline, statements may still
+// be cancelled
+class QueryDeadline {
+public:
+    QueryDeadline(sqlite3* db, double seconds)
+        : db(db), deadline(chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                                                              chrono::duration<double>(seconds))),
+          limited(seconds > 0), expired(false), cancelled(false) {
+        if (db && limited) {
+            sqlite3_progress_handler(db, 1000, check, this);
+        }
+    }
+
+    ~QueryDeadline() {
+        if (db && limited) {
+            sqlite3_progress_handler(db, 0, nullptr, nullptr);
+        }
+    }
+
+    QueryDeadline(const QueryDeadline&) = delete;
+    QueryDeadline& operator=(const QueryDeadline&) = delete;
+
+    void cancel() {
+        cancelled = true;
+        if (db) {
+            sqlite3_interrupt(db);
+        }
+    }
+
+    // timedOut reports whether a statement was interrupted by the deadline
+    bool timedOut() const {
+        return expired;
+    }
+
+    // interrupted reports whether a statement was stopped by the deadline or cancel
+    bool interrupted() const {
+        return expired || cancelled;
+    }
+
+private:
+    static int check(void* self) {
+        QueryDeadline* query = static_cast<QueryDeadline*>(self);
+        if (chrono::steady_clock::now() < query->deadline) {
+            return 0;
+        }
+        query->expired = true;
+        return 1;
+    }
+
+    sqlite3* db;
+    const chrono::steady_clock::time_point deadline;
+    const bool limited;
+    atomic<bool> expired;
+    atomic<bool> cancelled;
+};
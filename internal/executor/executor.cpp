@@ -0,0 +1,167 @@
+#pragma once
+#include <sqlite3.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "repository.cpp"
+#include "render.cpp"
+#include "metrics.cpp"
+#include "deadline.cpp"
+using namespace std;
+
+// SearchResult is a search of a batch: matching routes rendered as JSON array
+// in the order of the query, or an error
+struct SearchResult {
+    string body;
+    long rows = 0;
+    string error; // empty on success
+};
+
+// SearchExecutor runs batches of independent searches concurrently, one search
+// per read connection at a time. Connections are opened once, read only, and
+// the database is switched into WAL mode, so searches do not wait for writers
+// of other processes and every connection keeps its own prepared statements.
+// Connections read the database through a shared memory map instead of
+// copying pages into a private cache each. A search running longer than the
+// timeout is stopped and gets an error instead of its rows
+class SearchExecutor {
+public:
+    // connections is the size of the pool, 0 takes one connection per core,
+    // timeoutSeconds is the deadline of a search, 0 sets none
+    explicit SearchExecutor(int connections = 0, QueryMetrics* metrics = nullptr, double timeoutSeconds = 0)
+        : connections(connections > 0 ? connections : max(1u, thread::hardware_concurrency())),
+          metrics(metrics), timeoutSeconds(timeoutSeconds) {}
+
+    // open opens the pool, `error` gets the reason of a failure
+    bool open(const char* path, string& error) {
+        for (int i = 0; i < connections; ++i) {
+            unique_ptr<RouteRepository> repo(new RouteRepository());
+            if (!repo->open(path) || (i == 0 && !repo->configure("PRAGMA journal_mode=WAL;")) ||
+                !repo->configure("PRAGMA query_only = ON; PRAGMA mmap_size = 1073741824;")) {
+                error = repo->error();
+                return false;
+            }
+            if (repo->schemaVersion() < RouteSchemaVersion) {
+                error = "database schema is outdated";
+                return false;
+            }
+            pool.push_back(move(repo));
+        }
+        return true;
+    }
+
+    int size() const {
+        return int(pool.size());
+    }
+
+    // run executes all searches and hands every result to `completed` on the
+    // calling thread: in request order as soon as all results before it are
+    // ready, or with `asCompleted` in order of completion. A result is released
+    // once it is handed over, so a batch is never held in memory as a whole
+    void run(const vector<RouteSearch>& searches, const function<void(size_t, SearchResult&)>& completed,
+             bool asCompleted = false) {
+        vector<SearchResult> results(searches.size());
+        vector<bool> finished(searches.size(), false);
+        atomic<size_t> next(0);
+        mutex guard;
+        condition_variable ready;
+        deque<size_t> done;
+        auto work = [&](RouteRepository& repo) {
+            for (size_t i = next++; i < searches.size(); i = next++) {
+                execute(repo, searches[i], results[i]);
+                {
+                    lock_guard<mutex> lock(guard);
+                    done.push_back(i);
+                }
+                ready.notify_one();
+            }
+        };
+        // The calling thread only hands results over, every connection gets a thread
+        vector<thread> threads;
+        const size_t used = min(pool.size(), searches.size());
+        for (size_t i = 0; i < used; ++i) {
+            threads.emplace_back(work, ref(*pool[i]));
+        }
+        size_t handed = 0;
+        for (size_t reported = 0; reported < searches.size(); ++reported) {
+            unique_lock<mutex> lock(guard);
+            ready.wait(lock, [&done] { return !done.empty(); });
+            size_t index = done.front();
+            done.pop_front();
+            lock.unlock();
+            if (asCompleted) {
+                hand(completed, index, results[index]);
+                continue;
+            }
+            finished[index] = true;
+            for (; handed < searches.size() && finished[handed]; ++handed) {
+                hand(completed, handed, results[handed]);
+            }
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+
+    // run returns results of all searches in request order
+    vector<SearchResult> run(const vector<RouteSearch>& searches) {
+        vector<SearchResult> results(searches.size());
+        run(searches, [&results](size_t index, SearchResult& result) { results[index] = move(result); });
+        return results;
+    }
+
+private:
+    static void hand(const function<void(size_t, SearchResult&)>& completed, size_t index, SearchResult& result) {
+        completed(index, result);
+        // Assigning an empty result would keep the buffer of the body
+        SearchResult released;
+        swap(result, released);
+    }
+
+    // execute runs a search on `repo` and renders its rows as the server does
+    void execute(RouteRepository& repo, const RouteSearch& search, SearchResult& result) {
+        sqlite3_stmt* stmt = repo.searchRoutes(search);
+        if (!stmt) {
+            result.error = repo.error();
+            return;
+        }
+        result.body = "[";
+        Route route;
+        QueryDeadline deadline(repo.handle(), timeoutSeconds);
+        QueryTimer timer(stmt);
+        int rc;
+        while ((rc = timer.step()) == SQLITE_ROW) {
+            if (result.rows++ > 0) {
+                result.body += ',';
+            }
+            RouteColumns::read(stmt, route);
+            appendRouteJSON(result.body, route, true);
+        }
+        if (rc != SQLITE_DONE) {
+            result.error = deadline.timedOut() ? "query timed out" : repo.error();
+            result.body.clear();
+            result.rows = 0;
+            sqlite3_reset(stmt);
+            if (metrics && deadline.timedOut()) {
+                metrics->record("search_routes", timer);
+                metrics->recordTimeout("search_routes");
+            }
+            return;
+        }
+        result.body += "]";
+        if (metrics) {
+            metrics->record("search_routes", timer);
+        }
+    }
+
+    const int connections;
+    QueryMetrics* metrics;
+    const double timeoutSeconds;
+    vector<unique_ptr<RouteRepository>> pool;
+};
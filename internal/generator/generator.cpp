@@ -0,0 +1,339 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "importer.cpp"
+#include "render.cpp"
+#include "timeutil.cpp"
+using namespace std;
+
+// TimetableOptions configures a synthetic timetable
+struct TimetableOptions {
+    int cities = 50;
+    int transports = 4;
+    int days = 30;
+    long routesPerDay = 1000;
+    uint64_t seed = 1;
+    string start = "2024-11-01"; // first day of departures
+};
+
+// TimetableGenerator produces a repeatable timetable that looks like a real one:
+// big cities have more routes, transport depends on distance, travel time and
+// price grow with distance and some routes are sold out. The same options and
+// seed always give the same routes
+class TimetableGenerator {
+public:
+    explicit TimetableGenerator(const TimetableOptions& options)
+        : options(options), state(options.seed * 0x9E3779B97F4A7C15ULL + 1), produced(0) {
+        parseSQLiteTime(options.start, firstDay);
+        addCities();
+        addTransports();
+    }
+
+    long size() const {
+        return long(options.days) * options.routesPerDay;
+    }
+
+    // next fills record with the next route, routes go day by day
+    bool next(RouteRecord& record) {
+        if (produced >= size() || cities.size() < 2) {
+            return false;
+        }
+        const int64_t day = produced / options.routesPerDay;
+        size_t source = pickCity();
+        size_t destination = pickCity();
+        while (destination == source) {
+            destination = pickCity();
+        }
+        const double distance = roadDistance(cities[source], cities[destination]);
+        const Transport& transport = transports[pickTransport(distance)];
+        // Most departures are between 6:00 and 23:00, every 5 minutes
+        int64_t minute = uniform() < 0.7 ? 360 + int64_t(uniform() * 1020) : int64_t(uniform() * 1440);
+        int64_t departure = firstDay + day * 86400 + minute / 5 * 300;
+        int64_t travel = int64_t((transport.overhead + distance / transport.speed) * 3600);
+        double price = (transport.basePrice + transport.pricePerKm * distance) * (0.7 + 0.6 * uniform());
+        long seats = uniform() < 0.05 ? 0 : long(uniform() * transport.capacity);
+
+        record.flight = transport.prefix + to_string(1000 + produced % 9000);
+        record.source = cities[source].name;
+        record.destination = cities[destination].name;
+        record.departureTime = formatSQLiteTime(departure);
+        record.arrivalTime = formatSQLiteTime(departure + travel / 300 * 300);
+        record.transportType = transport.name;
+        record.ticketPrice = to_string(max(10L, long(price / 10) * 10));
+        record.distance = to_string(long(distance));
+        record.seatsAvaliable = to_string(seats);
+        ++produced;
+        return true;
+    }
+
+    // Names of generated cities, the most populated goes first
+    vector<string> cityNames() const {
+        vector<string> names;
+        for (const City& city : cities) {
+            names.push_back(city.name);
+        }
+        return names;
+    }
+
+    // writeHeader writes CSV header of import files
+    static void writeHeader(ostream& out, ImportFormat format) {
+        if (format != ImportFormat::CSV) {
+            return;
+        }
+        for (size_t i = 0; i < importFields.size(); ++i) {
+            out << (i > 0 ? "," : "") << importFields[i];
+        }
+        out << "\n";
+    }
+
+    // writeRecord writes record as a line of an import file
+    static void writeRecord(ostream& out, ImportFormat format, const RouteRecord& record) {
+        const string* fields[] = {
+            &record.flight, &record.source, &record.destination, &record.departureTime,
+            &record.arrivalTime, &record.transportType, &record.ticketPrice,
+            &record.distance, &record.seatsAvaliable};
+        if (format == ImportFormat::CSV) {
+            for (size_t i = 0; i < importFields.size(); ++i) {
+                out << (i > 0 ? "," : "") << *fields[i];
+            }
+            out << "\n";
+            return;
+        }
+        string line = "{";
+        for (size_t i = 0; i < importFields.size(); ++i) {
+            line += i > 0 ? ",\"" : "\"";
+            line += importFields[i] + "\":";
+            // Numbers go last in importFields
+            if (i >= 6) {
+                line += *fields[i];
+            } else {
+                appendJSONString(line, *fields[i]);
+            }
+        }
+        out << line << "}\n";
+    }
+
+private:
+    struct City {
+        string name;
+        double latitude;
+        double longitude;
+        double population; // millions
+    };
+
+    struct Transport {
+        string name;
+        string prefix;
+        double speed;      // km/h
+        double overhead;   // hours of boarding and transfers
+        double basePrice;
+        double pricePerKm;
+        long capacity;
+    };
+
+    void addCities() {
+        static const City known[] = {
+            {"Москва", 55.76, 37.62, 13.1}, {"Санкт-Петербург", 59.94, 30.31, 5.6},
+            {"Новосибирск", 55.03, 82.92, 1.6}, {"Екатеринбург", 56.84, 60.61, 1.5},
+            {"Казань", 55.79, 49.12, 1.3}, {"Нижний Новгород", 56.33, 44.00, 1.2},
+            {"Красноярск", 56.01, 92.87, 1.2}, {"Челябинск", 55.16, 61.40, 1.2},
+            {"Самара", 53.20, 50.15, 1.2}, {"Уфа", 54.74, 55.97, 1.2},
+            {"Ростов-на-Дону", 47.23, 39.72, 1.1}, {"Краснодар", 45.04, 38.98, 1.1},
+            {"Омск", 54.99, 73.37, 1.1}, {"Воронеж", 51.66, 39.20, 1.0},
+            {"Пермь", 58.01, 56.25, 1.0}, {"Волгоград", 48.71, 44.51, 1.0},
+            {"Саратов", 51.53, 46.03, 0.9}, {"Тюмень", 57.15, 65.53, 0.8},
+            {"Тольятти", 53.51, 49.42, 0.7}, {"Барнаул", 53.35, 83.78, 0.6},
+            {"Махачкала", 42.98, 47.50, 0.6}, {"Ижевск", 56.85, 53.21, 0.6},
+            {"Хабаровск", 48.48, 135.07, 0.6}, {"Ульяновск", 54.32, 48.40, 0.6},
+            {"Иркутск", 52.29, 104.28, 0.6}, {"Владивосток", 43.12, 131.89, 0.6},
+            {"Ярославль", 57.63, 39.87, 0.6}, {"Томск", 56.50, 84.97, 0.6},
+            {"Оренбург", 51.77, 55.10, 0.5}, {"Кемерово", 55.35, 86.09, 0.5},
+            {"Рязань", 54.63, 39.74, 0.5}, {"Набережные Челны", 55.74, 52.40, 0.5},
+            {"Астрахань", 46.35, 48.04, 0.5}, {"Пенза", 53.20, 45.00, 0.5},
+            {"Киров", 58.60, 49.66, 0.5}, {"Липецк", 52.61, 39.59, 0.5},
+            {"Калининград", 54.71, 20.51, 0.5}, {"Тула", 54.19, 37.62, 0.5},
+            {"Сочи", 43.59, 39.72, 0.4}, {"Мурманск", 68.97, 33.07, 0.3},
+        };
+        for (int i = 0; i < options.cities; ++i) {
+            if (size_t(i) < sizeof(known) / sizeof(known[0])) {
+                cities.push_back(known[i]);
+                continue;
+            }
+            // Small towns are spread over the populated part of the country
+            City city{"Город " + to_string(i + 1), 43 + uniform() * 17, 30 + uniform() * 100,
+                      0.02 + 0.2 * uniform() * uniform()};
+            cities.push_back(city);
+        }
+        double total = 0;
+        for (const City& city : cities) {
+            total += city.population;
+            weights.push_back(total);
+        }
+    }
+
+    void addTransports() {
+        static const Transport known[] = {
+            {"Самолет", "SU", 750, 1.5, 2500, 3.5, 180},
+            {"Поезд", "TR", 80, 0.3, 400, 1.8, 450},
+            {"Автобус", "BS", 60, 0.2, 150, 1.4, 50},
+            {"Паром", "FR", 30, 0.5, 600, 2.5, 300},
+        };
+        for (int i = 0; i < max(1, options.transports); ++i) {
+            if (size_t(i) < sizeof(known) / sizeof(known[0])) {
+                transports.push_back(known[i]);
+            } else {
+                transports.push_back(Transport{"Транспорт " + to_string(i + 1), "TX", 50, 0.3, 200, 1.5, 100});
+            }
+        }
+    }
+
+    // uniform returns a number in [0, 1), xorshift keeps sequences equal on every platform
+    double uniform() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (state >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // pickCity picks a city with probability proportional to its population
+    size_t pickCity() {
+        double value = uniform() * weights.back();
+        return upper_bound(weights.begin(), weights.end(), value) - weights.begin();
+    }
+
+    // pickTransport prefers buses for short trips, trains for middle and planes for long ones
+    size_t pickTransport(double distance) {
+        const size_t count = transports.size();
+        double value = uniform();
+        size_t transport;
+        if (value < 0.03) {
+            transport = 3 + size_t(uniform() * 8); // ferries and other kinds are rare
+        } else if (distance < 400) {
+            transport = value < 0.6 ? 2 : 1;
+        } else if (distance < 1500) {
+            transport = value < 0.6 ? 1 : value < 0.9 ? 0 : 2;
+        } else {
+            transport = value < 0.8 ? 0 : 1;
+        }
+        return transport < count ? transport : transport % count;
+    }
+
+    // roadDistance is great-circle distance with a detour factor, km
+    static double roadDistance(const City& a, const City& b) {
+        const double radians = M_PI / 180;
+        double dLatitude = (b.latitude - a.latitude) * radians;
+        double dLongitude = (b.longitude - a.longitude) * radians;
+        double h = sin(dLatitude / 2) * sin(dLatitude / 2) +
+            cos(a.latitude * radians) * cos(b.latitude * radians) * sin(dLongitude / 2) * sin(dLongitude / 2);
+        return 1.2 * 2 * 6371 * asin(sqrt(h));
+    }
+
+    TimetableOptions options;
+    uint64_t state;
+    long produced;
+    int64_t firstDay;
+    vector<City> cities;
+    vector<double> weights; // cumulative populations
+    vector<Transport> transports;
+};
+
+// applyMigration runs every statement of a migration file
+inline bool applyMigration(RouteRepository& repo, const string& path) {
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    stringstream sql;
+    sql << file.rdbuf();
+    return repo.configure(sql.str());
+}
+
+// generateTimetable writes generated routes into the database. A new database
+// gets the schema first and its indexes and aggregates after the routes, which
+// is faster than updating them on every insert
+inline bool generateTimetable(RouteRepository& repo, const TimetableOptions& options,
+                              const string& migrations, ImportStats& stats) {
+    auto start = chrono::steady_clock::now();
+    if (!repo.hasSchema() && !applyMigration(repo, migrations + "/create.sql")) {
+        return false;
+    }
+    TimetableGenerator generator(options);
+    RouteImporter importer(repo, 10000);
+    RouteRecord record;
+    if (!importer.begin()) {
+        return false;
+    }
+    while (generator.next(record)) {
+        if (!importer.add(record, stats)) {
+            return false;
+        }
+    }
+    if (!importer.finish(stats) || !applyMigration(repo, migrations + "/create_indexes.sql") ||
+        !applyMigration(repo, migrations + "/create_bookings.sql") ||
+        !applyMigration(repo, migrations + "/create_aggregates.sql") ||
+        !applyMigration(repo, migrations + "/create_partitions.sql")) {
+        return false;
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// MigrationStats is a summary of a schema migration
+struct MigrationStats {
+    int fromVersion = 0;
+    long long bytesBefore = 0;
+    long long bytesAfter = 0;
+    double seconds = 0;
+};
+
+// databaseBytes returns size of the database file in bytes
+inline long long databaseBytes(RouteRepository& repo) {
+    long long bytes = 1;
+    for (const char* pragma : {"PRAGMA page_count;", "PRAGMA page_size;"}) {
+        sqlite3_stmt* stmt = repo.statement(pragma);
+        bytes *= stmt && sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        if (stmt) {
+            sqlite3_reset(stmt);
+        }
+    }
+    return bytes;
+}
+
+// migrateSchema converts routes of an older schema version in place, rebuilds
+// their indexes and compacts the file, then adds route aggregates and the
+// catalog of partitions. A failed step is rolled back
+inline bool migrateSchema(RouteRepository& repo, const string& migrations, MigrationStats& stats) {
+    auto start = chrono::steady_clock::now();
+    stats.fromVersion = repo.schemaVersion();
+    stats.bytesBefore = stats.bytesAfter = databaseBytes(repo);
+    if (stats.fromVersion >= RouteSchemaVersion) {
+        return true;
+    }
+    if (stats.fromVersion < 1) {
+        if (!applyMigration(repo, migrations + "/migrate_compact.sql")) {
+            repo.configure("ROLLBACK;");
+            return false;
+        }
+        if (!applyMigration(repo, migrations + "/create_indexes.sql") || !repo.configure("VACUUM;")) {
+            return false;
+        }
+    }
+    if (stats.fromVersion < 2 && !applyMigration(repo, migrations + "/create_aggregates.sql")) {
+        repo.configure("ROLLBACK;");
+        return false;
+    }
+    if (!applyMigration(repo, migrations + "/create_partitions.sql")) {
+        repo.configure("ROLLBACK;");
+        return false;
+    }
+    stats.bytesAfter = databaseBytes(repo);
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,480 @@
+#pragma once
+#include <sqlite3.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "repository.cpp"
+using namespace std;
+
+// ImportFormat is a format of route records stream
+enum class ImportFormat {
+    CSV,
+    JSONL,
+};
+
+// RouteRecord is a single route of an import stream
+struct RouteRecord {
+    string flight;
+    string source;
+    string destination;
+    string departureTime;
+    string arrivalTime;
+    string transportType;
+    string ticketPrice;
+    string distance;
+    string seatsAvaliable;
+};
+
+// ImportStats is a summary of finished import
+struct ImportStats {
+    long imported = 0;
+    long rejected = 0;
+    long batches = 0;
+    double seconds = 0;
+};
+
+// importFields are names of CSV header columns and JSON keys of a record
+const vector<string> importFields = {
+    "flight", "source", "destination", "departure_time", "arrival_time",
+    "transport", "ticket_price", "distance", "seats_available"};
+
+// RouteImporter streams route records into the database, records are written
+// in explicit transactions of `batchSize` rows and city and transport names are
+// resolved through in-memory maps, so a row costs exactly one INSERT
+class RouteImporter {
+public:
+    RouteImporter(RouteRepository& repo, size_t batchSize)
+        : repo(repo), batchSize(batchSize ? batchSize : 1), inBatch(0) {}
+
+    // run imports every record of the stream, broken records are reported and skipped
+    bool run(istream& in, ImportFormat format, ImportStats& stats) {
+        auto start = chrono::steady_clock::now();
+        if (!begin()) {
+            return false;
+        }
+        vector<int> columns;
+        string line;
+        long lineNumber = 0;
+        if (format == ImportFormat::CSV) {
+            ++lineNumber;
+            if (!getline(in, line) || !parseHeader(line, columns)) {
+                cerr << "import: invalid CSV header, expected columns:";
+                for (const string& field : importFields) {
+                    cerr << " " << field;
+                }
+                cerr << "\n";
+                return false;
+            }
+        }
+        while (getline(in, line)) {
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            RouteRecord record;
+            string error;
+            bool parsed = format == ImportFormat::CSV
+                ? parseCSVRecord(line, columns, record, error)
+                : parseJSONRecord(line, record, error);
+            if (parsed && !normalizeRecord(record, error)) {
+                parsed = false;
+            }
+            if (!parsed) {
+                cerr << "import: line " << lineNumber << ": " << error << "\n";
+                ++stats.rejected;
+                continue;
+            }
+            if (!add(record, stats)) {
+                cerr << "import: line " << lineNumber << ": " << sqlite3_errmsg(repo.handle()) << "\n";
+                return false;
+            }
+        }
+        if (!finish(stats)) {
+            return false;
+        }
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // begin loads ids of known cities and transport types, it is called before
+    // records are added one by one
+    bool begin() {
+        return loadDimension(SelectDestinationsQuery, destinations) &&
+            loadDimension(SelectTransportTypesQuery, transportTypes);
+    }
+
+    // add imports a normalized record. On error rows of the current batch are
+    // rolled back, committed batches are kept
+    bool add(const RouteRecord& record, ImportStats& stats) {
+        if (!insert(record)) {
+            repo.execute("ROLLBACK");
+            stats.imported -= inBatch;
+            inBatch = 0;
+            return false;
+        }
+        ++stats.imported;
+        if (inBatch == batchSize) {
+            if (!repo.execute("COMMIT")) {
+                return false;
+            }
+            inBatch = 0;
+            ++stats.batches;
+        }
+        return true;
+    }
+
+    // finish commits the last batch
+    bool finish(ImportStats& stats) {
+        if (inBatch > 0) {
+            if (!repo.execute("COMMIT")) {
+                return false;
+            }
+            inBatch = 0;
+            ++stats.batches;
+        }
+        return true;
+    }
+
+private:
+    // loadDimension fills `ids` by name once before the import
+    bool loadDimension(const string& query, unordered_map<string, sqlite3_int64>& ids) {
+        sqlite3_stmt* stmt = repo.statement(query);
+        if (!stmt) {
+            return false;
+        }
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            ids[name ? name : ""] = sqlite3_column_int64(stmt, 0);
+        }
+        return rc == SQLITE_DONE;
+    }
+
+    // resolve returns id of name, unknown names are inserted into dimension table
+    bool resolve(const string& name, const string& insertQuery,
+                 unordered_map<string, sqlite3_int64>& ids, sqlite3_int64& id) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            id = it->second;
+            return true;
+        }
+        sqlite3_stmt* stmt = repo.statement(insertQuery);
+        if (!stmt ||
+            sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK ||
+            sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
+        }
+        id = sqlite3_last_insert_rowid(repo.handle());
+        ids.emplace(name, id);
+        return true;
+    }
+
+    // insert writes record in the current batch, the batch is started if needed
+    bool insert(const RouteRecord& record) {
+        if (inBatch == 0 && !repo.execute("BEGIN")) {
+            return false;
+        }
+        NewRoute route;
+        sqlite3_int64 transportId, sourceId, destinationId;
+        if (!newRoute(record, route) ||
+            !resolve(record.transportType, InsertTransportTypeQuery, transportTypes, transportId) ||
+            !resolve(record.source, InsertDestinationQuery, destinations, sourceId) ||
+            !resolve(record.destination, InsertDestinationQuery, destinations, destinationId)) {
+            return false;
+        }
+        sqlite3_stmt* stmt = repo.statement(InsertRouteByIdsQuery);
+        if (!stmt ||
+            sqlite3_bind_text(stmt, 1, record.flight.c_str(), -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 2, transportId) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 3, sourceId) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 4, destinationId) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 5, route.distance) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 6, route.departure) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 7, route.arrival) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 8, route.seats) != SQLITE_OK ||
+            sqlite3_bind_int64(stmt, 9, route.priceCents) != SQLITE_OK ||
+            sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
+        }
+        ++inBatch;
+        return true;
+    }
+
+    // field returns record's field by its index in `importFields`
+    static string& field(RouteRecord& record, size_t index) {
+        string* fields[] = {
+            &record.flight, &record.source, &record.destination, &record.departureTime,
+            &record.arrivalTime, &record.transportType, &record.ticketPrice,
+            &record.distance, &record.seatsAvaliable};
+        return *fields[index];
+    }
+
+    static int fieldIndex(const string& name) {
+        for (size_t i = 0; i < importFields.size(); ++i) {
+            if (importFields[i] == name) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // splitCSV splits a CSV line, double quoted fields may contain commas and "" escapes
+    static bool splitCSV(const string& line, vector<string>& values) {
+        values.clear();
+        string value;
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i) {
+            char c = line[i];
+            if (quoted) {
+                if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                    value += '"';
+                    ++i;
+                } else if (c == '"') {
+                    quoted = false;
+                } else {
+                    value += c;
+                }
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                values.push_back(value);
+                value.clear();
+            } else {
+                value += c;
+            }
+        }
+        values.push_back(value);
+        return !quoted;
+    }
+
+    // parseHeader maps CSV columns to record fields
+    static bool parseHeader(string line, vector<int>& columns) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        vector<string> names;
+        if (!splitCSV(line, names)) {
+            return false;
+        }
+        vector<bool> seen(importFields.size(), false);
+        columns.clear();
+        for (const string& name : names) {
+            int index = fieldIndex(name);
+            columns.push_back(index);
+            if (index >= 0) {
+                seen[index] = true;
+            }
+        }
+        for (bool present : seen) {
+            if (!present) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool parseCSVRecord(const string& line, const vector<int>& columns,
+                               RouteRecord& record, string& error) {
+        vector<string> values;
+        if (!splitCSV(line, values) || values.size() != columns.size()) {
+            error = "invalid number of columns";
+            return false;
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (columns[i] >= 0) {
+                field(record, columns[i]) = values[i];
+            }
+        }
+        return true;
+    }
+
+public:
+    // parseJSONString reads a JSON string starting at the opening quote
+    static bool parseJSONString(const string& line, size_t& pos, string& value) {
+        value.clear();
+        for (++pos; pos < line.size(); ++pos) {
+            char c = line[pos];
+            if (c == '"') {
+                ++pos;
+                return true;
+            }
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (++pos == line.size()) {
+                return false;
+            }
+            switch (line[pos]) {
+                case 'n': value += '\n'; break;
+                case 't': value += '\t'; break;
+                case 'r': value += '\r'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    if (pos + 4 >= line.size()) {
+                        return false;
+                    }
+                    unsigned code = strtoul(line.substr(pos + 1, 4).c_str(), nullptr, 16);
+                    pos += 4;
+                    // Encode code point as UTF-8, surrogate pairs are not expected in names
+                    if (code < 0x80) {
+                        value += char(code);
+                    } else if (code < 0x800) {
+                        value += char(0xC0 | (code >> 6));
+                        value += char(0x80 | (code & 0x3F));
+                    } else {
+                        value += char(0xE0 | (code >> 12));
+                        value += char(0x80 | ((code >> 6) & 0x3F));
+                        value += char(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: value += line[pos]; break;
+            }
+        }
+        return false;
+    }
+
+    // parseJSONRecord parses a flat JSON object with string or number values
+    static bool parseJSONRecord(const string& line, RouteRecord& record, string& error) {
+        return parseJSONObject(line, error, [&record](const string& key, const string& value) {
+            int index = fieldIndex(key);
+            if (index >= 0) {
+                field(record, index) = value;
+            }
+        });
+    }
+
+    // parseJSONObject parses a flat JSON object and calls onField(key, value) for
+    // every field, values that are not strings, such as arrays of numbers, are
+    // passed as their source text
+    template <typename OnField>
+    static bool parseJSONObject(const string& line, string& error, OnField onField) {
+        size_t pos = line.find('{');
+        if (pos == string::npos) {
+            error = "expected JSON object";
+            return false;
+        }
+        ++pos;
+        string key, value;
+        while (true) {
+            pos = line.find_first_not_of(" \t", pos);
+            if (pos == string::npos) {
+                break;
+            }
+            if (line[pos] == '}') {
+                return true;
+            }
+            if (line[pos] == ',') {
+                ++pos;
+                continue;
+            }
+            if (line[pos] != '"' || !parseJSONString(line, pos, key)) {
+                break;
+            }
+            pos = line.find_first_not_of(" \t", pos);
+            if (pos == string::npos || line[pos] != ':') {
+                break;
+            }
+            pos = line.find_first_not_of(" \t", pos + 1);
+            if (pos == string::npos) {
+                break;
+            }
+            if (line[pos] == '"') {
+                if (!parseJSONString(line, pos, value)) {
+                    break;
+                }
+            } else {
+                // Arrays of numbers are passed as a whole
+                size_t end = line[pos] == '[' ? line.find(']', pos) : line.find_first_of(",} \t", pos);
+                if (end == string::npos) {
+                    break;
+                }
+                if (line[pos] == '[') {
+                    ++end;
+                }
+                value = line.substr(pos, end - pos);
+                pos = end;
+            }
+            onField(key, value);
+        }
+        error = "invalid JSON object";
+        return false;
+    }
+
+    // normalizeDate converts "dd.mm.yyyy[ HH:MM:SS]" into SQLite "yyyy-mm-dd[ HH:MM:SS]",
+    // dates already in SQLite format are kept
+    static bool normalizeDate(string& date) {
+        int day, month, year;
+        if (date.size() >= 10 && date[4] == '-' && date[7] == '-') {
+            return sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day) == 3;
+        }
+        if (date.size() < 10 || date[2] != '.' || date[5] != '.' ||
+            sscanf(date.c_str(), "%d.%d.%d", &day, &month, &year) != 3) {
+            return false;
+        }
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, day);
+        date = buffer + date.substr(10);
+        return true;
+    }
+
+    static bool isNumber(const string& value) {
+        if (value.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        double number = strtod(value.c_str(), &end);
+        return *end == '\0' && number >= 0;
+    }
+
+    // normalizeRecord validates record and converts its dates
+    static bool normalizeRecord(RouteRecord& record, string& error) {
+        if (record.flight.empty() || record.source.empty() ||
+            record.destination.empty() || record.transportType.empty()) {
+            error = "flight, source, destination and transport are required";
+            return false;
+        }
+        if (!normalizeDate(record.departureTime) || !normalizeDate(record.arrivalTime)) {
+            error = "invalid date format";
+            return false;
+        }
+        if (!isNumber(record.ticketPrice) || !isNumber(record.distance) ||
+            !isNumber(record.seatsAvaliable)) {
+            error = "invalid number";
+            return false;
+        }
+        NewRoute route;
+        if (!newRoute(record, route)) {
+            error = "invalid date or price";
+            return false;
+        }
+        return true;
+    }
+
+    // newRoute converts a normalized record into stored form, dates are "yyyy-mm-dd[ HH:MM:SS]"
+    static bool newRoute(const RouteRecord& record, NewRoute& route) {
+        route.flight = record.flight;
+        route.source = record.source;
+        route.destination = record.destination;
+        route.transportType = record.transportType;
+        route.distance = atoll(record.distance.c_str());
+        route.seats = atoll(record.seatsAvaliable.c_str());
+        return parseSQLiteTime(record.departureTime, route.departure) &&
+            parseSQLiteTime(record.arrivalTime, route.arrival) && parseCents(record.ticketPrice, route.priceCents);
+    }
+
+private:
+    RouteRepository& repo;
+    size_t batchSize;
+    size_t inBatch;
+    unordered_map<string, sqlite3_int64> destinations;
+    unordered_map<string, sqlite3_int64> transportTypes;
+};
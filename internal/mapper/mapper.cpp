@@ -0,0 +1,148 @@
+#pragma once
+#include <sqlite3.h>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+using namespace std;
+
+// ColumnAffinity is a type affinity of a result column as SQLite derives it
+// from the declared type of the table column
+enum class ColumnAffinity {
+    Integer,
+    Real,
+    Text,
+    Numeric,
+    Blob,
+};
+
+// declaredAffinity applies SQLite rules of affinity to a declared column type
+inline ColumnAffinity declaredAffinity(string declared) {
+    for (char& c : declared) {
+        c = toupper(c);
+    }
+    if (declared.find("INT") != string::npos) {
+        return ColumnAffinity::Integer;
+    }
+    if (declared.find("CHAR") != string::npos || declared.find("CLOB") != string::npos ||
+        declared.find("TEXT") != string::npos) {
+        return ColumnAffinity::Text;
+    }
+    if (declared.empty() || declared.find("BLOB") != string::npos) {
+        return ColumnAffinity::Blob;
+    }
+    if (declared.find("REAL") != string::npos || declared.find("FLOA") != string::npos ||
+        declared.find("DOUB") != string::npos) {
+        return ColumnAffinity::Real;
+    }
+    return ColumnAffinity::Numeric;
+}
+
+// ColumnDecoder reads a result column into a field of type T: integers and
+// floating point numbers are read as they are stored, text as a view into the
+// statement, so no decoding allocates
+template <typename T, typename Enable = void>
+struct ColumnDecoder;
+
+template <typename T>
+struct ColumnDecoder<T, typename enable_if<is_integral<T>::value>::type> {
+    static constexpr ColumnAffinity affinity = ColumnAffinity::Integer;
+
+    static void read(sqlite3_stmt* stmt, int index, T& value) {
+        value = T(sqlite3_column_int64(stmt, index));
+    }
+};
+
+template <typename T>
+struct ColumnDecoder<T, typename enable_if<is_floating_point<T>::value>::type> {
+    static constexpr ColumnAffinity affinity = ColumnAffinity::Real;
+
+    static void read(sqlite3_stmt* stmt, int index, T& value) {
+        value = T(sqlite3_column_double(stmt, index));
+    }
+};
+
+template <>
+struct ColumnDecoder<string_view> {
+    static constexpr ColumnAffinity affinity = ColumnAffinity::Text;
+
+    static void read(sqlite3_stmt* stmt, int index, string_view& value) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+        value = text ? string_view(text, sqlite3_column_bytes(stmt, index)) : string_view();
+    }
+};
+
+// Column maps a result column to the field `Member` of a row struct
+template <auto Member>
+struct Column;
+
+template <typename Row, typename T, T Row::*Member>
+struct Column<Member> {
+    static constexpr ColumnAffinity affinity = ColumnDecoder<T>::affinity;
+
+    static void read(sqlite3_stmt* stmt, int index, Row& row) {
+        ColumnDecoder<T>::read(stmt, index, row.*Member);
+    }
+};
+
+// RowMapper decodes rows of a query whose result columns are `Columns` in order.
+// The list is the contract of the query: check compares it with a prepared
+// statement once, read then decodes every row without looking at types again
+template <typename Row, typename... Columns>
+struct RowMapper {
+    static constexpr int size = sizeof...(Columns);
+
+    // check compares number of columns and their declared types with the list
+    static bool check(sqlite3_stmt* stmt, string& error) {
+        if (sqlite3_column_count(stmt) != size) {
+            error = "query returns " + to_string(sqlite3_column_count(stmt)) + " columns, mapper expects " +
+                to_string(size);
+            return false;
+        }
+        const ColumnAffinity expected[] = {Columns::affinity...};
+        for (int i = 0; i < size; ++i) {
+            const char* declared = sqlite3_column_decltype(stmt, i);
+            if (!declared || declaredAffinity(declared) != expected[i]) {
+                error = string("column ") + sqlite3_column_name(stmt, i) + " is declared as " +
+                    (declared ? declared : "an expression") + ", mapper expects another type";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // read decodes the current row, text fields are valid until the statement
+    // is stepped or reset
+    static void read(sqlite3_stmt* stmt, Row& row) {
+        int index = 0;
+        (Columns::read(stmt, index++, row), ...);
+    }
+};
+
+// bindParam binds a parameter by its type: integers as INTEGER, floating point
+// numbers as REAL and anything convertible to string_view as a copied TEXT
+template <typename T>
+bool bindParam(sqlite3_stmt* stmt, int index, const T& value) {
+    if constexpr (is_integral<T>::value) {
+        return sqlite3_bind_int64(stmt, index, value) == SQLITE_OK;
+    } else if constexpr (is_floating_point<T>::value) {
+        return sqlite3_bind_double(stmt, index, value) == SQLITE_OK;
+    } else {
+        const string_view text(value);
+        return sqlite3_bind_text(stmt, index, text.data(), int(text.size()), SQLITE_TRANSIENT) == SQLITE_OK;
+    }
+}
+
+// bindParams binds all parameters of a statement in order, the statement must
+// take exactly as many parameters as given
+template <typename... Params>
+bool bindParams(sqlite3_stmt* stmt, const Params&... params) {
+    if (sqlite3_bind_parameter_count(stmt) != int(sizeof...(Params))) {
+        return false;
+    }
+    int index = 1;
+    bool bound = true;
+    ((bound = bound && bindParam(stmt, index++, params)), ...);
+    return bound;
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include <sqlite3.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// QueryTimer steps a statement and measures time spent in sqlite3_step and
+// rows returned, time of printing rows is not counted
+class QueryTimer {
+public:
+    explicit QueryTimer(sqlite3_stmt* stmt) : stmt(stmt), elapsed(0), returned(0) {}
+
+    int step() {
+        auto start = chrono::steady_clock::now();
+        int rc = sqlite3_step(stmt);
+        elapsed += chrono::steady_clock::now() - start;
+        if (rc == SQLITE_ROW) {
+            ++returned;
+        }
+        return rc;
+    }
+
+    sqlite3_stmt* statement() const {
+        return stmt;
+    }
+
+    double seconds() const {
+        return chrono::duration<double>(elapsed).count();
+    }
+
+    long rows() const {
+        return returned;
+    }
+
+private:
+    sqlite3_stmt* stmt;
+    chrono::steady_clock::duration elapsed;
+    long returned;
+};
+
+// QueryMetrics aggregates executions of queries by name: a latency histogram,
+// rows and sqlite3_stmt_status counters, and logs executions slower than the
+// threshold with their SQL and plan. Recording takes a short lock and reads
+// four counters, so it stays on all the time; it is shared by server workers
+class QueryMetrics {
+public:
+    // slowSeconds is the slow query threshold, 0 disables the log
+    explicit QueryMetrics(double slowSeconds = 0, ostream& slowLog = cerr)
+        : slowSeconds(slowSeconds), slowLog(slowLog) {}
+
+    // record adds an execution of `stmt` that is stepped to its end, the
+    // counters of the statement are reset for the next one. Without a statement,
+    // e.g. for a write of several statements, only time and rows are recorded
+    void record(string_view name, sqlite3_stmt* stmt, double seconds, long rows) {
+        int64_t counters[4] = {0, 0, 0, 0};
+        if (stmt) {
+            for (int i = 0; i < 4; ++i) {
+                counters[i] = sqlite3_stmt_status(stmt, statusCounters[i], 1);
+            }
+        }
+        const bool slow = slowSeconds > 0 && seconds >= slowSeconds;
+        {
+            lock_guard<mutex> lock(guard);
+            Aggregate& query = aggregate(name);
+            int bucket = 0;
+            while (bucket < bucketCount && seconds > bucketBounds[bucket]) {
+                ++bucket;
+            }
+            ++query.buckets[bucket];
+            ++query.executions;
+            query.seconds += seconds;
+            query.rows += rows;
+            for (int i = 0; i < 4; ++i) {
+                query.counters[i] += counters[i];
+            }
+            query.slow += slow;
+        }
+        if (slow) {
+            logSlow(name, stmt, seconds, rows, counters);
+        }
+    }
+
+    // record adds an execution measured by QueryTimer
+    void record(string_view name, const QueryTimer& timer) {
+        record(name, timer.statement(), timer.seconds(), timer.rows());
+    }
+
+    // recordTimeout counts an execution stopped by its deadline, its time is
+    // recorded by record as any other
+    void recordTimeout(string_view name) {
+        lock_guard<mutex> lock(guard);
+        ++aggregate(name).timeouts;
+    }
+
+    // recordShed counts a request refused because too many heavy queries ran
+    void recordShed(string_view name) {
+        lock_guard<mutex> lock(guard);
+        ++aggregate(name).shed;
+    }
+
+    // writePrometheus writes aggregates in Prometheus text exposition format
+    void writePrometheus(string& out) {
+        lock_guard<mutex> lock(guard);
+        char number[32];
+        out += "# HELP transport_query_duration_seconds Time queries spent in sqlite3_step.\n";
+        out += "# TYPE transport_query_duration_seconds histogram\n";
+        for (const auto& entry : queries) {
+            uint64_t cumulative = 0;
+            for (int i = 0; i <= bucketCount; ++i) {
+                cumulative += entry.second.buckets[i];
+                if (i < bucketCount) {
+                    snprintf(number, sizeof(number), "%g", bucketBounds[i]);
+                }
+                out += "transport_query_duration_seconds_bucket{query=\"" + entry.first + "\",le=\"" +
+                    (i < bucketCount ? number : "+Inf") + "\"} " + to_string(cumulative) + "\n";
+            }
+            snprintf(number, sizeof(number), "%.9f", entry.second.seconds);
+            out += "transport_query_duration_seconds_sum{query=\"" + entry.first + "\"} " + number + "\n";
+            out += "transport_query_duration_seconds_count{query=\"" + entry.first + "\"} " +
+                to_string(entry.second.executions) + "\n";
+        }
+        writeCounter(out, "transport_query_rows_total", "Rows returned or changed by queries.",
+                     [](const Aggregate& aggregate) { return aggregate.rows; });
+        const char* counterNames[4] = {"transport_query_fullscan_steps_total", "transport_query_sorts_total",
+                                       "transport_query_autoindexes_total", "transport_query_vm_steps_total"};
+        const char* counterHelp[4] = {"Forward steps of full table scans.", "Sort operations.",
+                                      "Rows inserted into automatic indexes.", "Virtual machine operations."};
+        for (int i = 0; i < 4; ++i) {
+            writeCounter(out, counterNames[i], counterHelp[i],
+                         [i](const Aggregate& aggregate) { return aggregate.counters[i]; });
+        }
+        writeCounter(out, "transport_query_slow_total", "Executions slower than the slow query threshold.",
+                     [](const Aggregate& aggregate) { return aggregate.slow; });
+        writeCounter(out, "transport_query_timeouts_total", "Executions stopped by their deadline.",
+                     [](const Aggregate& aggregate) { return aggregate.timeouts; });
+        writeCounter(out, "transport_query_shed_total", "Requests refused while too many heavy queries ran.",
+                     [](const Aggregate& aggregate) { return aggregate.shed; });
+    }
+
+private:
+    static constexpr int bucketCount = 10;
+    static constexpr double bucketBounds[bucketCount] = {0.0001, 0.0005, 0.001, 0.005, 0.01,
+                                                         0.05, 0.1, 0.5, 1, 5};
+    static constexpr int statusCounters[4] = {SQLITE_STMTSTATUS_FULLSCAN_STEP, SQLITE_STMTSTATUS_SORT,
+                                              SQLITE_STMTSTATUS_AUTOINDEX, SQLITE_STMTSTATUS_VM_STEP};
+
+    struct Aggregate {
+        uint64_t buckets[bucketCount + 1] = {};
+        uint64_t executions = 0;
+        double seconds = 0;
+        int64_t rows = 0;
+        int64_t counters[4] = {0, 0, 0, 0};
+        uint64_t slow = 0;
+        uint64_t timeouts = 0;
+        uint64_t shed = 0;
+    };
+
+    // aggregate returns the aggregate of query `name`, adding it, under `guard`
+    Aggregate& aggregate(string_view name) {
+        auto it = queries.find(name);
+        if (it == queries.end()) {
+            it = queries.emplace(string(name), Aggregate()).first;
+        }
+        return it->second;
+    }
+
+    template <typename Value>
+    void writeCounter(string& out, const char* name, const char* help, Value value) {
+        out += string("# HELP ") + name + " " + help + "\n";
+        out += string("# TYPE ") + name + " counter\n";
+        for (const auto& entry : queries) {
+            out += string(name) + "{query=\"" + entry.first + "\"} " + to_string(value(entry.second)) + "\n";
+        }
+    }
+
+    // logSlow writes the statement with bound values and its plan, the plan is
+    // explained on the connection of the statement
+    void logSlow(string_view name, sqlite3_stmt* stmt, double seconds, long rows, const int64_t* counters) {
+        char milliseconds[32];
+        snprintf(milliseconds, sizeof(milliseconds), "%.3f", seconds * 1000);
+        string entry = "slow query " + string(name) + ": " + milliseconds + " ms, " +
+            to_string(rows) + " rows, fullscan steps " + to_string(counters[0]) + ", sorts " +
+            to_string(counters[1]) + ", autoindexes " + to_string(counters[2]) + ", vm steps " +
+            to_string(counters[3]) + "\n";
+        char* sql = stmt ? sqlite3_expanded_sql(stmt) : nullptr;
+        if (sql) {
+            entry += sql;
+            entry += "\n";
+            sqlite3_stmt* plan = nullptr;
+            if (sqlite3_prepare_v2(sqlite3_db_handle(stmt), ("EXPLAIN QUERY PLAN " + string(sql)).c_str(), -1,
+                                   &plan, nullptr) == SQLITE_OK) {
+                // Rows are id, parent, notused, detail; children follow their parent
+                map<int, int> depth;
+                while (sqlite3_step(plan) == SQLITE_ROW) {
+                    int level = depth.count(sqlite3_column_int(plan, 1)) ? depth[sqlite3_column_int(plan, 1)] + 1 : 0;
+                    depth[sqlite3_column_int(plan, 0)] = level;
+                    entry += string(2 * level + 2, ' ') + reinterpret_cast<const char*>(sqlite3_column_text(plan, 3)) + "\n";
+                }
+            }
+            sqlite3_finalize(plan);
+            sqlite3_free(sql);
+        }
+        lock_guard<mutex> lock(logGuard);
+        slowLog << entry << flush;
+    }
+
+    const double slowSeconds;
+    ostream& slowLog;
+    mutex guard;
+    mutex logGuard;
+    map<string, Aggregate, less<>> queries; // sorted, so dumps are stable
+};
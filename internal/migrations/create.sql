@@ -21,11 +21,13 @@ CREATE TABLE routes (
   source_id INTEGER NOT NULL,
   destination_id INTEGER NOT NULL,
   distance INTEGER NOT NULL,
-  departure_time DATETIME NOT NULL,
-  arrival_time DATETIME NOT NULL,
+  departure_time INTEGER NOT NULL, -- epoch seconds
+  arrival_time INTEGER NOT NULL, -- epoch seconds
   seats_available INTEGER NOT NULL,
-  ticket_price REAL NOT NULL,
+  ticket_price INTEGER NOT NULL, -- cents
   FOREIGN KEY (transport_type_id) REFERENCES transport_types (id),
   FOREIGN KEY (source_id) REFERENCES destinations (id),
   FOREIGN KEY (destination_id) REFERENCES destinations (id)
-);
\ No newline at end of file
+);
+
+PRAGMA user_version = 1;
\ No newline at end of file
@@ -0,0 +1,140 @@
+-- Route aggregates per source, destination, departure day and transport type:
+-- number of routes, routes with available seats, available seats and the
+-- cheapest fare of routes with available seats (NULL when all are sold out).
+-- Triggers keep them up to date on every write to routes, a route changes only
+-- its own aggregate, and the cheapest fare is searched again only when the
+-- cheapest route is sold out or removed, within one day of one city pair.
+-- Days are UTC days of departure_time, `main migrate` applies this to schema 1
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS route_aggregates (
+  source_id INTEGER NOT NULL,
+  destination_id INTEGER NOT NULL,
+  day INTEGER NOT NULL, -- departure_time / 86400
+  transport_type_id INTEGER NOT NULL,
+  routes INTEGER NOT NULL,
+  available_routes INTEGER NOT NULL,
+  seats_available INTEGER NOT NULL,
+  min_price INTEGER, -- cents
+  PRIMARY KEY (source_id, destination_id, day, transport_type_id)
+) WITHOUT ROWID;
+
+DELETE FROM route_aggregates;
+
+INSERT INTO
+  route_aggregates
+SELECT
+  source_id,
+  destination_id,
+  departure_time / 86400,
+  transport_type_id,
+  count(*),
+  sum(seats_available > 0),
+  sum(max(seats_available, 0)),
+  min(CASE WHEN seats_available > 0 THEN ticket_price END)
+FROM
+  routes
+GROUP BY
+  1, 2, 3, 4;
+
+CREATE TRIGGER IF NOT EXISTS route_aggregates_insert AFTER INSERT ON routes
+BEGIN
+  INSERT INTO route_aggregates
+  VALUES (new.source_id, new.destination_id, new.departure_time / 86400, new.transport_type_id, 1,
+    new.seats_available > 0, max(new.seats_available, 0),
+    CASE WHEN new.seats_available > 0 THEN new.ticket_price END)
+  ON CONFLICT (source_id, destination_id, day, transport_type_id) DO UPDATE SET
+    routes = routes + 1,
+    available_routes = available_routes + excluded.available_routes,
+    seats_available = seats_available + excluded.seats_available,
+    min_price = coalesce(min(min_price, excluded.min_price), min_price, excluded.min_price);
+END;
+
+CREATE TRIGGER IF NOT EXISTS route_aggregates_delete AFTER DELETE ON routes
+BEGIN
+  UPDATE route_aggregates SET
+    routes = routes - 1,
+    available_routes = available_routes - (old.seats_available > 0),
+    seats_available = seats_available - max(old.seats_available, 0)
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id;
+  UPDATE route_aggregates SET
+    min_price = (
+      SELECT min(ticket_price) FROM routes
+      WHERE source_id = old.source_id AND destination_id = old.destination_id
+        AND departure_time >= old.departure_time / 86400 * 86400
+        AND departure_time < (old.departure_time / 86400 + 1) * 86400
+        AND transport_type_id = old.transport_type_id AND seats_available > 0)
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id
+    AND old.seats_available > 0 AND old.ticket_price <= min_price;
+  DELETE FROM route_aggregates
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id AND routes = 0;
+END;
+
+-- Bookings and cancellations change seats only
+CREATE TRIGGER IF NOT EXISTS route_aggregates_seats AFTER UPDATE OF seats_available ON routes
+WHEN old.source_id = new.source_id AND old.destination_id = new.destination_id
+  AND old.departure_time / 86400 = new.departure_time / 86400
+  AND old.transport_type_id = new.transport_type_id AND old.ticket_price = new.ticket_price
+BEGIN
+  UPDATE route_aggregates SET
+    available_routes = available_routes + (new.seats_available > 0) - (old.seats_available > 0),
+    seats_available = seats_available + max(new.seats_available, 0) - max(old.seats_available, 0),
+    min_price = CASE WHEN new.seats_available > 0 AND old.seats_available <= 0
+      THEN coalesce(min(min_price, new.ticket_price), new.ticket_price) ELSE min_price END
+  WHERE source_id = new.source_id AND destination_id = new.destination_id
+    AND day = new.departure_time / 86400 AND transport_type_id = new.transport_type_id;
+  UPDATE route_aggregates SET
+    min_price = (
+      SELECT min(ticket_price) FROM routes
+      WHERE source_id = new.source_id AND destination_id = new.destination_id
+        AND departure_time >= new.departure_time / 86400 * 86400
+        AND departure_time < (new.departure_time / 86400 + 1) * 86400
+        AND transport_type_id = new.transport_type_id AND seats_available > 0)
+  WHERE source_id = new.source_id AND destination_id = new.destination_id
+    AND day = new.departure_time / 86400 AND transport_type_id = new.transport_type_id
+    AND old.seats_available > 0 AND new.seats_available <= 0 AND old.ticket_price <= min_price;
+END;
+
+-- Any other change of a key or the price moves the route from one aggregate to another
+CREATE TRIGGER IF NOT EXISTS route_aggregates_move
+AFTER UPDATE OF source_id, destination_id, departure_time, transport_type_id, ticket_price ON routes
+WHEN old.source_id != new.source_id OR old.destination_id != new.destination_id
+  OR old.departure_time / 86400 != new.departure_time / 86400
+  OR old.transport_type_id != new.transport_type_id OR old.ticket_price != new.ticket_price
+BEGIN
+  UPDATE route_aggregates SET
+    routes = routes - 1,
+    available_routes = available_routes - (old.seats_available > 0),
+    seats_available = seats_available - max(old.seats_available, 0)
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id;
+  UPDATE route_aggregates SET
+    min_price = (
+      SELECT min(ticket_price) FROM routes
+      WHERE source_id = old.source_id AND destination_id = old.destination_id
+        AND departure_time >= old.departure_time / 86400 * 86400
+        AND departure_time < (old.departure_time / 86400 + 1) * 86400
+        AND transport_type_id = old.transport_type_id AND seats_available > 0)
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id
+    AND old.seats_available > 0 AND old.ticket_price <= min_price;
+  DELETE FROM route_aggregates
+  WHERE source_id = old.source_id AND destination_id = old.destination_id
+    AND day = old.departure_time / 86400 AND transport_type_id = old.transport_type_id AND routes = 0;
+  INSERT INTO route_aggregates
+  VALUES (new.source_id, new.destination_id, new.departure_time / 86400, new.transport_type_id, 1,
+    new.seats_available > 0, max(new.seats_available, 0),
+    CASE WHEN new.seats_available > 0 THEN new.ticket_price END)
+  ON CONFLICT (source_id, destination_id, day, transport_type_id) DO UPDATE SET
+    routes = routes + 1,
+    available_routes = available_routes + excluded.available_routes,
+    seats_available = seats_available + excluded.seats_available,
+    min_price = coalesce(min(min_price, excluded.min_price), min_price, excluded.min_price);
+END;
+
+PRAGMA user_version = 2;
+
+COMMIT;
@@ -0,0 +1,15 @@
+CREATE TABLE IF NOT EXISTS bookings (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  seats INTEGER NOT NULL,
+  status TEXT NOT NULL DEFAULT 'active',
+  created_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE TABLE IF NOT EXISTS booking_legs (
+  booking_id INTEGER NOT NULL,
+  leg INTEGER NOT NULL,
+  route_id INTEGER NOT NULL,
+  PRIMARY KEY (booking_id, leg),
+  FOREIGN KEY (booking_id) REFERENCES bookings (id),
+  FOREIGN KEY (route_id) REFERENCES routes (id)
+);
@@ -0,0 +1,19 @@
+CREATE UNIQUE INDEX IF NOT EXISTS destinations_name ON destinations (name);
+
+CREATE UNIQUE INDEX IF NOT EXISTS transport_types_name ON transport_types (name);
+
+CREATE INDEX IF NOT EXISTS routes_source_destination_departure ON routes (source_id, destination_id, departure_time);
+
+CREATE INDEX IF NOT EXISTS routes_destination_departure ON routes (destination_id, departure_time);
+
+CREATE INDEX IF NOT EXISTS routes_departure ON routes (departure_time);
+
+CREATE INDEX IF NOT EXISTS routes_transport_type ON routes (transport_type_id);
+
+CREATE INDEX IF NOT EXISTS routes_ticket_price ON routes (ticket_price);
+
+CREATE INDEX IF NOT EXISTS routes_available_price ON routes (ticket_price) WHERE seats_available > 0;
+
+CREATE INDEX IF NOT EXISTS routes_destination_transport ON routes (destination_id, transport_type_id);
+
+CREATE INDEX IF NOT EXISTS routes_source_departure ON routes (source_id, departure_time);
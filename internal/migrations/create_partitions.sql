@@ -0,0 +1,18 @@
+-- Catalog of monthly partitions of routes. `main partition --before yyyy-mm`
+-- moves routes departing in earlier months out of routes into a table per
+-- month, routes_yyyy_mm, with the columns of routes; searches by departure date
+-- read only partitions of months ending after the date besides routes.
+-- `main archive-partition` moves a partition into a database file of its own
+-- and `main restore-partition` brings it back. `main migrate` applies this to schema 2
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS route_partitions (
+  name TEXT PRIMARY KEY, -- table of the partition
+  month_start INTEGER NOT NULL, -- epoch seconds, first departure the month may hold
+  month_end INTEGER NOT NULL, -- epoch seconds, start of the next month
+  routes INTEGER NOT NULL
+);
+
+PRAGMA user_version = 3;
+
+COMMIT;
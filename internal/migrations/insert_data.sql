@@ -20,6 +20,7 @@ VALUES
   ('Уфа'),
   ('Челябинск');
 
+-- Times are epoch seconds, prices are cents
 INSERT INTO
   routes (
     flight,
@@ -39,10 +40,10 @@ VALUES
     1,
     2,
     700,
-    '2024-11-20',
-    '2024-11-20',
+    1732060800,
+    1732060800,
     150,
-    5000
+    500000
   ),
   (
     'AA2397',
@@ -50,10 +51,10 @@ VALUES
     1,
     3,
     800,
-    '2024-11-21',
-    '2024-11-21',
+    1732147200,
+    1732147200,
     200,
-    3000
+    300000
   ),
   (
     'LH718',
@@ -61,10 +62,10 @@ VALUES
     2,
     4,
     3200,
-    '2024-11-22',
-    '2024-11-22',
+    1732233600,
+    1732233600,
     0,
-    1500
+    150000
   ),
   (
     'ICE524',
@@ -72,10 +73,10 @@ VALUES
     3,
     5,
     1250,
-    '2024-11-23',
-    '2024-11-23',
+    1732320000,
+    1732320000,
     120,
-    7000
+    700000
   ),
   (
     'TGV8147',
@@ -83,10 +84,10 @@ VALUES
     2,
     6,
     2780,
-    '2024-11-24',
-    '2024-11-24',
+    1732406400,
+    1732406400,
     20,
-    1000
+    100000
   ),
   (
     'BUS34A',
@@ -94,10 +95,10 @@ VALUES
     3,
     7,
     6210,
-    '2024-11-25',
-    '2024-11-25',
+    1732492800,
+    1732492800,
     100,
-    15000
+    1500000
   ),
   (
     'CO-ACH567',
@@ -105,10 +106,10 @@ VALUES
     4,
     8,
     4600,
-    '2024-11-26',
-    '2024-11-26',
+    1732579200,
+    1732579200,
     80,
-    4000
+    400000
   ),
   (
     'FERRY902',
@@ -116,10 +117,10 @@ VALUES
     5,
     9,
     700,
-    '2024-11-27',
-    '2024-11-27',
+    1732665600,
+    1732665600,
     0,
-    2000
+    200000
   ),
   (
     'CRU1158',
@@ -127,10 +128,10 @@ VALUES
     6,
     10,
     1700,
-    '2024-11-28',
-    '2024-11-28',
+    1732752000,
+    1732752000,
     5,
-    300
+    30000
   ),
   (
     'ZAS-123',
@@ -138,8 +139,8 @@ VALUES
     7,
     2,
     9260,
-    '2024-11-29',
-    '2024-11-29',
+    1732838400,
+    1732838400,
     200,
-    250
+    25000
   );
\ No newline at end of file
@@ -0,0 +1,47 @@
+-- Converts routes of schema version 0 in place: departure_time and arrival_time
+-- text become INTEGER epoch seconds and REAL ticket_price becomes INTEGER cents.
+-- Route indexes are dropped with the old table, apply create_indexes.sql and
+-- VACUUM afterwards, `main migrate` does all of it
+BEGIN;
+
+CREATE TABLE routes_compact (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  flight TEXT NOT NULL,
+  transport_type_id INTEGER NOT NULL,
+  source_id INTEGER NOT NULL,
+  destination_id INTEGER NOT NULL,
+  distance INTEGER NOT NULL,
+  departure_time INTEGER NOT NULL, -- epoch seconds
+  arrival_time INTEGER NOT NULL, -- epoch seconds
+  seats_available INTEGER NOT NULL,
+  ticket_price INTEGER NOT NULL, -- cents
+  FOREIGN KEY (transport_type_id) REFERENCES transport_types (id),
+  FOREIGN KEY (source_id) REFERENCES destinations (id),
+  FOREIGN KEY (destination_id) REFERENCES destinations (id)
+);
+
+INSERT INTO
+  routes_compact
+SELECT
+  id,
+  flight,
+  transport_type_id,
+  source_id,
+  destination_id,
+  CAST(distance AS INTEGER),
+  CAST(strftime('%s', departure_time) AS INTEGER),
+  CAST(strftime('%s', arrival_time) AS INTEGER),
+  CAST(seats_available AS INTEGER),
+  CAST(round(ticket_price * 100) AS INTEGER)
+FROM
+  routes
+ORDER BY
+  id;
+
+DROP TABLE routes;
+
+ALTER TABLE routes_compact RENAME TO routes;
+
+PRAGMA user_version = 1;
+
+COMMIT;
@@ -0,0 +1,60 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+using namespace std;
+
+// parseCents parses a non-negative price such as "1500", "12.5" or "12.345" into
+// cents. Digits after cents are dropped, so "price <= 12.345" keeps its meaning
+// as "cents <= 1234"
+inline bool parseCents(const string& value, int64_t& cents) {
+    size_t i = 0;
+    int64_t whole = 0;
+    while (i < value.size() && value[i] >= '0' && value[i] <= '9' && whole < 1000000000000LL) {
+        whole = whole * 10 + (value[i++] - '0');
+    }
+    int64_t fraction = 0;
+    if (i > 0 && i < value.size() && value[i] == '.' && i + 1 < value.size()) {
+        int digits = 0;
+        for (++i; i < value.size() && value[i] >= '0' && value[i] <= '9'; ++i, ++digits) {
+            if (digits < 2) {
+                fraction = fraction * 10 + (value[i] - '0');
+            }
+        }
+        if (digits == 1) {
+            fraction *= 10;
+        }
+    }
+    if (i > 0 && i == value.size()) {
+        cents = whole * 100 + fraction;
+        return true;
+    }
+    // Anything else strtod accepts, e.g. "1e3"
+    char* end = nullptr;
+    double number = strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || !(number >= 0) || number > 1e13) {
+        return false;
+    }
+    cents = int64_t(floor(number * 100 + 1e-6));
+    return true;
+}
+
+// formatCents writes cents as SQLite prints a REAL price: "1500.0", "12.5" or
+// "12.34", into buffer of 32 bytes, returns length
+inline size_t formatCents(int64_t cents, char* buffer) {
+    const char* sign = cents < 0 ? "-" : "";
+    const int64_t value = cents < 0 ? -cents : cents;
+    const long long whole = value / 100;
+    const int fraction = value % 100;
+    int length = fraction % 10 == 0
+        ? snprintf(buffer, 32, "%s%lld.%d", sign, whole, fraction / 10)
+        : snprintf(buffer, 32, "%s%lld.%02d", sign, whole, fraction);
+    return length > 0 ? length : 0;
+}
+
+inline string formatCents(int64_t cents) {
+    char buffer[32];
+    return string(buffer, formatCents(cents, buffer));
+}
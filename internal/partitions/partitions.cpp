@@ -0,0 +1,322 @@
+#pragma once
+#include <sqlite3.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "repository.cpp"
+#include "timeutil.cpp"
+using namespace std;
+
+// Routes of past months are moved out of routes into a table per month, so
+// routes and its indexes hold only recent and upcoming departures however long
+// the history is, and searches of upcoming routes cost the same. A search with
+// a departure date reads partitions of months ending after the date besides
+// routes, see RouteRepository::searchRoutes; searches without one, lists, the
+// columnar index, snapshots and journeys read all partitions, and route
+// aggregates keep the days of partitions. Booked routes stay in routes, so
+// booking legs always reference a route and cancellations return its seats. A
+// partition is archived into a database file of its own by copying its rows
+// once and dropping its table, and restored from the file the same way
+
+// PartitionStats describes a run of partitionRoutes
+struct PartitionStats {
+    int partitions = 0; // months moved
+    long routes = 0;    // routes moved
+    double seconds = 0;
+};
+
+// RoutePartition is a partition listed by listPartitions
+struct RoutePartition {
+    string name;
+    int64_t monthStart = 0;
+    int64_t monthEnd = 0;
+    int64_t routes = 0;
+};
+
+// monthStart returns epoch seconds of the first second of the month of `epoch`
+inline int64_t monthStart(int64_t epoch) {
+    int year, month, day;
+    civilFromDays(epoch >= 0 ? epoch / 86400 : (epoch - 86399) / 86400, year, month, day);
+    return daysFromCivil(year, month, 1) * 86400;
+}
+
+// nextMonthStart returns start of the month after the month starting at `start`
+inline int64_t nextMonthStart(int64_t start) {
+    int year, month, day;
+    civilFromDays(start / 86400, year, month, day);
+    return daysFromCivil(month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1) * 86400;
+}
+
+// parseMonth converts "yyyy-mm" into start of the month
+inline bool parseMonth(const string& value, int64_t& start) {
+    int year, month;
+    char rest;
+    if (sscanf(value.c_str(), "%4d-%2d%c", &year, &month, &rest) != 2 || month < 1 || month > 12) {
+        return false;
+    }
+    start = daysFromCivil(year, month, 1) * 86400;
+    return true;
+}
+
+// partitionName returns table of the month starting at `start`: routes_yyyy_mm
+inline string partitionName(int64_t start) {
+    int year, month, day;
+    civilFromDays(start / 86400, year, month, day);
+    char name[32];
+    snprintf(name, sizeof(name), "routes_%04d_%02d", year, month);
+    return name;
+}
+
+// isPartitionName reports whether `name` is a table partitionName makes, names
+// are written into SQL, so nothing else is accepted
+inline bool isPartitionName(const string& name) {
+    int64_t start;
+    return name.size() == 14 && name.compare(0, 7, "routes_") == 0 && name[11] == '_' &&
+        parseMonth(name.substr(7, 4) + "-" + name.substr(12, 2), start) && partitionName(start) == name;
+}
+
+// readPartition reads the catalog row of partition `name`, `found` is false if there is none
+inline bool readPartition(RouteRepository& repo, const string& name, RoutePartition& partition, bool& found) {
+    sqlite3_stmt* stmt = repo.statement(SelectPartitionQuery);
+    if (!stmt || !bindParams(stmt, name)) {
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    found = rc == SQLITE_ROW;
+    if (found) {
+        PartitionRow row;
+        PartitionColumns::read(stmt, row);
+        partition = RoutePartition{string(row.name), row.monthStart, row.monthEnd, row.routes};
+    }
+    sqlite3_reset(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+// addPartition adds routes to the catalog row of a partition, creating it
+inline bool addPartition(RouteRepository& repo, const string& name, int64_t start, int64_t end, int64_t routes) {
+    sqlite3_stmt* stmt = repo.statement(InsertPartitionQuery);
+    return stmt && bindParams(stmt, name, start, end, routes) && sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// listPartitions returns all partitions of the catalog, oldest first
+inline bool listPartitions(RouteRepository& repo, vector<RoutePartition>& partitions) {
+    partitions.clear();
+    sqlite3_stmt* stmt = repo.statement(SelectPartitionsQuery);
+    if (!stmt || !bindParams(stmt, INT64_MIN)) {
+        return false;
+    }
+    PartitionRow row;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        PartitionColumns::read(stmt, row);
+        partitions.push_back(RoutePartition{string(row.name), row.monthStart, row.monthEnd, row.routes});
+    }
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// partitionRoutes moves routes departing before the month `before` ("yyyy-mm"),
+// the current one at most, into partitions, a month per transaction from the
+// oldest one, so an interrupted run keeps months it finished. A month already
+// partitioned gets routes inserted since then. Routes with booking legs are not
+// moved. Route aggregates of the month are computed again, triggers of routes
+// would drop the moved routes from them. Partitions made before get indexes
+// added since
+inline bool partitionRoutes(RouteRepository& repo, const string& before, PartitionStats& stats, string& error) {
+    auto started = chrono::steady_clock::now();
+    int64_t end;
+    if (!parseMonth(before, end)) {
+        error = "invalid month, expected yyyy-mm";
+        return false;
+    }
+    // Bookings change routes only, so months that have not passed stay there
+    if (end > monthStart(time(nullptr))) {
+        error = "month " + before + " is later than the current one, only past months are partitioned";
+        return false;
+    }
+    vector<RoutePartition> partitions;
+    if (!listPartitions(repo, partitions)) {
+        error = repo.error();
+        return false;
+    }
+    for (const RoutePartition& partition : partitions) {
+        if (!repo.configure(buildPartitionIndexesQuery(partition.name))) {
+            error = repo.error();
+            return false;
+        }
+    }
+    // Booked routes stay behind, the next month is searched after the last one
+    int64_t from = INT64_MIN;
+    while (true) {
+        sqlite3_stmt* stmt = repo.statement(SelectFirstDepartureQuery);
+        if (!stmt || !bindParams(stmt, from) || sqlite3_step(stmt) != SQLITE_ROW) {
+            error = repo.error();
+            return false;
+        }
+        const bool empty = sqlite3_column_type(stmt, 0) == SQLITE_NULL;
+        const int64_t first = sqlite3_column_int64(stmt, 0);
+        sqlite3_reset(stmt);
+        if (empty || first >= end) {
+            break;
+        }
+        const int64_t start = monthStart(first), next = nextMonthStart(start);
+        from = next;
+        const string name = partitionName(start);
+        const string range = " WHERE departure_time >= " + to_string(start) + " AND departure_time < " +
+            to_string(next) + " AND " + UnbookedRouteFilter + ";\n";
+        if (!repo.configure("BEGIN IMMEDIATE;")) {
+            error = repo.error();
+            return false;
+        }
+        if (!repo.configure(buildPartitionTableQuery(name) + "INSERT INTO " + name + " SELECT " +
+                            RouteColumnNames + " FROM routes" + range + buildPartitionIndexesQuery(name) +
+                            "DELETE FROM routes" + range)) {
+            error = repo.error();
+            repo.configure("ROLLBACK;");
+            return false;
+        }
+        const int64_t moved = sqlite3_changes(repo.handle());
+        // Every route of the month is booked
+        if (moved == 0) {
+            repo.configure("ROLLBACK;");
+            continue;
+        }
+        if (!repo.configure(buildMonthAggregatesQuery(name, start, next)) ||
+            !addPartition(repo, name, start, next, moved) || !repo.configure("COMMIT;")) {
+            error = repo.error();
+            repo.configure("ROLLBACK;");
+            return false;
+        }
+        ++stats.partitions;
+        stats.routes += moved;
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return true;
+}
+
+// attachArchive attaches database file `path` as schema `archive`
+inline bool attachArchive(RouteRepository& repo, const string& path) {
+    sqlite3_stmt* stmt = repo.statement("ATTACH DATABASE ? AS archive;");
+    return stmt && bindParams(stmt, path) && sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// archiveHas reports whether the attached archive has table `name`
+inline bool archiveHas(RouteRepository& repo, const string& name) {
+    sqlite3_stmt* stmt = repo.statement("SELECT 1 FROM archive.sqlite_master WHERE type = 'table' AND name = ?;");
+    bool exists = stmt && bindParams(stmt, name) && sqlite3_step(stmt) == SQLITE_ROW;
+    if (stmt) {
+        sqlite3_reset(stmt);
+    }
+    return exists;
+}
+
+// archivePartition moves partition `name` into database file `path`: its rows
+// are copied into a table of the same name with its catalog row and the table is
+// dropped, reads and route aggregates stop seeing it. A file may keep several
+// partitions, one that is there already is not overwritten. Pages of the dropped
+// table are reused by new rows, VACUUM gives them back to the file system. A
+// partition of a month that has not ended is kept, its routes may be booked
+inline bool archivePartition(RouteRepository& repo, const string& name, const string& path, string& error) {
+    RoutePartition partition;
+    bool found;
+    if (!isPartitionName(name) || !readPartition(repo, name, partition, found) || !found) {
+        error = "no such partition: " + name;
+        return false;
+    }
+    if (partition.monthEnd > time(nullptr)) {
+        error = "partition " + name + " holds upcoming departures";
+        return false;
+    }
+    if (!attachArchive(repo, path)) {
+        error = repo.error();
+        return false;
+    }
+    if (archiveHas(repo, name)) {
+        error = "partition " + name + " is archived in " + path + " already";
+        repo.configure("DETACH DATABASE archive;");
+        return false;
+    }
+    bool done = repo.configure("BEGIN IMMEDIATE;") &&
+        repo.configure(
+            "CREATE TABLE IF NOT EXISTS archive.route_partitions (name TEXT PRIMARY KEY, month_start INTEGER NOT "
+            "NULL, month_end INTEGER NOT NULL, routes INTEGER NOT NULL);\n" +
+            buildPartitionTableQuery("archive." + name) + "INSERT INTO archive." + name + " SELECT " +
+            RouteColumnNames + " FROM main." + name + ";\n" +
+            "INSERT INTO archive.route_partitions SELECT * FROM main.route_partitions WHERE name = '" + name +
+            "';\nDROP TABLE main." + name + ";\nDELETE FROM main.route_partitions WHERE name = '" + name + "';\n" +
+            buildMonthAggregatesQuery("", partition.monthStart, partition.monthEnd)) &&
+        repo.configure("COMMIT;");
+    if (!done) {
+        error = repo.error();
+        repo.configure("ROLLBACK;");
+    }
+    repo.configure("DETACH DATABASE archive;");
+    return done;
+}
+
+// restorePartition copies every partition of archive file `path` back into the
+// database, the file is kept. Fails if one of them is partitioned again since
+inline bool restorePartition(RouteRepository& repo, const string& path, vector<RoutePartition>& restored,
+                             string& error) {
+    restored.clear();
+    // Attaching a missing file would create it
+    if (!ifstream(path)) {
+        error = "cannot open " + path;
+        return false;
+    }
+    if (!attachArchive(repo, path)) {
+        error = repo.error();
+        return false;
+    }
+    vector<RoutePartition> partitions;
+    sqlite3_stmt* stmt = archiveHas(repo, "route_partitions")
+        ? repo.statement("SELECT name, month_start, month_end, routes FROM archive.route_partitions "
+                         "ORDER BY month_start;")
+        : nullptr;
+    PartitionRow row;
+    while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+        PartitionColumns::read(stmt, row);
+        partitions.push_back(RoutePartition{string(row.name), row.monthStart, row.monthEnd, row.routes});
+    }
+    if (stmt) {
+        sqlite3_reset(stmt);
+    } else {
+        error = "not a partition archive: " + path;
+    }
+    bool done = stmt && repo.configure("BEGIN IMMEDIATE;");
+    for (const RoutePartition& partition : partitions) {
+        RoutePartition existing;
+        bool found = false;
+        if (!done) {
+            break;
+        }
+        if (!isPartitionName(partition.name) || !archiveHas(repo, partition.name) ||
+            !readPartition(repo, partition.name, existing, found) || found) {
+            error = "cannot restore partition " + partition.name + ", it exists or the archive is damaged";
+            done = false;
+            break;
+        }
+        done = repo.configure(buildPartitionTableQuery("main." + partition.name) + "INSERT INTO main." +
+                              partition.name + " SELECT " + RouteColumnNames + " FROM archive." + partition.name +
+                              ";\n" + buildPartitionIndexesQuery(partition.name) +
+                              buildMonthAggregatesQuery(partition.name, partition.monthStart, partition.monthEnd)) &&
+            addPartition(repo, partition.name, partition.monthStart, partition.monthEnd, partition.routes);
+        restored.push_back(partition);
+    }
+    if (done) {
+        done = repo.configure("COMMIT;");
+    }
+    if (!done) {
+        if (error.empty()) {
+            error = repo.error();
+        }
+        restored.clear();
+        repo.configure("ROLLBACK;");
+    }
+    repo.configure("DETACH DATABASE archive;");
+    return done;
+}
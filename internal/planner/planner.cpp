@@ -0,0 +1,286 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "repository.cpp"
+using namespace std;
+
+// JourneyObjective is what journey planner optimizes
+enum class JourneyObjective {
+    EarliestArrival,
+    Cheapest,
+    Pareto, // every journey not worse than another by both arrival and price
+};
+
+// Connection is a single route of the timetable
+struct Connection {
+    int64_t routeId;
+    int32_t source;
+    int32_t destination;
+    int64_t departure; // epoch seconds
+    int64_t arrival;   // epoch seconds
+    int64_t price;     // cents
+};
+
+// JourneyRequest holds parameters of journey planning
+struct JourneyRequest {
+    int32_t source = 0;
+    int32_t destination = 0;
+    int64_t departAfter = 0;          // epoch seconds
+    int64_t minTransfer = 0;          // seconds between arrival and next departure
+    int maxLegs = 3;
+    int64_t horizon = 7 * 86400;      // latest departure of any leg after the first departure from source
+    JourneyObjective objective = JourneyObjective::EarliestArrival;
+};
+
+// Journey is a sequence of routes from source to destination
+struct Journey {
+    vector<int64_t> routeIds;
+    int64_t departure;
+    int64_t arrival;
+    int64_t price;
+};
+
+// JourneyPlanner answers multi-leg journey queries by Connection Scan over the
+// timetable kept in memory sorted by departure time. Every stop keeps a bag of
+// labels (arrival, price, legs) not dominated by each other, connections are
+// scanned once in departure order, so a query never touches SQLite
+class JourneyPlanner {
+public:
+    JourneyPlanner() : stops(0), loaded(false) {}
+
+    bool isLoaded() const {
+        return loaded;
+    }
+
+    size_t size() const {
+        return connections.size();
+    }
+
+    // load reads timetable of routes with avaliable seats
+    bool load(RouteRepository& repo) {
+        connections.clear();
+        stops = 0;
+        sqlite3_stmt* stmt = repo.routesStatement(SelectConnectionsQuery);
+        if (!stmt) {
+            return false;
+        }
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            Connection connection = readConnection(stmt);
+            connections.push_back(connection);
+            addStops(connection);
+        }
+        loaded = rc == SQLITE_DONE;
+        return loaded;
+    }
+
+    // add puts a just inserted route into the timetable keeping it sorted
+    bool add(RouteRepository& repo, sqlite3_int64 id) {
+        if (!loaded) {
+            return true;
+        }
+        sqlite3_stmt* stmt = repo.statement(SelectConnectionByIdQuery);
+        if (!stmt || sqlite3_bind_int64(stmt, 1, id) != SQLITE_OK) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            Connection connection = readConnection(stmt);
+            addStops(connection);
+            connections.insert(
+                upper_bound(connections.begin(), connections.end(), connection, earlier),
+                connection);
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW || rc == SQLITE_DONE;
+    }
+
+    // update reloads a route whose seats have changed, sold out routes leave the timetable
+    bool update(RouteRepository& repo, sqlite3_int64 id) {
+        if (!loaded) {
+            return true;
+        }
+        connections.erase(remove_if(connections.begin(), connections.end(), [id](const Connection& c) {
+            return c.routeId == id;
+        }), connections.end());
+        return add(repo, id);
+    }
+
+    // plan returns journeys for the request, the best one goes first
+    vector<Journey> plan(const JourneyRequest& request) const {
+        vector<Label> labels;
+        vector<vector<int32_t>> bags(stops);
+        if (request.source < 0 || size_t(request.source) >= stops ||
+            request.destination < 0 || size_t(request.destination) >= stops) {
+            return vector<Journey>();
+        }
+        labels.push_back(Label{request.departAfter, 0, 0, -1, 0});
+        bags[request.source].push_back(0);
+        const vector<int32_t>& target = bags[request.destination];
+        const bool byPrice = request.objective != JourneyObjective::EarliestArrival;
+        Connection first = {0, 0, 0, request.departAfter, 0, 0};
+        auto begin = lower_bound(connections.begin(), connections.end(), first, earlier);
+        // Search window starts at the first departure from source
+        auto firstDeparture = find_if(begin, connections.end(), [&request](const Connection& c) {
+            return c.source == request.source;
+        });
+        if (firstDeparture == connections.end()) {
+            return vector<Journey>();
+        }
+        begin = firstDeparture;
+        const int64_t lastDeparture = firstDeparture->departure + request.horizon;
+        for (auto it = begin; it != connections.end() && it->departure <= lastDeparture; ++it) {
+            const Connection& c = *it;
+            // No connection departing after the earliest arrival can arrive earlier
+            if (!byPrice && !target.empty() && c.departure >= labels[target.front()].arrival) {
+                break;
+            }
+            vector<int32_t>& from = bags[c.source];
+            if (from.empty() || c.source == c.destination || c.arrival < c.departure) {
+                continue;
+            }
+            for (size_t i = 0; i < from.size(); ++i) {
+                const Label previous = labels[from[i]];
+                const int64_t ready = previous.legs == 0 ? previous.arrival : previous.arrival + request.minTransfer;
+                if (previous.legs >= request.maxLegs || c.departure < ready) {
+                    continue;
+                }
+                Label next{c.arrival, previous.price + c.price, previous.legs + 1,
+                           from[i], uint32_t(it - connections.begin())};
+                // Target pruning: nothing reachable from `next` beats the known journeys
+                if (dominatedBy(target, labels, next, byPrice)) {
+                    continue;
+                }
+                insertLabel(bags[c.destination], labels, next, byPrice);
+            }
+        }
+        return journeys(target, labels, request.objective);
+    }
+
+private:
+    // Label is a way to reach a stop
+    struct Label {
+        int64_t arrival;
+        int64_t price;
+        int legs;
+        int32_t parent;       // label of the previous stop, -1 for the source
+        uint32_t connection;  // connection used to reach the stop
+    };
+
+    void addStops(const Connection& connection) {
+        size_t last = max(connection.source, connection.destination);
+        if (connection.source >= 0 && connection.destination >= 0 && last >= stops) {
+            stops = last + 1;
+        }
+    }
+
+    static bool earlier(const Connection& a, const Connection& b) {
+        return a.departure < b.departure;
+    }
+
+    static Connection readConnection(sqlite3_stmt* stmt) {
+        ConnectionRow row;
+        ConnectionColumns::read(stmt, row);
+        Connection connection;
+        connection.routeId = row.routeId;
+        connection.source = row.sourceId;
+        connection.destination = row.destinationId;
+        connection.departure = row.departure;
+        connection.arrival = row.arrival;
+        connection.price = row.priceCents;
+        return connection;
+    }
+
+    // dominates reports whether `a` is not worse than `b` by every criterion
+    static bool dominates(const Label& a, const Label& b, bool byPrice) {
+        return a.arrival <= b.arrival && a.legs <= b.legs && (!byPrice || a.price <= b.price);
+    }
+
+    static bool dominatedBy(const vector<int32_t>& bag, const vector<Label>& labels,
+                            const Label& label, bool byPrice) {
+        for (int32_t index : bag) {
+            if (dominates(labels[index], label, byPrice)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // insertLabel adds label to the bag unless it is dominated, labels dominated
+    // by the new one are dropped from the bag. The earliest label goes first
+    static void insertLabel(vector<int32_t>& bag, vector<Label>& labels, const Label& label, bool byPrice) {
+        if (dominatedBy(bag, labels, label, byPrice)) {
+            return;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < bag.size(); ++i) {
+            if (!dominates(label, labels[bag[i]], byPrice)) {
+                bag[kept++] = bag[i];
+            }
+        }
+        bag.resize(kept);
+        labels.push_back(label);
+        int32_t index = labels.size() - 1;
+        auto position = find_if(bag.begin(), bag.end(), [&](int32_t other) {
+            return labels[other].arrival > label.arrival;
+        });
+        bag.insert(position, index);
+    }
+
+    // journeys restores journeys of the target bag in order of the objective
+    vector<Journey> journeys(const vector<int32_t>& bag, const vector<Label>& labels,
+                             JourneyObjective objective) const {
+        vector<Journey> result;
+        for (int32_t index : bag) {
+            Journey journey;
+            journey.arrival = labels[index].arrival;
+            journey.price = labels[index].price;
+            for (int32_t i = index; labels[i].parent >= 0; i = labels[i].parent) {
+                const Connection& c = connections[labels[i].connection];
+                journey.routeIds.push_back(c.routeId);
+                journey.departure = c.departure;
+            }
+            if (journey.routeIds.empty()) {
+                continue; // source is destination
+            }
+            reverse(journey.routeIds.begin(), journey.routeIds.end());
+            result.push_back(journey);
+        }
+        // Keep journeys not dominated by arrival and price only
+        vector<Journey> pareto;
+        for (const Journey& journey : result) {
+            bool dominated = false;
+            for (const Journey& other : result) {
+                if (other.arrival <= journey.arrival && other.price <= journey.price &&
+                    (other.arrival < journey.arrival || other.price < journey.price ||
+                     other.routeIds.size() < journey.routeIds.size())) {
+                    dominated = true;
+                    break;
+                }
+            }
+            if (!dominated) {
+                pareto.push_back(journey);
+            }
+        }
+        if (objective == JourneyObjective::Cheapest) {
+            sort(pareto.begin(), pareto.end(), [](const Journey& a, const Journey& b) {
+                return a.price != b.price ? a.price < b.price : a.arrival < b.arrival;
+            });
+        } else {
+            sort(pareto.begin(), pareto.end(), [](const Journey& a, const Journey& b) {
+                return a.arrival != b.arrival ? a.arrival < b.arrival : a.price < b.price;
+            });
+        }
+        if (objective != JourneyObjective::Pareto && pareto.size() > 1) {
+            pareto.resize(1);
+        }
+        return pareto;
+    }
+
+    vector<Connection> connections;
+    size_t stops; // stop ids are below
+    bool loaded;
+};
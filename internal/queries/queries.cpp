@@ -1,6 +1,115 @@
+#pragma once
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mapper.cpp"
+#include "money.cpp"
+#include "timeutil.cpp"
 using namespace std;
 
+// Routes keep departure_time and arrival_time as INTEGER epoch seconds and
+// ticket_price as INTEGER cents (schema version 1), so they are compared and
+// sorted as numbers. They are turned into text only when printed, see
+// render.cpp. Schema version 2 adds route_aggregates kept by triggers and
+// version 3 the catalog of monthly partitions of routes, route_partitions
+const int RouteSchemaVersion = 3;
+
+// Route is a row of every query selecting routes, see RouteColumns. Names point
+// into the statement and are valid until it is stepped or reset
+struct Route {
+    int64_t id = 0;
+    string_view flight;
+    string_view source;
+    string_view destination;
+    int64_t distance = 0;
+    int64_t departure = 0;  // epoch seconds
+    int64_t arrival = 0;    // epoch seconds
+    int64_t priceCents = 0;
+    int64_t seats = 0;
+    string_view transport;
+};
+
+using RouteColumns = RowMapper<Route,
+    Column<&Route::id>, Column<&Route::flight>, Column<&Route::source>, Column<&Route::destination>,
+    Column<&Route::distance>, Column<&Route::departure>, Column<&Route::arrival>, Column<&Route::priceCents>,
+    Column<&Route::seats>, Column<&Route::transport>>;
+
+// KeyedRoute is a route with ids of its names as SelectRouteColumnsQuery loads it
+struct KeyedRoute : Route {
+    int64_t sourceId = 0;
+    int64_t destinationId = 0;
+    int64_t transportId = 0;
+};
+
+using KeyedRouteColumns = RowMapper<KeyedRoute,
+    Column<&KeyedRoute::id>, Column<&KeyedRoute::flight>, Column<&KeyedRoute::source>,
+    Column<&KeyedRoute::destination>, Column<&KeyedRoute::distance>, Column<&KeyedRoute::departure>,
+    Column<&KeyedRoute::arrival>, Column<&KeyedRoute::priceCents>, Column<&KeyedRoute::seats>,
+    Column<&KeyedRoute::transport>, Column<&KeyedRoute::sourceId>, Column<&KeyedRoute::destinationId>,
+    Column<&KeyedRoute::transportId>>;
+
+// ConnectionRow is a row of SelectConnectionsQuery
+struct ConnectionRow {
+    int64_t routeId = 0;
+    int64_t sourceId = 0;
+    int64_t destinationId = 0;
+    int64_t departure = 0;
+    int64_t arrival = 0;
+    int64_t priceCents = 0;
+};
+
+using ConnectionColumns = RowMapper<ConnectionRow,
+    Column<&ConnectionRow::routeId>, Column<&ConnectionRow::sourceId>, Column<&ConnectionRow::destinationId>,
+    Column<&ConnectionRow::departure>, Column<&ConnectionRow::arrival>, Column<&ConnectionRow::priceCents>>;
+
+// CityRow is a row of SelectDestinationsAfterQuery
+struct CityRow {
+    int64_t id = 0;
+    string_view name;
+};
+
+using CityColumns = RowMapper<CityRow, Column<&CityRow::id>, Column<&CityRow::name>>;
+
+// RouteAggregateRow is a row of SelectRouteAggregatesQuery, minPrice is NULL
+// read as 0 when no route has available seats
+struct RouteAggregateRow {
+    int64_t transportId = 0;
+    int64_t routes = 0;
+    int64_t availableRoutes = 0;
+    int64_t seats = 0;
+    int64_t minPrice = 0;
+};
+
+using RouteAggregateColumns = RowMapper<RouteAggregateRow,
+    Column<&RouteAggregateRow::transportId>, Column<&RouteAggregateRow::routes>,
+    Column<&RouteAggregateRow::availableRoutes>, Column<&RouteAggregateRow::seats>,
+    Column<&RouteAggregateRow::minPrice>>;
+
+// FareDayRow is a row of SelectFareCalendarQuery, minPrice is NULL read as 0
+// when no route has available seats
+struct FareDayRow {
+    int64_t day = 0;
+    int64_t availableRoutes = 0;
+    int64_t minPrice = 0;
+};
+
+using FareDayColumns = RowMapper<FareDayRow,
+    Column<&FareDayRow::day>, Column<&FareDayRow::availableRoutes>, Column<&FareDayRow::minPrice>>;
+
+// PartitionRow is a row of route_partitions
+struct PartitionRow {
+    string_view name;
+    int64_t monthStart = 0;
+    int64_t monthEnd = 0;
+    int64_t routes = 0;
+};
+
+using PartitionColumns = RowMapper<PartitionRow,
+    Column<&PartitionRow::name>, Column<&PartitionRow::monthStart>, Column<&PartitionRow::monthEnd>,
+    Column<&PartitionRow::routes>>;
+
 string SelectAllRoutesQuery = R"(
         SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time, 
                r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
@@ -8,7 +117,7 @@ string SelectAllRoutesQuery = R"(
         JOIN destinations d1 ON r.source_id = d1.id
         JOIN destinations d2 ON r.destination_id = d2.id
         JOIN transport_types t ON r.transport_type_id = t.id
-        ORDER BY r.ticket_price ASC;
+        ORDER BY r.ticket_price ASC, r.id ASC;
 )";
 
 string SelectAllAvaliableRoutesQuery = R"(
@@ -19,61 +128,301 @@ string SelectAllAvaliableRoutesQuery = R"(
         JOIN destinations d2 ON r.destination_id = d2.id
         JOIN transport_types t ON r.transport_type_id = t.id
         WHERE r.seats_available > 0
-        ORDER BY r.ticket_price ASC;
+        ORDER BY r.ticket_price ASC, r.id ASC;
 )";
 
+// SelectRoutesQuery is a base of "Find route by parameters", predicates
+// and ordering are appended by buildSelectRoutesQuery
 string SelectRoutesQuery = R"(
     SELECT r.id,  r.flight, d1.name AS source, d2.name AS destination, r.distance,
-    strftime('%d.%m.%Y %H:%M:%S', r.departure_time) AS departure_time, 
-        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
     FROM routes r
     JOIN destinations d1 ON r.source_id = d1.id
     JOIN destinations d2 ON r.destination_id = d2.id
     JOIN transport_types t ON r.transport_type_id = t.id
-    WHERE (r.departure_time >= ? OR ? = '') 
-    AND (d1.name = ? OR ? = '') 
-    AND (d2.name = ? OR ? = '')
-    AND (t.name = ? OR ? = '')
-    AND (r.ticket_price <= ? OR ? = '')
-    ORDER BY r.departure_time ASC;
 )";
 
+// QueryBind is a parameter of a built query, numbers are bound as integers
+struct QueryBind {
+    QueryBind(const string& text) : integer(false), number(0), text(text) {}
+    QueryBind(int64_t number) : integer(true), number(number) {}
+
+    bool integer;
+    int64_t number;
+    string text;
+};
+
+// dateBind and priceBind bind a date as epoch seconds and a price as cents, a malformed
+// value is bound as text which is greater than any number
+inline QueryBind dateBind(const string& date) {
+    int64_t epoch;
+    return parseSQLiteTime(date, epoch) ? QueryBind(epoch) : QueryBind(date);
+}
+
+inline QueryBind priceBind(const string& price) {
+    int64_t cents;
+    return parseCents(price, cents) ? QueryBind(cents) : QueryBind(price);
+}
+
+// RouteSearch holds filters of "Find route by parameters", empty field means any
+struct RouteSearch {
+    string date;          // departure on or after, "yyyy-mm-dd"
+    string source;
+    string destination;
+    string transportType;
+    string ticketPrice;   // higher ticket price
+    int64_t sourceId = 0;      // resolved id of `source`, 0 searches by the name
+    int64_t destinationId = 0; // resolved id of `destination`, 0 searches by the name
+};
+
+// RouteColumnNames are columns of routes in order of the table, partitions have the same
+const string RouteColumnNames =
+    "id, flight, transport_type_id, source_id, destination_id, distance, departure_time, arrival_time, "
+    "seats_available, ticket_price";
+
+// routesFromPartitions makes `query` read routes of `partitions` besides routes, the
+// filters of the query are pushed down into every table of the union. Routes
+// are `routes r` after FROM or JOIN
+string routesFromPartitions(const string& query, const vector<string>& partitions) {
+    if (partitions.empty()) {
+        return query;
+    }
+    string routes = "(\n        SELECT " + RouteColumnNames + " FROM routes\n";
+    for (const string& partition : partitions) {
+        routes += "        UNION ALL SELECT " + RouteColumnNames + " FROM " + partition + "\n";
+    }
+    routes += "    ) r";
+    string routed = query;
+    size_t from = routed.find("FROM routes r");
+    if (from == string::npos) {
+        from = routed.find("JOIN routes r");
+    }
+    return from == string::npos ? routed : routed.replace(from + 5, 8, routes);
+}
+
+// buildSelectRoutesQuery builds SelectRoutesQuery with predicates only for specified
+// filters and writes their values into `binds` in placeholder order.
+// Names are resolved to ids by subqueries, so routes are always searched by index,
+// cities resolved by the caller are bound by their ids. Routes of `partitions`
+// are searched as well
+string buildSelectRoutesQuery(const RouteSearch& search, vector<QueryBind>& binds,
+                              const vector<string>& partitions = {}) {
+    string query = routesFromPartitions(SelectRoutesQuery, partitions);
+    const char* separator = "    WHERE ";
+    binds.clear();
+    if (search.sourceId > 0) {
+        query += separator;
+        query += "r.source_id = ?\n";
+        binds.push_back(search.sourceId);
+        separator = "    AND ";
+    } else if (!search.source.empty()) {
+        query += separator;
+        query += "r.source_id = (SELECT id FROM destinations WHERE name = ?)\n";
+        binds.push_back(search.source);
+        separator = "    AND ";
+    }
+    if (search.destinationId > 0) {
+        query += separator;
+        query += "r.destination_id = ?\n";
+        binds.push_back(search.destinationId);
+        separator = "    AND ";
+    } else if (!search.destination.empty()) {
+        query += separator;
+        query += "r.destination_id = (SELECT id FROM destinations WHERE name = ?)\n";
+        binds.push_back(search.destination);
+        separator = "    AND ";
+    }
+    if (!search.date.empty()) {
+        query += separator;
+        query += "r.departure_time >= ?\n";
+        binds.push_back(dateBind(search.date));
+        separator = "    AND ";
+    }
+    if (!search.transportType.empty()) {
+        query += separator;
+        query += "r.transport_type_id = (SELECT id FROM transport_types WHERE name = ?)\n";
+        binds.push_back(search.transportType);
+        separator = "    AND ";
+    }
+    if (!search.ticketPrice.empty()) {
+        query += separator;
+        query += "r.ticket_price <= ?\n";
+        binds.push_back(priceBind(search.ticketPrice));
+    }
+    // With price as the only filter the planner prefers to walk departure_time
+    // index for ordering, unary plus makes it search routes by price instead
+    if (binds.size() == 1 && !search.ticketPrice.empty()) {
+        query += "    ORDER BY +r.departure_time ASC, r.id ASC;\n";
+    } else {
+        query += "    ORDER BY r.departure_time ASC, r.id ASC;\n";
+    }
+    return query;
+}
+
+// searchCombinations returns a search for every combination of filters, values are
+// placeholders. Source and destination are given by names and by resolved ids
+inline vector<RouteSearch> searchCombinations() {
+    vector<RouteSearch> searches;
+    // Bits 5 and 6 take source and destination as ids instead of names
+    for (int mask = 0; mask < 128; ++mask) {
+        if ((mask & 32 && !(mask & 1)) || (mask & 64 && !(mask & 2))) {
+            continue;
+        }
+        RouteSearch search;
+        search.source = mask & 1 ? "?" : "";
+        search.destination = mask & 2 ? "?" : "";
+        search.date = mask & 4 ? "?" : "";
+        search.transportType = mask & 8 ? "?" : "";
+        search.ticketPrice = mask & 16 ? "?" : "";
+        search.sourceId = mask & 32 ? 1 : 0;
+        search.destinationId = mask & 64 ? 1 : 0;
+        searches.push_back(search);
+    }
+    return searches;
+}
+
+// RoutePage asks for a page of a route query. Pages are keyset ones: a next page
+// seeks past (sort key, id) of the last row of the previous page instead of
+// skipping rows with OFFSET, so any page costs as much as the first one
+struct RoutePage {
+    int limit = 0;  // rows per page, 0 means the whole result
+    string cursor;  // opaque cursor of the previous page, empty for the first page
+};
+
+// Result columns holding sort keys of route pages, NoSortKey pages by id alone
+const int NoSortKey = -1;
+const int DepartureSortKey = 5;
+const int PriceSortKey = 7;
+const int TransportSortKey = 9;
+
+// keysetQuery builds a page of `select` filtered by `where`: the first page
+// only takes LIMIT, next pages also seek past the cursor row by `seek`
+string keysetQuery(const string& select, const string& where, const string& seek, const string& order) {
+    string query = select;
+    if (!where.empty() || !seek.empty()) {
+        query += "    WHERE " + where + (!where.empty() && !seek.empty() ? " AND " : "") + seek + "\n";
+    }
+    query += "    ORDER BY " + order + "\n    LIMIT ?;\n";
+    return query;
+}
+
+// buildSelectRoutesPageQuery builds a page of "Find route by parameters", filters
+// are bound first, then cursor (when `seek` is set) and limit. A page always walks
+// departure_time index, it stops after `limit` rows and needs no sorting. Unary
+// plus keeps the date filter from being taken as the index range instead of the seek
+string buildSelectRoutesPageQuery(const RouteSearch& search, bool seek, vector<QueryBind>& binds,
+                                  const vector<string>& partitions = {}) {
+    string query = buildSelectRoutesQuery(search, binds, partitions);
+    size_t plus = query.find("ORDER BY +");
+    if (plus != string::npos) {
+        query.erase(plus + 9, 1);
+    }
+    if (seek) {
+        size_t date = query.find("r.departure_time >= ?");
+        if (date != string::npos) {
+            query.insert(date, "+");
+        }
+        query.insert(query.rfind("    ORDER BY"),
+                     string(binds.empty() ? "    WHERE " : "    AND ") + "(r.departure_time, r.id) > (?, ?)\n");
+    }
+    query.replace(query.size() - 2, 2, "\n    LIMIT ?;\n");
+    return query;
+}
+
 string SelectRoutesByTransportTypeQuery = R"(
     SELECT r.id,  r.flight, d1.name AS source, d2.name AS destination, r.distance,
-    strftime('%d.%m.%Y %H:%M:%S', r.departure_time) AS departure_time, 
-        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
     FROM routes r
     JOIN destinations d1 ON r.source_id = d1.id
     JOIN destinations d2 ON r.destination_id = d2.id
     JOIN transport_types t ON r.transport_type_id = t.id
     WHERE t.name = ?
-    ORDER BY t.name ASC;
+    ORDER BY t.name ASC, r.id ASC;
 )";
 
 string SelectRoutesByDestinationQuery = R"(
     SELECT r.id,  r.flight, d1.name AS source, d2.name AS destination, r.distance,
-    strftime('%d.%m.%Y %H:%M:%S', r.departure_time) AS departure_time, 
-        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
     FROM routes r
     JOIN destinations d1 ON r.source_id = d1.id
     JOIN destinations d2 ON r.destination_id = d2.id
     JOIN transport_types t ON r.transport_type_id = t.id
     WHERE d2.name = ?
-    ORDER BY t.name ASC;
+    ORDER BY t.name ASC, r.id ASC;
+)";
+
+// SelectRoutesByDestinationIdQuery is SelectRoutesByDestinationQuery for a destination
+// resolved by the caller, routes are searched by its id
+string SelectRoutesByDestinationIdQuery = R"(
+    SELECT r.id,  r.flight, d1.name AS source, d2.name AS destination, r.distance,
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    FROM routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
+    JOIN transport_types t ON r.transport_type_id = t.id
+    WHERE r.destination_id = ?
+    ORDER BY t.name ASC, r.id ASC;
 )";
 
 string SelectRoutesByTicketPriceQuery = R"(
     SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance,
-    strftime('%d.%m.%Y %H:%M:%S', r.departure_time) AS departure_time, 
-        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
     FROM routes r
     JOIN destinations d1 ON r.source_id = d1.id
     JOIN destinations d2 ON r.destination_id = d2.id
     JOIN transport_types t ON r.transport_type_id = t.id
     WHERE r.ticket_price <= ?
-    ORDER BY r.ticket_price ASC;
+    ORDER BY r.ticket_price ASC, r.id ASC;
+)";
+
+// RoutesPageSelect is the select list of "Show all routes" pages
+string RoutesPageSelect = R"(
+        SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time, 
+               r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+        FROM routes r
+        JOIN destinations d1 ON r.source_id = d1.id
+        JOIN destinations d2 ON r.destination_id = d2.id
+        JOIN transport_types t ON r.transport_type_id = t.id
+)";
+
+// DestinationPageSelect walks transport types in name order and routes of every
+// type by (destination_id, transport_type_id) index, so pages need no sorting
+string DestinationPageSelect = R"(
+    SELECT r.id,  r.flight, d1.name AS source, d2.name AS destination, r.distance,
+    r.departure_time, r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport
+    FROM transport_types t
+    CROSS JOIN routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
 )";
 
+const string PriceSeek = "(r.ticket_price, r.id) > (?, ?)";
+const string PriceOrder = "r.ticket_price ASC, r.id ASC";
+const string AvaliableFilter = "r.seats_available > 0";
+const string TransportFilter = "r.transport_type_id = (SELECT id FROM transport_types WHERE name = ?)";
+const string DestinationFilter =
+    "r.transport_type_id = t.id AND r.destination_id = (SELECT id FROM destinations WHERE name = ?)";
+const string DestinationIdFilter = "r.transport_type_id = t.id AND r.destination_id = ?";
+const string DestinationSeek = "(t.name, r.id) > (?, ?)";
+const string DestinationOrder = "t.name ASC, r.id ASC";
+
+string SelectAllRoutesFirstPageQuery = keysetQuery(RoutesPageSelect, "", "", PriceOrder);
+string SelectAllRoutesNextPageQuery = keysetQuery(RoutesPageSelect, "", PriceSeek, PriceOrder);
+string SelectAllAvaliableRoutesFirstPageQuery = keysetQuery(RoutesPageSelect, AvaliableFilter, "", PriceOrder);
+string SelectAllAvaliableRoutesNextPageQuery = keysetQuery(RoutesPageSelect, AvaliableFilter, PriceSeek, PriceOrder);
+string SelectRoutesByTransportTypeFirstPageQuery = keysetQuery(SelectRoutesQuery, TransportFilter, "", "r.id ASC");
+string SelectRoutesByTransportTypeNextPageQuery = keysetQuery(SelectRoutesQuery, TransportFilter, "r.id > ?", "r.id ASC");
+string SelectRoutesByDestinationFirstPageQuery = keysetQuery(DestinationPageSelect, DestinationFilter, "", DestinationOrder);
+string SelectRoutesByDestinationNextPageQuery =
+    keysetQuery(DestinationPageSelect, DestinationFilter, DestinationSeek, DestinationOrder);
+string SelectRoutesByDestinationIdFirstPageQuery =
+    keysetQuery(DestinationPageSelect, DestinationIdFilter, "", DestinationOrder);
+string SelectRoutesByDestinationIdNextPageQuery =
+    keysetQuery(DestinationPageSelect, DestinationIdFilter, DestinationSeek, DestinationOrder);
+string SelectRoutesByTicketPriceFirstPageQuery = keysetQuery(SelectRoutesQuery, "r.ticket_price <= ?", "", PriceOrder);
+string SelectRoutesByTicketPriceNextPageQuery =
+    keysetQuery(SelectRoutesQuery, "r.ticket_price <= ?", PriceSeek, PriceOrder);
+
 string InsertRouteQuery = R"(
 INSERT INTO routes (
     flight,
@@ -105,4 +454,277 @@ string InsertInTranportTypesIfNotExists = R"(
 
 string InsertInDestinationsIfNotExists = R"(
     INSERT INTO destinations (name) SELECT ? WHERE NOT EXISTS (SELECT 1 FROM destinations WHERE name =  ?);
-)";
\ No newline at end of file
+)";
+
+string InsertRouteByIdsQuery = R"(
+INSERT INTO routes (
+    flight,
+    transport_type_id, 
+    source_id, 
+    destination_id, 
+    distance, 
+    departure_time, 
+    arrival_time, 
+    seats_available, 
+    ticket_price
+)
+VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);
+)";
+
+string SelectDestinationsQuery = R"(
+    SELECT id, name FROM destinations;
+)";
+
+// SelectDestinationsAfterQuery loads cities added after the last one the city index knows
+string SelectDestinationsAfterQuery = R"(
+    SELECT id, name FROM destinations WHERE id > ? ORDER BY id ASC;
+)";
+
+// SelectRouteAggregatesQuery reads aggregates of a city pair on a day, one row
+// per transport type, by the primary key of route_aggregates
+string SelectRouteAggregatesQuery = R"(
+    SELECT transport_type_id, routes, available_routes, seats_available, min_price
+    FROM route_aggregates
+    WHERE source_id = ? AND destination_id = ? AND day = ?;
+)";
+
+string SelectRouteAggregatesByTransportQuery = R"(
+    SELECT transport_type_id, routes, available_routes, seats_available, min_price
+    FROM route_aggregates
+    WHERE source_id = ? AND destination_id = ? AND day = ?
+        AND transport_type_id = (SELECT id FROM transport_types WHERE name = ?);
+)";
+
+// SelectFareCalendarQuery reads aggregates of a city pair for a range of days in
+// one range scan of the primary key of route_aggregates, rows of a day follow
+// each other, one per transport type
+string SelectFareCalendarQuery = R"(
+    SELECT day, available_routes, min_price
+    FROM route_aggregates
+    WHERE source_id = ? AND destination_id = ? AND day >= ? AND day <= ?
+    ORDER BY day ASC;
+)";
+
+string SelectFareCalendarByTransportQuery = R"(
+    SELECT day, available_routes, min_price
+    FROM route_aggregates
+    WHERE source_id = ? AND destination_id = ? AND day >= ? AND day <= ?
+        AND transport_type_id = (SELECT id FROM transport_types WHERE name = ?)
+    ORDER BY day ASC;
+)";
+
+// SelectPartitionsQuery lists partitions of months ending after a time, oldest first
+string SelectPartitionsQuery = R"(
+    SELECT name, month_start, month_end, routes FROM route_partitions WHERE month_end > ? ORDER BY month_start ASC;
+)";
+
+string SelectPartitionQuery = R"(
+    SELECT name, month_start, month_end, routes FROM route_partitions WHERE name = ?;
+)";
+
+string InsertPartitionQuery = R"(
+    INSERT INTO route_partitions (name, month_start, month_end, routes) VALUES (?, ?, ?, ?)
+    ON CONFLICT (name) DO UPDATE SET routes = routes + excluded.routes;
+)";
+
+string DeletePartitionQuery = R"(
+    DELETE FROM route_partitions WHERE name = ?;
+)";
+
+// SelectFirstDepartureQuery finds the oldest departure of routes at or after a time
+// by routes_departure
+string SelectFirstDepartureQuery = R"(
+    SELECT min(departure_time) FROM routes WHERE departure_time >= ?;
+)";
+
+// buildPartitionTableQuery creates table `table` of a partition with the columns of
+// routes, `table` may name a schema. Indexes are built by buildPartitionIndexesQuery
+// once rows are copied
+string buildPartitionTableQuery(const string& table) {
+    return "CREATE TABLE IF NOT EXISTS " + table + R"( (
+  id INTEGER PRIMARY KEY,
+  flight TEXT NOT NULL,
+  transport_type_id INTEGER NOT NULL,
+  source_id INTEGER NOT NULL,
+  destination_id INTEGER NOT NULL,
+  distance INTEGER NOT NULL,
+  departure_time INTEGER NOT NULL, -- epoch seconds
+  arrival_time INTEGER NOT NULL, -- epoch seconds
+  seats_available INTEGER NOT NULL,
+  ticket_price INTEGER NOT NULL -- cents
+);
+)";
+}
+
+// buildPartitionIndexesQuery indexes a partition for searches and lists as routes are:
+// by the date alone and by source and destination before it, by transport type,
+// by price and by destination and transport type
+string buildPartitionIndexesQuery(const string& table) {
+    return "CREATE INDEX IF NOT EXISTS " + table + "_departure ON " + table + " (departure_time);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_source_destination_departure ON " + table +
+        " (source_id, destination_id, departure_time);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_source_departure ON " + table + " (source_id, departure_time);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_destination_departure ON " + table +
+        " (destination_id, departure_time);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_transport_type ON " + table + " (transport_type_id);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_ticket_price ON " + table + " (ticket_price);\n" +
+        "CREATE INDEX IF NOT EXISTS " + table + "_destination_transport ON " + table +
+        " (destination_id, transport_type_id);\n";
+}
+
+// buildMonthAggregatesQuery computes route aggregates of days from `start` to `end`
+// again from routes and `partition`, none if empty. Triggers of routes only see
+// rows leaving routes, so partitions keep aggregates of their months this way
+string buildMonthAggregatesQuery(const string& partition, int64_t start, int64_t end) {
+    const string days = "day >= " + to_string(start / 86400) + " AND day < " + to_string(end / 86400);
+    const string range =
+        " WHERE departure_time >= " + to_string(start) + " AND departure_time < " + to_string(end);
+    string routes = "SELECT " + RouteColumnNames + " FROM routes" + range;
+    if (!partition.empty()) {
+        routes += " UNION ALL SELECT " + RouteColumnNames + " FROM " + partition + range;
+    }
+    return "DELETE FROM route_aggregates WHERE " + days + ";\n" +
+        "INSERT INTO route_aggregates SELECT source_id, destination_id, departure_time / 86400, "
+        "transport_type_id, count(*), sum(seats_available > 0), sum(max(seats_available, 0)), "
+        "min(CASE WHEN seats_available > 0 THEN ticket_price END) FROM (" + routes + ") GROUP BY 1, 2, 3, 4;\n";
+}
+
+// UnbookedRouteFilter keeps routes with booking legs in routes when partitioning,
+// legs reference routes and cancellations return seats to them
+const string UnbookedRouteFilter = "id NOT IN (SELECT route_id FROM booking_legs)";
+
+string SelectTransportTypesQuery = R"(
+    SELECT id, name FROM transport_types;
+)";
+
+string InsertDestinationQuery = R"(
+    INSERT INTO destinations (name) VALUES (?);
+)";
+
+string InsertTransportTypeQuery = R"(
+    INSERT INTO transport_types (name) VALUES (?);
+)";
+
+// SelectRouteColumnsQuery loads routes into the columnar index
+string SelectRouteColumnsQuery = R"(
+    SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time,
+        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport, r.source_id,
+        r.destination_id, r.transport_type_id
+    FROM routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
+    JOIN transport_types t ON r.transport_type_id = t.id
+    ORDER BY r.id ASC;
+)";
+
+// SelectUpcomingRouteColumnsQuery loads routes departing at or after a time into
+// the departure board by routes_departure
+string SelectUpcomingRouteColumnsQuery = R"(
+    SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time,
+        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport, r.source_id,
+        r.destination_id, r.transport_type_id
+    FROM routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
+    JOIN transport_types t ON r.transport_type_id = t.id
+    WHERE r.departure_time >= ?
+    ORDER BY r.departure_time ASC, r.id ASC;
+)";
+
+// SelectRouteColumnsAfterIdQuery reads routes inserted after the last one the
+// departure board knows
+string SelectRouteColumnsAfterIdQuery = R"(
+    SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time,
+        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport, r.source_id,
+        r.destination_id, r.transport_type_id
+    FROM routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
+    JOIN transport_types t ON r.transport_type_id = t.id
+    WHERE r.id > ?
+    ORDER BY r.id ASC;
+)";
+
+string SelectLastRouteIdQuery = R"(
+    SELECT max(id) FROM routes;
+)";
+
+string SelectRouteColumnsByIdQuery = R"(
+    SELECT r.id, r.flight, d1.name AS source, d2.name AS destination, r.distance, r.departure_time,
+        r.arrival_time, r.ticket_price, r.seats_available, t.name AS transport, r.source_id,
+        r.destination_id, r.transport_type_id
+    FROM routes r
+    JOIN destinations d1 ON r.source_id = d1.id
+    JOIN destinations d2 ON r.destination_id = d2.id
+    JOIN transport_types t ON r.transport_type_id = t.id
+    WHERE r.id = ?;
+)";
+
+// SelectConnectionsQuery loads timetable of routes with avaliable seats for journey planning
+string SelectConnectionsQuery = R"(
+    SELECT r.id, r.source_id, r.destination_id, r.departure_time, r.arrival_time, r.ticket_price
+    FROM routes r
+    WHERE r.seats_available > 0
+    ORDER BY r.departure_time ASC, r.id ASC;
+)";
+
+string SelectConnectionByIdQuery = R"(
+    SELECT r.id, r.source_id, r.destination_id, r.departure_time, r.arrival_time, r.ticket_price
+    FROM routes r
+    WHERE r.id = ? AND r.seats_available > 0;
+)";
+
+// SelectRouteByIdQuery selects a single route as "Find route by parameters" prints it
+string SelectRouteByIdQuery = SelectRoutesQuery + R"(
+    WHERE r.id = ?;
+)";
+
+string SelectDestinationIdQuery = R"(
+    SELECT id FROM destinations WHERE name = ?;
+)";
+
+// SelectRouteWidthsQuery returns display widths of route columns for streaming output,
+// times are always "yyyy-mm-dd HH:MM:SS" long and prices are printed by formatCents
+string SelectRouteWidthsQuery = R"(
+    SELECT length(max(r.id)), max(length(r.flight)), (SELECT max(length(name)) FROM destinations),
+        (SELECT max(length(name)) FROM destinations), max(length(r.distance)), 19, 19,
+        max(length(r.ticket_price / 100) + 2 + (r.ticket_price % 10 != 0)), max(length(r.seats_available)),
+        (SELECT max(length(name)) FROM transport_types)
+    FROM routes r;
+)";
+
+string InsertBookingQuery = R"(
+    INSERT INTO bookings (seats) VALUES (?);
+)";
+
+string InsertBookingLegQuery = R"(
+    INSERT INTO booking_legs (booking_id, leg, route_id) VALUES (?, ?, ?);
+)";
+
+// ReserveSeatsQuery takes seats of a route only while enough of them are left,
+// the check and the update are a single statement, so concurrent bookings never oversell
+string ReserveSeatsQuery = R"(
+    UPDATE routes SET seats_available = seats_available - ? WHERE id = ? AND seats_available >= ?;
+)";
+
+string SelectRouteExistsQuery = R"(
+    SELECT 1 FROM routes WHERE id = ?;
+)";
+
+string CancelBookingQuery = R"(
+    UPDATE bookings SET status = 'cancelled' WHERE id = ? AND status = 'active';
+)";
+
+// ReleaseSeatsQuery returns seats of a booking to all of its routes
+string ReleaseSeatsQuery = R"(
+    UPDATE routes SET seats_available = seats_available + (SELECT seats FROM bookings WHERE id = ?)
+    WHERE id IN (SELECT route_id FROM booking_legs WHERE booking_id = ?);
+)";
+
+string SelectBookingStatusQuery = R"(
+    SELECT status FROM bookings WHERE id = ?;
+)";
+
+string SelectBookingLegsQuery = R"(
+    SELECT route_id FROM booking_legs WHERE booking_id = ? ORDER BY leg ASC;
+)";
@@ -0,0 +1,278 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "money.cpp"
+#include "queries.cpp"
+#include "timeutil.cpp"
+using namespace std;
+
+// appendJSONString appends value as a quoted JSON string
+inline void appendJSONString(string& out, const char* value, size_t length) {
+    out += '"';
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = value[i];
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += char(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+inline void appendJSONString(string& out, const string& value) {
+    appendJSONString(out, value.data(), value.size());
+}
+
+// appendInteger appends a number without a temporary string
+inline void appendInteger(string& out, int64_t value) {
+    char buffer[24];
+    out.append(buffer, snprintf(buffer, sizeof(buffer), "%lld", (long long)value));
+}
+
+// routeCell returns text of a printed route column and its length in `bytes`.
+// Times are printed as "yyyy-mm-dd HH:MM:SS", departure as "dd.mm.yyyy HH:MM:SS"
+// when `dayFirstDeparture` is set, and price as formatCents does; numbers are
+// written into `buffer` of 32 bytes
+inline const char* routeCell(const Route& route, int column, bool dayFirstDeparture, char* buffer, size_t& bytes) {
+    string_view text;
+    switch (column) {
+        case 0: bytes = snprintf(buffer, 32, "%lld", (long long)route.id); return buffer;
+        case 1: text = route.flight; break;
+        case 2: text = route.source; break;
+        case 3: text = route.destination; break;
+        case 4: bytes = snprintf(buffer, 32, "%lld", (long long)route.distance); return buffer;
+        case 5: bytes = formatTime(route.departure, dayFirstDeparture, buffer); return buffer;
+        case 6: bytes = formatTime(route.arrival, false, buffer); return buffer;
+        case 7: bytes = formatCents(route.priceCents, buffer); return buffer;
+        case 8: bytes = snprintf(buffer, 32, "%lld", (long long)route.seats); return buffer;
+        default: text = route.transport;
+    }
+    bytes = text.size();
+    return text.data();
+}
+
+// routeCells renders all printed columns of a route
+inline void routeCells(const Route& route, bool dayFirstDeparture, vector<string>& cells) {
+    char buffer[32];
+    cells.resize(10);
+    for (int i = 0; i < 10; ++i) {
+        size_t bytes;
+        const char* text = routeCell(route, i, dayFirstDeparture, buffer, bytes);
+        cells[i].assign(text, bytes);
+    }
+}
+
+// appendRouteJSON appends route as JSON object keyed by routeColumnNames, numbers
+// are written as numbers, names and times as strings
+inline void appendRouteJSON(string& out, const Route& route, bool dayFirstDeparture) {
+    char buffer[32];
+    out += "{\"id\":";
+    appendInteger(out, route.id);
+    out += ",\"flight\":";
+    appendJSONString(out, route.flight.data(), route.flight.size());
+    out += ",\"source\":";
+    appendJSONString(out, route.source.data(), route.source.size());
+    out += ",\"destination\":";
+    appendJSONString(out, route.destination.data(), route.destination.size());
+    out += ",\"distance\":";
+    appendInteger(out, route.distance);
+    out += ",\"departure_time\":";
+    appendJSONString(out, buffer, formatTime(route.departure, dayFirstDeparture, buffer));
+    out += ",\"arrival_time\":";
+    appendJSONString(out, buffer, formatTime(route.arrival, false, buffer));
+    out += ",\"ticket_price\":";
+    out.append(buffer, formatCents(route.priceCents, buffer));
+    out += ",\"seats_available\":";
+    appendInteger(out, route.seats);
+    out += ",\"transport\":";
+    appendJSONString(out, route.transport.data(), route.transport.size());
+    out += '}';
+}
+
+// OutputFormat is how query results are printed
+enum class OutputFormat {
+    Table,  // aligned table, widths are computed from the whole result
+    Stream, // aligned table with precomputed widths, rows are printed as they come
+    CSV,
+    JSONL,
+};
+
+// routeColumnNames are names of the columns printed by route queries
+const vector<string> routeColumnNames = {
+    "id", "flight", "source", "destination", "distance", "departure_time",
+    "arrival_time", "ticket_price", "seats_available", "transport"};
+
+// utf8Length counts symbols of UTF-8 text (not number of bytes)
+inline size_t utf8Length(const char* text, size_t bytes) {
+    size_t count = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        // Symbol starts from 0xxxxxxx or 11xxxxxx in UTF-8
+        if ((text[i] & 0xC0) != 0x80) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// RowWriter prints rows one by one without keeping the result. Cells are copied
+// straight from decoded routes into an output buffer, which is written once per
+// chunk, so memory does not depend on number of rows
+class RowWriter {
+public:
+    // `widths` are display widths of Stream table columns including padding
+    RowWriter(ostream& out, OutputFormat format, const vector<string>& headers, const vector<size_t>& widths)
+        : out(out), format(format), headers(headers), widths(widths), rows(0) {
+        buffer.reserve(chunkSize + 4096);
+    }
+
+    // begin prints table header or CSV header
+    void begin() {
+        if (format == OutputFormat::Stream) {
+            line();
+            for (size_t i = 0; i < headers.size(); ++i) {
+                tableCell(i, headers[i].data(), headers[i].size());
+            }
+            buffer += "|\n";
+            line();
+        } else if (format == OutputFormat::CSV) {
+            for (size_t i = 0; i < routeColumnNames.size(); ++i) {
+                csvCell(i, routeColumnNames[i].data(), routeColumnNames[i].size());
+            }
+            buffer += '\n';
+        }
+    }
+
+    // row prints a route, see routeCell for `dayFirstDeparture`
+    void row(const Route& route, bool dayFirstDeparture) {
+        if (format == OutputFormat::JSONL) {
+            appendRouteJSON(buffer, route, dayFirstDeparture);
+            buffer += '\n';
+            ++rows;
+        } else {
+            char formatted[32];
+            for (size_t i = 0; i < headers.size(); ++i) {
+                size_t bytes;
+                const char* text = routeCell(route, i, dayFirstDeparture, formatted, bytes);
+                cell(i, text, bytes);
+            }
+            endRow();
+        }
+        flushChunk();
+    }
+
+    // end prints table footer and flushes the rest of buffer
+    void end() {
+        if (format == OutputFormat::Stream) {
+            line();
+        }
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        buffer.clear();
+    }
+
+    // truncate ends a result stopped before its end: the rows printed so far
+    // are closed as end does and followed by a marker with `reason`, a JSON
+    // object for JSONL and a line of text otherwise
+    void truncate(const string& reason) {
+        end();
+        string marker;
+        if (format == OutputFormat::JSONL) {
+            marker = "{\"truncated\":true,\"rows\":" + to_string(rows) + ",\"error\":";
+            appendJSONString(marker, reason);
+            marker += "}\n";
+        } else {
+            marker = "Truncated after " + to_string(rows) + " rows: " + reason + "\n";
+        }
+        out << marker << flush;
+    }
+
+    long count() const {
+        return rows;
+    }
+
+private:
+    static const size_t chunkSize = 64 * 1024;
+
+    void cell(size_t column, const char* text, size_t bytes) {
+        if (format == OutputFormat::CSV) {
+            csvCell(column, text, bytes);
+        } else {
+            tableCell(column, text, bytes);
+        }
+    }
+
+    void endRow() {
+        buffer += format == OutputFormat::CSV ? "\n" : "|\n";
+        ++rows;
+    }
+
+    void tableCell(size_t column, const char* text, size_t bytes) {
+        buffer += "| ";
+        buffer.append(text, bytes);
+        size_t length = utf8Length(text, bytes) + 2;
+        if (column < widths.size() && length < widths[column]) {
+            buffer.append(widths[column] - length + 1, ' ');
+        } else {
+            buffer += ' ';
+        }
+    }
+
+    void csvCell(size_t column, const char* text, size_t bytes) {
+        if (column > 0) {
+            buffer += ',';
+        }
+        bool quote = false;
+        for (size_t i = 0; i < bytes && !quote; ++i) {
+            quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+        }
+        if (!quote) {
+            buffer.append(text, bytes);
+            return;
+        }
+        buffer += '"';
+        for (size_t i = 0; i < bytes; ++i) {
+            if (text[i] == '"') {
+                buffer += '"';
+            }
+            buffer += text[i];
+        }
+        buffer += '"';
+    }
+
+    void line() {
+        buffer += '+';
+        for (size_t width : widths) {
+            buffer.append(width, '-');
+            buffer += '+';
+        }
+        buffer += '\n';
+    }
+
+    void flushChunk() {
+        if (buffer.size() >= chunkSize) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    ostream& out;
+    OutputFormat format;
+    const vector<string>& headers;
+    const vector<size_t>& widths;
+    string buffer;
+    long rows;
+};
@@ -0,0 +1,392 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "importer.cpp"
+#include "columnar.cpp"
+#include "planner.cpp"
+using namespace std;
+
+// LatencyHistogram counts values in log-linear buckets like HdrHistogram: every
+// power of two range is split into 64 linear sub-buckets, so a value is kept with
+// relative error below 1/64 and memory does not depend on number of values
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts(bucketCount, 0), total(0), minimum(UINT64_MAX), maximum(0), sum(0) {}
+
+    void record(uint64_t value) {
+        ++counts[bucketIndex(value)];
+        ++total;
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        sum += value;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t min() const {
+        return total == 0 ? 0 : minimum;
+    }
+
+    uint64_t max() const {
+        return maximum;
+    }
+
+    double mean() const {
+        return total == 0 ? 0 : double(sum) / total;
+    }
+
+    // Sum of all recorded values
+    uint64_t totalValue() const {
+        return sum;
+    }
+
+    // percentile returns the highest value equivalent to the one at `p` percent
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(p / 100.0 * total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(bucketHigh(i), maximum);
+            }
+        }
+        return maximum;
+    }
+
+    // printDistribution prints percentile distribution in HdrHistogram text format,
+    // values are divided by `scale`
+    void printDistribution(ostream& out, double scale) const {
+        out << setw(12) << "Value" << setw(15) << "Percentile" << setw(11) << "TotalCount"
+            << setw(18) << "1/(1-Percentile)" << "\n\n";
+        out << fixed;
+        uint64_t seen = 0;
+        double nextPercentile = 0;
+        for (size_t i = 0; i < counts.size() && total > 0; ++i) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            seen += counts[i];
+            double reached = 100.0 * seen / total;
+            if (reached < nextPercentile && seen < total) {
+                continue;
+            }
+            out << setprecision(3) << setw(12) << std::min(bucketHigh(i), maximum) / scale
+                << setprecision(12) << setw(15) << reached / 100 << setw(11) << seen;
+            if (seen < total) {
+                out << setprecision(2) << setw(18) << 100 / (100 - reached);
+            }
+            out << "\n";
+            // Five lines per halving of distance to 100% as HdrHistogram prints
+            while (nextPercentile <= reached && seen < total) {
+                double halves = floor(log2(100 / (100 - nextPercentile))) + 1;
+                nextPercentile += 100 / (5 * pow(2, halves));
+            }
+        }
+        out << setprecision(3) << "#[Mean    = " << setw(12) << mean() / scale
+            << ", Max     = " << setw(12) << maximum / scale << "]\n";
+        out << "#[Total count    = " << setw(12) << total << "]\n";
+        out.unsetf(ios::floatfield);
+    }
+
+private:
+    // 128 exact buckets for small values, then 64 buckets per power of two
+    static const int subBits = 6;
+    static const size_t bucketCount = 128 + 57 * 64;
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < 128) {
+            return value;
+        }
+        int shift = 63 - __builtin_clzll(value) - subBits;
+        return 128 + (shift - 1) * 64 + ((value >> shift) - 64);
+    }
+
+    static uint64_t bucketHigh(size_t index) {
+        if (index < 128) {
+            return index;
+        }
+        int shift = (index - 128) / 64 + 1;
+        uint64_t low = uint64_t((index - 128) % 64 + 64) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+    vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t minimum;
+    uint64_t maximum;
+    uint64_t sum;
+};
+
+// OperationStats are results of one type of replayed operations
+struct OperationStats {
+    LatencyHistogram latency; // nanoseconds
+    long errors = 0;
+    long rows = 0;
+};
+
+// WorkloadReplayer executes a stream of operations, one JSON object per line,
+// through the same repository, columnar index and journey planner as the menu.
+// A failed operation is counted and reported, the replay goes on. Operations are
+//   {"op":"routes"}, {"op":"available"}, {"op":"destination","name":...},
+//   {"op":"transport","name":...}, {"op":"price","max":...},
+//   {"op":"search","date":...,"source":...,"destination":...,"transport":...,"price":...},
+//   {"op":"insert", fields of an imported route},
+//   {"op":"plan","source":...,"destination":...,"date":...,"objective":...,"min_transfer":...,"max_legs":...}
+// Lists also take "limit" and "cursor" of keyset pages. Inserts change the
+// database, so production traffic is replayed against a copy
+class WorkloadReplayer {
+public:
+    WorkloadReplayer(RouteRepository& repo, ColumnarRouteIndex* columnar, JourneyPlanner& planner)
+        : repo(repo), columnar(columnar), planner(planner) {}
+
+    // run replays operations from `in` and prints errors to `errors`
+    void run(istream& in, ostream& errors) {
+        string line;
+        long lineNumber = 0;
+        auto start = chrono::steady_clock::now();
+        while (getline(in, line)) {
+            ++lineNumber;
+            if (line.find_first_not_of(" \t\r") == string::npos) {
+                continue;
+            }
+            string error;
+            map<string, string> fields;
+            if (!RouteImporter::parseJSONObject(line, error, [&fields](const string& key, const string& value) {
+                    fields[key] = value;
+                })) {
+                ++stats["invalid"].errors;
+                errors << "line " << lineNumber << ": " << error << "\n";
+                continue;
+            }
+            const string op = fields["op"];
+            // Timetable is loaded once before the first plan is timed
+            if (op == "plan" && !planner.isLoaded() && !planner.load(repo)) {
+                error = sqlite3_errmsg(repo.handle());
+            }
+            long rows = 0;
+            auto sent = chrono::steady_clock::now();
+            bool ok = error.empty() && execute(op, fields, line, rows, error);
+            uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sent).count();
+            OperationStats& operation = stats[op.empty() ? "invalid" : op];
+            if (!ok) {
+                ++operation.errors;
+                errors << "line " << lineNumber << ": " << (op.empty() ? "missing op" : op) << ": " << error << "\n";
+                continue;
+            }
+            operation.latency.record(elapsed);
+            operation.rows += rows;
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // report prints latency percentiles and throughput of every operation type,
+    // `distribution` adds full HDR percentile distributions
+    void report(ostream& out, bool distribution) const {
+        out << left << setw(12) << "Operation" << right << setw(9) << "Count" << setw(8) << "Errors"
+            << setw(11) << "Rows" << setw(11) << "Ops/s" << setw(11) << "p50 us" << setw(11) << "p90 us"
+            << setw(11) << "p99 us" << setw(11) << "p99.9 us" << setw(11) << "Max us" << "\n";
+        long total = 0;
+        long errors = 0;
+        for (const auto& entry : stats) {
+            const LatencyHistogram& latency = entry.second.latency;
+            const double busy = latency.totalValue() / 1e9;
+            total += latency.count();
+            errors += entry.second.errors;
+            out << left << setw(12) << entry.first << right << setw(9) << latency.count()
+                << setw(8) << entry.second.errors << setw(11) << entry.second.rows << fixed << setprecision(0)
+                << setw(11) << (busy > 0 ? latency.count() / busy : 0) << setprecision(1)
+                << setw(11) << latency.percentile(50) / 1e3 << setw(11) << latency.percentile(90) / 1e3
+                << setw(11) << latency.percentile(99) / 1e3 << setw(11) << latency.percentile(99.9) / 1e3
+                << setw(11) << latency.max() / 1e3 << "\n";
+            out.unsetf(ios::floatfield);
+        }
+        out << "Operations: " << total << ", errors: " << errors << ", wall time " << fixed << setprecision(3)
+            << seconds << " s, throughput " << setprecision(0) << (seconds > 0 ? total / seconds : 0) << " ops/s\n";
+        out.unsetf(ios::floatfield);
+        if (!distribution) {
+            return;
+        }
+        for (const auto& entry : stats) {
+            if (entry.second.latency.count() > 0) {
+                out << "\n" << entry.first << " latency, us\n";
+                entry.second.latency.printDistribution(out, 1e3);
+            }
+        }
+    }
+
+private:
+    // execute runs a single operation and reads all its rows
+    bool execute(const string& op, map<string, string>& fields, const string& line, long& rows, string& error) {
+        RoutePage page;
+        page.limit = atoi(fields["limit"].c_str());
+        page.cursor = fields["cursor"];
+        if (!page.cursor.empty() && (page.limit <= 0 || !RouteRepository::validCursor(page.cursor))) {
+            error = "invalid cursor";
+            return false;
+        }
+        // Pages are index seeks, they are answered by SQLite with any engine
+        const bool inMemory = columnar && page.limit <= 0;
+        if (op == "routes" || op == "available") {
+            if (inMemory) {
+                return consume(columnar->allRoutes(op == "available"), false, rows);
+            }
+            return consume(op == "routes" ? repo.allRoutes(page) : repo.allAvaliableRoutes(page), rows, error);
+        }
+        if (op == "destination") {
+            if (inMemory) {
+                return consume(columnar->routesByDestination(fields["name"]), true, rows);
+            }
+            return consume(repo.routesByDestination(fields["name"], page), rows, error);
+        }
+        if (op == "transport") {
+            if (inMemory) {
+                return consume(columnar->routesByTransport(fields["name"]), true, rows);
+            }
+            return consume(repo.routesByTransport(fields["name"], page), rows, error);
+        }
+        if (op == "price") {
+            if (!RouteImporter::isNumber(fields["max"])) {
+                error = "invalid price";
+                return false;
+            }
+            if (inMemory) {
+                return consume(columnar->routesByPrice(fields["max"]), true, rows);
+            }
+            return consume(repo.routesByPrice(fields["max"], page), rows, error);
+        }
+        if (op == "search") {
+            RouteSearch search;
+            search.date = fields["date"];
+            search.source = fields["source"];
+            search.destination = fields["destination"];
+            search.transportType = fields["transport"];
+            search.ticketPrice = fields["price"];
+            if (!search.date.empty() && !RouteImporter::normalizeDate(search.date)) {
+                error = "invalid date format";
+                return false;
+            }
+            if (!search.ticketPrice.empty() && !RouteImporter::isNumber(search.ticketPrice)) {
+                error = "invalid price";
+                return false;
+            }
+            if (inMemory) {
+                return consume(columnar->search(search), true, rows);
+            }
+            return consume(repo.searchRoutes(search, page), rows, error);
+        }
+        if (op == "insert") {
+            return insert(line, rows, error);
+        }
+        if (op == "plan") {
+            return plan(fields, rows, error);
+        }
+        error = "unknown operation";
+        return false;
+    }
+
+    // consume steps the statement and reads every cell as printing does
+    bool consume(sqlite3_stmt* stmt, long& rows, string& error) {
+        if (!stmt) {
+            error = sqlite3_errmsg(repo.handle());
+            return false;
+        }
+        Route route;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            RouteColumns::read(stmt, route);
+            routeCells(route, true, cells);
+            ++rows;
+        }
+        if (rc != SQLITE_DONE) {
+            error = sqlite3_errmsg(repo.handle());
+            return false;
+        }
+        return true;
+    }
+
+    // consume renders every row selected by the columnar index
+    bool consume(const vector<uint32_t>& selected, bool dayFirstDeparture, long& rows) {
+        for (uint32_t position : selected) {
+            routeCells(columnar->route(position), dayFirstDeparture, cells);
+            ++rows;
+        }
+        return true;
+    }
+
+    bool insert(const string& line, long& rows, string& error) {
+        RouteRecord record;
+        NewRoute route;
+        if (!RouteImporter::parseJSONRecord(line, record, error) || !RouteImporter::normalizeRecord(record, error)) {
+            return false;
+        }
+        RouteImporter::newRoute(record, route);
+        if (!repo.insertRoute(route)) {
+            error = sqlite3_errmsg(repo.handle());
+            return false;
+        }
+        sqlite3_int64 id = sqlite3_last_insert_rowid(repo.handle());
+        if ((columnar && !columnar->append(repo, id)) || !planner.add(repo, id)) {
+            error = sqlite3_errmsg(repo.handle());
+            return false;
+        }
+        rows = 1;
+        return true;
+    }
+
+    bool plan(map<string, string>& fields, long& rows, string& error) {
+        JourneyRequest request;
+        string date = fields["date"];
+        if (!RouteImporter::normalizeDate(date) || !parseSQLiteTime(date, request.departAfter)) {
+            error = "invalid date format";
+            return false;
+        }
+        if (!cityId(fields["source"], request.source) || !cityId(fields["destination"], request.destination)) {
+            error = sqlite3_errmsg(repo.handle());
+            return false;
+        }
+        request.minTransfer = atoll(fields["min_transfer"].c_str()) * 60;
+        if (!fields["max_legs"].empty()) {
+            request.maxLegs = atoi(fields["max_legs"].c_str());
+        }
+        if (fields["objective"] == "cheapest") {
+            request.objective = JourneyObjective::Cheapest;
+        } else if (fields["objective"] == "pareto") {
+            request.objective = JourneyObjective::Pareto;
+        }
+        rows = planner.plan(request).size();
+        return true;
+    }
+
+    // cityId finds id of city by name, unknown city gets -1
+    bool cityId(const string& name, int32_t& id) {
+        sqlite3_stmt* stmt = repo.statement(SelectDestinationIdQuery);
+        if (!stmt || sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt);
+        id = rc == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW || rc == SQLITE_DONE;
+    }
+
+    RouteRepository& repo;
+    ColumnarRouteIndex* columnar;
+    JourneyPlanner& planner;
+    map<string, OperationStats> stats;
+    vector<string> cells;
+    double seconds = 0;
+};
@@ -0,0 +1,611 @@
+#pragma once
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "queries.cpp"
+using namespace std;
+
+// NewRoute is a route to insert in stored form: times are epoch seconds and
+// price is cents, cities and transport type are given by names
+struct NewRoute {
+    string flight;
+    string source;
+    string destination;
+    string transportType;
+    int64_t departure = 0;
+    int64_t arrival = 0;
+    int64_t priceCents = 0;
+    int64_t distance = 0;
+    int64_t seats = 0;
+};
+
+// RouteAggregate sums route aggregates of a city pair on a day
+struct RouteAggregate {
+    int64_t routes = 0;
+    int64_t availableRoutes = 0;
+    int64_t seats = 0;
+    int64_t minPrice = -1; // cents, -1 when no route has available seats
+};
+
+// FareDay is a day of a fare calendar
+struct FareDay {
+    int64_t day = 0; // days since epoch
+    int64_t availableRoutes = 0;
+    int64_t minPrice = -1; // cents, -1 when no route has available seats
+};
+
+// RouteRepository owns the database connection and keeps every query prepared
+// for the whole lifetime of the connection. Callers get a statement that is
+// already reset and has its bindings cleared, so a steady-state call only pays
+// for binding and stepping, never for parsing and planning the SQL again.
+class RouteRepository {
+public:
+    RouteRepository() : db(nullptr), prepareCalls(0), reuseHits(0) {}
+
+    ~RouteRepository() {
+        close();
+    }
+
+    // open opens the database file and prepares all static queries, a new
+    // database without schema is opened as is
+    bool open(const char* path) {
+        if (sqlite3_open(path, &db) != SQLITE_OK) {
+            return false;
+        }
+        return !hasSchema() || prepareAll(schemaVersion() >= RouteSchemaVersion);
+    }
+
+    // hasSchema reports whether routes table exists
+    bool hasSchema() {
+        sqlite3_stmt* stmt = statement("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'routes';");
+        bool exists = stmt && sqlite3_step(stmt) == SQLITE_ROW;
+        if (stmt) {
+            sqlite3_reset(stmt);
+        }
+        return exists;
+    }
+
+    // schemaVersion returns user_version of the database, routes of a version
+    // below RouteSchemaVersion have to be migrated first
+    int schemaVersion() {
+        sqlite3_stmt* stmt = statement("PRAGMA user_version;");
+        int version = stmt && sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+        if (stmt) {
+            sqlite3_reset(stmt);
+        }
+        return version;
+    }
+
+    // configure runs one-off statements such as pragmas, they are not cached
+    bool configure(const string& sql) {
+        return sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+    // close finalizes all cached statements and closes the connection
+    void close() {
+        for (auto& entry : statements) {
+            sqlite3_finalize(entry.second);
+        }
+        statements.clear();
+        sortKeys.clear();
+        if (db) {
+            sqlite3_close(db);
+            db = nullptr;
+        }
+    }
+
+    sqlite3* handle() const {
+        return db;
+    }
+
+    // error describes why the last call failed: a query whose result columns do
+    // not match its mapper or an error of the connection
+    string error() const {
+        return mappingError.empty() ? sqlite3_errmsg(db) : mappingError;
+    }
+
+    // statement returns a ready to bind statement for the query, it is prepared
+    // on first use and only reset on every next call
+    sqlite3_stmt* statement(const string& query) {
+        auto it = statements.find(query);
+        if (it != statements.end()) {
+            ++reuseHits;
+            sqlite3_reset(it->second);
+            sqlite3_clear_bindings(it->second);
+            return it->second;
+        }
+        sqlite3_stmt* stmt = nullptr;
+        ++prepareCalls;
+        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            return nullptr;
+        }
+        statements.emplace(query, stmt);
+        return stmt;
+    }
+
+    // routesStatement returns statement of `query` reading all partitions besides
+    // routes, see routesFromPartitions. Lists, the columnar index, snapshots and
+    // journeys see every route this way
+    sqlite3_stmt* routesStatement(const string& query) {
+        vector<string> partitions;
+        if (!partitionsAfter(INT64_MIN, partitions)) {
+            return nullptr;
+        }
+        return statement(routesFromPartitions(query, partitions));
+    }
+
+    // allRoutes returns statement selecting all routes
+    sqlite3_stmt* allRoutes() {
+        return routesStatement(SelectAllRoutesQuery);
+    }
+
+    // allAvaliableRoutes returns statement selecting routes with avaliable seats
+    sqlite3_stmt* allAvaliableRoutes() {
+        return routesStatement(SelectAllAvaliableRoutesQuery);
+    }
+
+    // routesByTransport returns statement selecting routes with specified `transport_type`
+    sqlite3_stmt* routesByTransport(const string& transportType) {
+        sqlite3_stmt* stmt = routesStatement(SelectRoutesByTransportTypeQuery);
+        if (!stmt || !bindParams(stmt, transportType)) {
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    // routesByDestination returns statement selecting routes with specified destination,
+    // a destination resolved by the caller is searched by its `destinationId`
+    sqlite3_stmt* routesByDestination(const string& destination, int64_t destinationId = 0) {
+        if (destinationId > 0) {
+            sqlite3_stmt* stmt = routesStatement(SelectRoutesByDestinationIdQuery);
+            return stmt && bindParams(stmt, destinationId) ? stmt : nullptr;
+        }
+        sqlite3_stmt* stmt = routesStatement(SelectRoutesByDestinationQuery);
+        if (!stmt || !bindParams(stmt, destination)) {
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    // routesByPrice returns statement selecting routes cheaper than `ticketPrice`
+    sqlite3_stmt* routesByPrice(const string& ticketPrice) {
+        sqlite3_stmt* stmt = routesStatement(SelectRoutesByTicketPriceQuery);
+        if (!stmt || !bindValue(stmt, 1, priceBind(ticketPrice))) {
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    // partitionsAfter returns tables of partitions holding routes that may depart at
+    // or after `departure`, oldest first. The catalog has a row per month
+    bool partitionsAfter(const QueryBind& departure, vector<string>& tables) {
+        tables.clear();
+        sqlite3_stmt* stmt = statement(SelectPartitionsQuery);
+        if (!stmt || !bindValue(stmt, 1, departure)) {
+            return false;
+        }
+        PartitionRow row;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            PartitionColumns::read(stmt, row);
+            tables.emplace_back(row.name);
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // searchRoutes returns statement selecting routes by specified filters only,
+    // every combination of filters is prepared once and then reused. A search
+    // with a departure date also reads partitions of months ending after it,
+    // searches without one read all partitions
+    sqlite3_stmt* searchRoutes(const RouteSearch& search) {
+        vector<string> partitions;
+        if (!partitionsAfter(search.date.empty() ? QueryBind(INT64_MIN) : dateBind(search.date), partitions)) {
+            return nullptr;
+        }
+        vector<QueryBind> binds;
+        sqlite3_stmt* stmt = statement(buildSelectRoutesQuery(search, binds, partitions));
+        if (!stmt) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < binds.size(); ++i) {
+            if (!bindValue(stmt, i + 1, binds[i])) {
+                return nullptr;
+            }
+        }
+        return stmt;
+    }
+
+    // Page variants of the queries above, a page with zero limit is the whole result.
+    // They return nullptr on a malformed cursor as well
+    sqlite3_stmt* allRoutes(const RoutePage& page) {
+        if (page.limit <= 0) {
+            return allRoutes();
+        }
+        return routesPage(page.cursor.empty() ? SelectAllRoutesFirstPageQuery : SelectAllRoutesNextPageQuery,
+                          PriceSortKey, vector<QueryBind>(), page);
+    }
+
+    sqlite3_stmt* allAvaliableRoutes(const RoutePage& page) {
+        if (page.limit <= 0) {
+            return allAvaliableRoutes();
+        }
+        return routesPage(
+            page.cursor.empty() ? SelectAllAvaliableRoutesFirstPageQuery : SelectAllAvaliableRoutesNextPageQuery,
+            PriceSortKey, vector<QueryBind>(), page);
+    }
+
+    sqlite3_stmt* routesByTransport(const string& transportType, const RoutePage& page) {
+        if (page.limit <= 0) {
+            return routesByTransport(transportType);
+        }
+        return routesPage(
+            page.cursor.empty() ? SelectRoutesByTransportTypeFirstPageQuery : SelectRoutesByTransportTypeNextPageQuery,
+            NoSortKey, vector<QueryBind>{transportType}, page);
+    }
+
+    sqlite3_stmt* routesByDestination(const string& destination, const RoutePage& page, int64_t destinationId = 0) {
+        if (page.limit <= 0) {
+            return routesByDestination(destination, destinationId);
+        }
+        if (destinationId > 0) {
+            return routesPage(page.cursor.empty() ? SelectRoutesByDestinationIdFirstPageQuery
+                                                  : SelectRoutesByDestinationIdNextPageQuery,
+                              TransportSortKey, vector<QueryBind>{destinationId}, page);
+        }
+        return routesPage(
+            page.cursor.empty() ? SelectRoutesByDestinationFirstPageQuery : SelectRoutesByDestinationNextPageQuery,
+            TransportSortKey, vector<QueryBind>{destination}, page);
+    }
+
+    sqlite3_stmt* routesByPrice(const string& ticketPrice, const RoutePage& page) {
+        if (page.limit <= 0) {
+            return routesByPrice(ticketPrice);
+        }
+        return routesPage(
+            page.cursor.empty() ? SelectRoutesByTicketPriceFirstPageQuery : SelectRoutesByTicketPriceNextPageQuery,
+            PriceSortKey, vector<QueryBind>{priceBind(ticketPrice)}, page);
+    }
+
+    sqlite3_stmt* searchRoutes(const RouteSearch& search, const RoutePage& page) {
+        if (page.limit <= 0) {
+            return searchRoutes(search);
+        }
+        vector<string> partitions;
+        if (!partitionsAfter(search.date.empty() ? QueryBind(INT64_MIN) : dateBind(search.date), partitions)) {
+            return nullptr;
+        }
+        vector<QueryBind> binds;
+        string query = buildSelectRoutesPageQuery(search, !page.cursor.empty(), binds, partitions);
+        return pageStatement(query, DepartureSortKey, binds, page);
+    }
+
+    // cursor returns cursor of the current row of a page statement, the next page
+    // starts right after this row
+    string cursor(sqlite3_stmt* stmt) const {
+        auto it = sortKeys.find(stmt);
+        string payload = to_string(sqlite3_column_int64(stmt, 0)) + ":";
+        int key = it == sortKeys.end() ? NoSortKey : it->second;
+        if (key == NoSortKey) {
+            payload += '-';
+        } else if (sqlite3_column_type(stmt, key) == SQLITE_INTEGER) {
+            payload += 'i' + to_string(sqlite3_column_int64(stmt, key));
+        } else if (sqlite3_column_type(stmt, key) == SQLITE_FLOAT) {
+            char value[32];
+            snprintf(value, sizeof(value), "%.17g", sqlite3_column_double(stmt, key));
+            payload += 'f';
+            payload += value;
+        } else {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, key));
+            payload += 't';
+            payload += text ? text : "";
+        }
+        return encodeBase64URL(payload);
+    }
+
+    // validCursor reports whether cursor was made by `cursor`
+    static bool validCursor(const string& cursor) {
+        string payload;
+        return decodeBase64URL(cursor, payload) && payload.find(':') != string::npos;
+    }
+
+    // insertIfNotExists inserts value into table if value not exists
+    bool insertIfNotExists(const string& query, const string& field) {
+        sqlite3_stmt* stmt = statement(query);
+        if (!stmt || !bindParams(stmt, field, field)) {
+            return false;
+        }
+        return sqlite3_step(stmt) == SQLITE_DONE;
+    }
+
+    // routeAggregate reads aggregates of routes from `sourceId` to `destinationId`
+    // departing on `day` (days since epoch) of `transportType`, or of every type
+    // when it is empty. It reads a row per transport type, never routes
+    bool routeAggregate(int64_t sourceId, int64_t destinationId, int64_t day, const string& transportType,
+                        RouteAggregate& aggregate) {
+        aggregate = RouteAggregate();
+        sqlite3_stmt* stmt = statement(transportType.empty() ? SelectRouteAggregatesQuery
+                                                             : SelectRouteAggregatesByTransportQuery);
+        if (!stmt || !(transportType.empty() ? bindParams(stmt, sourceId, destinationId, day)
+                                              : bindParams(stmt, sourceId, destinationId, day, transportType))) {
+            return false;
+        }
+        RouteAggregateRow row;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            RouteAggregateColumns::read(stmt, row);
+            aggregate.routes += row.routes;
+            aggregate.availableRoutes += row.availableRoutes;
+            aggregate.seats += row.seats;
+            if (row.availableRoutes > 0 && (aggregate.minPrice < 0 || row.minPrice < aggregate.minPrice)) {
+                aggregate.minPrice = row.minPrice;
+            }
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // fareCalendar reads the cheapest fare and number of routes with available
+    // seats from `sourceId` to `destinationId` for every day from `firstDay` to
+    // `lastDay` of `transportType`, or of every type when it is empty. Days
+    // without routes are in `days` too. It is one query for the whole range
+    bool fareCalendar(int64_t sourceId, int64_t destinationId, int64_t firstDay, int64_t lastDay,
+                      const string& transportType, vector<FareDay>& days) {
+        days.assign(size_t(max<int64_t>(0, lastDay - firstDay + 1)), FareDay());
+        for (size_t i = 0; i < days.size(); ++i) {
+            days[i].day = firstDay + int64_t(i);
+        }
+        sqlite3_stmt* stmt = statement(transportType.empty() ? SelectFareCalendarQuery
+                                                             : SelectFareCalendarByTransportQuery);
+        if (!stmt || !(transportType.empty()
+                           ? bindParams(stmt, sourceId, destinationId, firstDay, lastDay)
+                           : bindParams(stmt, sourceId, destinationId, firstDay, lastDay, transportType))) {
+            return false;
+        }
+        FareDayRow row;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            FareDayColumns::read(stmt, row);
+            FareDay& day = days[size_t(row.day - firstDay)];
+            day.availableRoutes += row.availableRoutes;
+            if (row.availableRoutes > 0 && (day.minPrice < 0 || row.minPrice < day.minPrice)) {
+                day.minPrice = row.minPrice;
+            }
+        }
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    // insertRoute inserts a new route
+    bool insertRoute(const NewRoute& route) {
+        // Insert specified transport_type, source and destination cities
+        // if they are not exists in corresponding tables
+        if (!insertIfNotExists(InsertInTranportTypesIfNotExists, route.transportType) ||
+            !insertIfNotExists(InsertInDestinationsIfNotExists, route.source) ||
+            !insertIfNotExists(InsertInDestinationsIfNotExists, route.destination)) {
+            return false;
+        }
+        sqlite3_stmt* stmt = statement(InsertRouteQuery);
+        if (!stmt || !bindParams(stmt, route.flight, route.transportType, route.source, route.destination,
+                                 route.distance, route.departure, route.arrival, route.seats, route.priceCents)) {
+            return false;
+        }
+        return sqlite3_step(stmt) == SQLITE_DONE;
+    }
+
+    // execute runs a statement without parameters and result rows, e.g. "BEGIN"
+    bool execute(const string& query) {
+        sqlite3_stmt* stmt = statement(query);
+        return stmt && sqlite3_step(stmt) == SQLITE_DONE;
+    }
+
+    // Number of sqlite3_prepare_v2 calls and number of cached statement reuses
+    long prepares() const {
+        return prepareCalls;
+    }
+
+    long reuses() const {
+        return reuseHits;
+    }
+
+private:
+    RouteRepository(const RouteRepository&) = delete;
+    RouteRepository& operator=(const RouteRepository&) = delete;
+
+    // prepareAll prepares every static query once at startup. With `checkColumns`
+    // result columns of every query selecting routes are compared with its mapper,
+    // so a query edited out of step with Route fails here instead of decoding garbage
+    bool prepareAll(bool checkColumns) {
+        const string* queries[] = {
+            &SelectAllRoutesQuery,
+            &SelectAllAvaliableRoutesQuery,
+            &SelectRoutesByTransportTypeQuery,
+            &SelectRoutesByDestinationQuery,
+            &SelectRoutesByDestinationIdQuery,
+            &SelectRoutesByTicketPriceQuery,
+            &InsertRouteQuery,
+            &InsertInTranportTypesIfNotExists,
+            &InsertInDestinationsIfNotExists,
+        };
+        for (const string* query : queries) {
+            if (statements.count(*query) == 0 && !statement(*query)) {
+                return false;
+            }
+        }
+        vector<string> routeQueries = {
+            SelectAllRoutesQuery, SelectAllAvaliableRoutesQuery, SelectRoutesByTransportTypeQuery,
+            SelectRoutesByDestinationQuery, SelectRoutesByTicketPriceQuery, SelectRouteByIdQuery,
+            SelectAllRoutesFirstPageQuery, SelectAllRoutesNextPageQuery, SelectAllAvaliableRoutesFirstPageQuery,
+            SelectAllAvaliableRoutesNextPageQuery, SelectRoutesByTransportTypeFirstPageQuery,
+            SelectRoutesByTransportTypeNextPageQuery, SelectRoutesByDestinationFirstPageQuery,
+            SelectRoutesByDestinationNextPageQuery, SelectRoutesByTicketPriceFirstPageQuery,
+            SelectRoutesByTicketPriceNextPageQuery, SelectRoutesByDestinationIdQuery,
+            SelectRoutesByDestinationIdFirstPageQuery, SelectRoutesByDestinationIdNextPageQuery};
+        // Every combination of search filters and its pages
+        vector<QueryBind> binds;
+        for (const RouteSearch& search : searchCombinations()) {
+            const string query = buildSelectRoutesQuery(search, binds);
+            if (!statement(query)) {
+                return false;
+            }
+            routeQueries.push_back(query);
+            routeQueries.push_back(buildSelectRoutesPageQuery(search, false, binds));
+            routeQueries.push_back(buildSelectRoutesPageQuery(search, true, binds));
+        }
+        if (!checkColumns) {
+            return true;
+        }
+        for (const string& query : routeQueries) {
+            if (!checkMapper<RouteColumns>(query)) {
+                return false;
+            }
+        }
+        return checkMapper<KeyedRouteColumns>(SelectRouteColumnsQuery) &&
+            checkMapper<KeyedRouteColumns>(SelectRouteColumnsByIdQuery) &&
+            checkMapper<KeyedRouteColumns>(SelectUpcomingRouteColumnsQuery) &&
+            checkMapper<KeyedRouteColumns>(SelectRouteColumnsAfterIdQuery) &&
+            checkMapper<ConnectionColumns>(SelectConnectionsQuery) &&
+            checkMapper<ConnectionColumns>(SelectConnectionByIdQuery) &&
+            checkMapper<CityColumns>(SelectDestinationsAfterQuery) &&
+            checkMapper<RouteAggregateColumns>(SelectRouteAggregatesQuery) &&
+            checkMapper<RouteAggregateColumns>(SelectRouteAggregatesByTransportQuery) &&
+            checkMapper<FareDayColumns>(SelectFareCalendarQuery) &&
+            checkMapper<FareDayColumns>(SelectFareCalendarByTransportQuery) &&
+            checkMapper<PartitionColumns>(SelectPartitionsQuery) &&
+            checkMapper<PartitionColumns>(SelectPartitionQuery);
+    }
+
+    // checkMapper prepares the query and compares its result columns with `Mapper`
+    template <typename Mapper>
+    bool checkMapper(const string& query) {
+        sqlite3_stmt* stmt = statement(query);
+        if (!stmt) {
+            return false;
+        }
+        string error;
+        if (!Mapper::check(stmt, error)) {
+            mappingError = error + " in query:" + query;
+            return false;
+        }
+        return true;
+    }
+
+    // routesPage is pageStatement of a list reading all partitions besides routes
+    sqlite3_stmt* routesPage(const string& query, int sortKey, const vector<QueryBind>& binds, const RoutePage& page) {
+        vector<string> partitions;
+        if (!partitionsAfter(INT64_MIN, partitions)) {
+            return nullptr;
+        }
+        return pageStatement(routesFromPartitions(query, partitions), sortKey, binds, page);
+    }
+
+    // pageStatement binds filters, then sort key and id of the cursor row and limit
+    sqlite3_stmt* pageStatement(const string& query, int sortKey, const vector<QueryBind>& binds, const RoutePage& page) {
+        sqlite3_stmt* stmt = statement(query);
+        if (!stmt) {
+            return nullptr;
+        }
+        sortKeys[stmt] = sortKey;
+        int index = 1;
+        for (const QueryBind& value : binds) {
+            if (!bindValue(stmt, index++, value)) {
+                return nullptr;
+            }
+        }
+        if (!page.cursor.empty()) {
+            string payload;
+            size_t colon;
+            if (!decodeBase64URL(page.cursor, payload) || (colon = payload.find(':')) == string::npos ||
+                colon + 1 >= payload.size() || (sortKey == NoSortKey) != (payload[colon + 1] == '-')) {
+                return nullptr;
+            }
+            const string value = payload.substr(colon + 2);
+            int rc = SQLITE_OK;
+            switch (payload[colon + 1]) {
+                case '-': break;
+                case 'i': rc = sqlite3_bind_int64(stmt, index++, strtoll(value.c_str(), nullptr, 10)); break;
+                case 'f': rc = sqlite3_bind_double(stmt, index++, strtod(value.c_str(), nullptr)); break;
+                case 't': rc = bindText(stmt, index++, value) ? SQLITE_OK : SQLITE_ERROR; break;
+                default: return nullptr;
+            }
+            if (rc != SQLITE_OK ||
+                sqlite3_bind_int64(stmt, index++, strtoll(payload.c_str(), nullptr, 10)) != SQLITE_OK) {
+                return nullptr;
+            }
+        }
+        if (sqlite3_bind_int(stmt, index, page.limit) != SQLITE_OK) {
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    static string encodeBase64URL(const string& data) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        string out;
+        unsigned value = 0;
+        int bits = 0;
+        for (unsigned char c : data) {
+            value = (value << 8) | c;
+            bits += 8;
+            while (bits >= 6) {
+                bits -= 6;
+                out += alphabet[(value >> bits) & 0x3F];
+            }
+        }
+        if (bits > 0) {
+            out += alphabet[(value << (6 - bits)) & 0x3F];
+        }
+        return out;
+    }
+
+    static bool decodeBase64URL(const string& text, string& data) {
+        data.clear();
+        unsigned value = 0;
+        int bits = 0;
+        for (char c : text) {
+            int digit;
+            if (c >= 'A' && c <= 'Z') {
+                digit = c - 'A';
+            } else if (c >= 'a' && c <= 'z') {
+                digit = c - 'a' + 26;
+            } else if (c >= '0' && c <= '9') {
+                digit = c - '0' + 52;
+            } else if (c == '-' || c == '_') {
+                digit = c == '-' ? 62 : 63;
+            } else {
+                return false;
+            }
+            value = (value << 6) | digit;
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                data += char((value >> bits) & 0xFF);
+            }
+        }
+        return !data.empty();
+    }
+
+    // bindText binds a copy of value, so temporaries may be passed
+    static bool bindText(sqlite3_stmt* stmt, int index, const string& value) {
+        return sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_TRANSIENT) == SQLITE_OK;
+    }
+
+    static bool bindValue(sqlite3_stmt* stmt, int index, const QueryBind& value) {
+        if (value.integer) {
+            return sqlite3_bind_int64(stmt, index, value.number) == SQLITE_OK;
+        }
+        return bindText(stmt, index, value.text);
+    }
+
+    sqlite3* db;
+    string mappingError;
+    unordered_map<string, sqlite3_stmt*> statements;
+    unordered_map<sqlite3_stmt*, int> sortKeys; // sort key column of page statements
+    long prepareCalls;
+    long reuseHits;
+};
@@ -0,0 +1,172 @@
+#pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "server.cpp"
+using namespace std;
+
+// LoadOptions configures the bundled load generator
+struct LoadOptions {
+    int port = 8080;
+    int connections = 8;
+    int requests = 1000;   // per connection
+    int insertEvery = 0;   // every N-th request of a connection is an insert, 0 disables inserts
+    long bookRoute = 0;    // every request books a seat of this route, all connections contend for it
+};
+
+// defaultLoadTargets is a mix of read requests against the seed data
+inline vector<string> defaultLoadTargets() {
+    return {
+        "/routes",
+        "/routes/available",
+        "/routes/destination?name=" + urlEncode("Санкт-Петербург"),
+        "/routes/transport?name=" + urlEncode("Поезд"),
+        "/routes/price?max=3000",
+        "/routes/search?date=2024-11-01&source=" + urlEncode("Москва"),
+        "/routes/search?date=2024-11-01&destination=" + urlEncode("Сочи") + "&price=5000",
+    };
+}
+
+// LoadClient is a keep-alive HTTP client connection
+class LoadClient {
+public:
+    LoadClient() : fd(-1) {}
+
+    ~LoadClient() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool connectTo(int port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+
+    // roundTrip sends request and reads the whole response, returns its status or -1
+    int roundTrip(const string& method, const string& target, const string& body) {
+        string request = method + " " + target + " HTTP/1.1\r\nHost: localhost\r\n";
+        if (!body.empty()) {
+            request += "Content-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n";
+        }
+        request += "\r\n" + body;
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())) {
+            return -1;
+        }
+        char chunk[16 * 1024];
+        size_t headerEnd = string::npos;
+        size_t total = 0;
+        while (headerEnd == string::npos || buffer.size() < total) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                return -1;
+            }
+            buffer.append(chunk, received);
+            if (headerEnd == string::npos && (headerEnd = buffer.find("\r\n\r\n")) != string::npos) {
+                size_t length = buffer.find("Content-Length: ");
+                if (length == string::npos || length > headerEnd) {
+                    return -1;
+                }
+                total = headerEnd + 4 + strtoul(buffer.c_str() + length + 16, nullptr, 10);
+            }
+        }
+        int status = atoi(buffer.c_str() + 9);
+        buffer.erase(0, total);
+        return status;
+    }
+
+private:
+    int fd;
+    string buffer;
+};
+
+// runLoadGenerator drives the server from `connections` threads and prints
+// throughput and latency percentiles
+inline bool runLoadGenerator(const LoadOptions& options) {
+    vector<string> targets = defaultLoadTargets();
+    mutex resultsGuard;
+    vector<double> latencies;
+    atomic<long> errors(0);
+    atomic<long> soldOut(0);
+    const string booking = "{\"route_ids\":[" + to_string(options.bookRoute) + "],\"seats\":1}";
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c] {
+            LoadClient client;
+            if (!client.connectTo(options.port)) {
+                errors += options.requests;
+                return;
+            }
+            vector<double> local;
+            local.reserve(options.requests);
+            for (int i = 0; i < options.requests; ++i) {
+                auto sent = chrono::steady_clock::now();
+                int status;
+                if (options.bookRoute > 0) {
+                    status = client.roundTrip("POST", "/bookings", booking);
+                    // A sold out route is a valid answer
+                    if (status == 409) {
+                        ++soldOut;
+                        status = 200;
+                    }
+                } else if (options.insertEvery > 0 && i % options.insertEvery == options.insertEvery - 1) {
+                    string body = "{\"flight\":\"LOAD" + to_string(c) + "-" + to_string(i) +
+                        "\",\"source\":\"Москва\",\"destination\":\"Казань\","
+                        "\"departure_time\":\"2024-12-01 10:00:00\",\"arrival_time\":\"2024-12-01 12:00:00\","
+                        "\"transport\":\"Поезд\",\"ticket_price\":1000,\"distance\":800,\"seats_available\":100}";
+                    status = client.roundTrip("POST", "/routes", body);
+                } else {
+                    status = client.roundTrip("GET", targets[(c + i) % targets.size()], "");
+                }
+                if (status < 200 || status >= 300) {
+                    ++errors;
+                    if (status < 0) {
+                        return;
+                    }
+                    continue;
+                }
+                local.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+            }
+            lock_guard<mutex> lock(resultsGuard);
+            latencies.insert(latencies.end(), local.begin(), local.end());
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+    cout << "Requests: " << latencies.size() << ", errors: " << errors << "\n";
+    if (options.bookRoute > 0) {
+        cout << "Bookings: " << latencies.size() - soldOut << " booked, " << soldOut << " sold out\n";
+    }
+    cout << fixed << setprecision(0);
+    cout << "Throughput: " << latencies.size() / seconds << " req/s\n";
+    cout << setprecision(1);
+    cout << "Latency us: p50 " << percentile(0.5) << ", p90 " << percentile(0.9)
+         << ", p99 " << percentile(0.99) << ", max " << percentile(1.0) << "\n";
+    return errors == 0;
+}
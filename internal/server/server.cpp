@@ -0,0 +1,1412 @@
+#pragma once
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "repository.cpp"
+#include "booking.cpp"
+#include "cache.cpp"
+#include "board.cpp"
+#include "cities.cpp"
+#include "columnar.cpp"
+#include "importer.cpp"
+#include "render.cpp"
+#include "metrics.cpp"
+#include "deadline.cpp"
+using namespace std;
+
+// HttpRequest is a parsed HTTP request
+struct HttpRequest {
+    string method;
+    string path;
+    unordered_map<string, string> params;
+    string body;
+    bool keepAlive = true;
+};
+
+// HttpResponse is a response of the server, JSON but for metrics
+struct HttpResponse {
+    int status = 200;
+    string body;
+    const char* contentType = "application/json";
+    string nextCursor; // cursor of the next page of rows, sent as X-Next-Cursor header
+};
+
+// urlDecode decodes percent-encoded query component
+inline string urlDecode(const string& value) {
+    string decoded;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size()) {
+            decoded += char(strtol(value.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+// urlEncode encodes query component
+inline string urlEncode(const string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    string encoded;
+    for (unsigned char c : value) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 15];
+        }
+    }
+    return encoded;
+}
+
+// parseTarget splits request target into path and query parameters
+inline void parseTarget(const string& target, string& path, unordered_map<string, string>& params) {
+    size_t question = target.find('?');
+    path = target.substr(0, question);
+    if (question == string::npos) {
+        return;
+    }
+    string query = target.substr(question + 1);
+    size_t start = 0;
+    while (start <= query.size()) {
+        size_t end = query.find('&', start);
+        if (end == string::npos) {
+            end = query.size();
+        }
+        string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        if (!pair.empty()) {
+            params[urlDecode(pair.substr(0, equals))] =
+                equals == string::npos ? "" : urlDecode(pair.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+}
+
+// parseHttpRequest takes a complete request from the head of `buffer`,
+// returns 0 if more data is needed, -1 on malformed request, 1 on success
+inline int parseHttpRequest(string& buffer, HttpRequest& request) {
+    size_t headerEnd = buffer.find("\r\n\r\n");
+    if (headerEnd == string::npos) {
+        return buffer.size() > 64 * 1024 ? -1 : 0;
+    }
+    size_t lineEnd = buffer.find("\r\n");
+    string line = buffer.substr(0, lineEnd);
+    size_t first = line.find(' ');
+    size_t second = line.find(' ', first + 1);
+    if (first == string::npos || second == string::npos) {
+        return -1;
+    }
+    request = HttpRequest();
+    request.method = line.substr(0, first);
+    parseTarget(line.substr(first + 1, second - first - 1), request.path, request.params);
+    request.keepAlive = line.compare(second + 1, string::npos, "HTTP/1.0") != 0;
+    size_t contentLength = 0;
+    size_t position = lineEnd + 2;
+    while (position < headerEnd) {
+        size_t end = buffer.find("\r\n", position);
+        string header = buffer.substr(position, end - position);
+        position = end + 2;
+        size_t colon = header.find(':');
+        if (colon == string::npos) {
+            continue;
+        }
+        string name = header.substr(0, colon);
+        for (char& c : name) {
+            c = tolower(c);
+        }
+        string value = header.substr(header.find_first_not_of(' ', colon + 1) == string::npos
+            ? header.size() : header.find_first_not_of(' ', colon + 1));
+        for (char& c : value) {
+            c = tolower(c);
+        }
+        if (name == "content-length") {
+            contentLength = strtoul(value.c_str(), nullptr, 10);
+        } else if (name == "connection") {
+            request.keepAlive = value != "close";
+        }
+    }
+    if (contentLength > 1024 * 1024) {
+        return -1;
+    }
+    if (buffer.size() < headerEnd + 4 + contentLength) {
+        return 0;
+    }
+    request.body = buffer.substr(headerEnd + 4, contentLength);
+    buffer.erase(0, headerEnd + 4 + contentLength);
+    return 1;
+}
+
+// serializeHttpResponse renders response with status line and headers
+inline string serializeHttpResponse(const HttpResponse& response, bool keepAlive) {
+    const char* reason = "OK";
+    switch (response.status) {
+        case 201: reason = "Created"; break;
+        case 400: reason = "Bad Request"; break;
+        case 404: reason = "Not Found"; break;
+        case 405: reason = "Method Not Allowed"; break;
+        case 409: reason = "Conflict"; break;
+        case 500: reason = "Internal Server Error"; break;
+        case 503: reason = "Service Unavailable"; break;
+        case 504: reason = "Gateway Timeout"; break;
+    }
+    string out = "HTTP/1.1 " + to_string(response.status) + " " + reason + "\r\n";
+    out += string("Content-Type: ") + response.contentType + "\r\n";
+    out += "Content-Length: " + to_string(response.body.size()) + "\r\n";
+    if (!response.nextCursor.empty()) {
+        out += "X-Next-Cursor: " + response.nextCursor + "\r\n";
+    }
+    out += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    out += response.body;
+    return out;
+}
+
+inline HttpResponse errorResponse(int status, const string& message) {
+    HttpResponse response;
+    response.status = status;
+    response.body = "{\"error\":";
+    appendJSONString(response.body, message);
+    response.body += "}";
+    return response;
+}
+
+// rowsResponse steps the statement and renders all rows as JSON array, see
+// routeCell for `dayFirstDeparture`. A full page also gets the cursor of the next one.
+// The execution is recorded in `metrics` as `name` query, a statement stopped by
+// the deadline of the connection is answered with 504 and no rows
+inline HttpResponse rowsResponse(RouteRepository& repo, sqlite3_stmt* stmt, bool dayFirstDeparture,
+                                 const RoutePage& page = RoutePage(), QueryMetrics* metrics = nullptr,
+                                 const char* name = "") {
+    if (!stmt) {
+        return errorResponse(500, sqlite3_errmsg(repo.handle()));
+    }
+    HttpResponse response;
+    response.body = "[";
+    Route route;
+    QueryTimer timer(stmt);
+    int rc;
+    int rows = 0;
+    while ((rc = timer.step()) == SQLITE_ROW) {
+        if (rows++ > 0) {
+            response.body += ',';
+        }
+        RouteColumns::read(stmt, route);
+        appendRouteJSON(response.body, route, dayFirstDeparture);
+        if (page.limit > 0 && rows == page.limit) {
+            response.nextCursor = repo.cursor(stmt);
+        }
+    }
+    if (rc == SQLITE_INTERRUPT) {
+        sqlite3_reset(stmt);
+        if (metrics) {
+            metrics->record(name, timer);
+            metrics->recordTimeout(name);
+        }
+        return errorResponse(504, "query timed out");
+    }
+    if (rc != SQLITE_DONE) {
+        return errorResponse(500, sqlite3_errmsg(repo.handle()));
+    }
+    if (metrics) {
+        metrics->record(name, timer);
+    }
+    response.body += "]";
+    return response;
+}
+
+// indexResponse renders rows selected by an in-memory index as rowsResponse does
+inline HttpResponse indexResponse(const RouteIndex& index, const function<vector<uint32_t>()>& select,
+                                  bool dayFirstDeparture, QueryMetrics* metrics, const char* name) {
+    auto start = chrono::steady_clock::now();
+    vector<uint32_t> selected = select();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (metrics) {
+        metrics->record(name, nullptr, seconds, selected.size());
+    }
+    HttpResponse response;
+    response.body = "[";
+    for (size_t i = 0; i < selected.size(); ++i) {
+        if (i > 0) {
+            response.body += ',';
+        }
+        appendRouteJSON(response.body, index.route(selected[i]), dayFirstDeparture);
+    }
+    response.body += "]";
+    return response;
+}
+
+inline string param(const HttpRequest& request, const string& name) {
+    auto it = request.params.find(name);
+    return it == request.params.end() ? "" : it->second;
+}
+
+// cachedRowsResponse answers from the cache when the same operation was read at
+// the current data generation, otherwise it runs the query and keeps the result
+inline HttpResponse cachedRowsResponse(RouteRepository& repo, ResultCache* cache, const string& key,
+                                       const function<sqlite3_stmt*()>& query, bool dayFirstDeparture,
+                                       const RoutePage& page, QueryMetrics* metrics, const char* name) {
+    if (!cache || !cache->enabled()) {
+        return rowsResponse(repo, query(), dayFirstDeparture, page, metrics, name);
+    }
+    shared_ptr<const CachedResult> cached;
+    HttpResponse response;
+    if (cache->get(key, cached)) {
+        response.body = cached->body;
+        response.nextCursor = cached->nextCursor;
+        return response;
+    }
+    const uint64_t generation = cache->generation();
+    response = rowsResponse(repo, query(), dayFirstDeparture, page, metrics, name);
+    if (response.status == 200) {
+        cache->put(key, generation, CachedResult{response.body, response.nextCursor});
+    }
+    return response;
+}
+
+// cacheStatsResponse renders counters of the result cache
+inline HttpResponse cacheStatsResponse(ResultCache* cache) {
+    ResultCacheStats stats = cache ? cache->stats() : ResultCacheStats();
+    HttpResponse response;
+    response.body = "{\"hits\":" + to_string(stats.hits) + ",\"misses\":" + to_string(stats.misses) +
+        ",\"evictions\":" + to_string(stats.evictions) + ",\"invalidations\":" + to_string(stats.invalidations) +
+        ",\"generation\":" + to_string(stats.generation) + ",\"entries\":" + to_string(stats.entries) +
+        ",\"bytes\":" + to_string(stats.bytes) + ",\"capacity\":" + to_string(stats.capacity) + "}";
+    return response;
+}
+
+// metricsResponse renders query metrics in Prometheus text format
+inline HttpResponse metricsResponse(QueryMetrics* metrics) {
+    HttpResponse response;
+    response.contentType = "text/plain; version=0.0.4";
+    if (metrics) {
+        metrics->writePrometheus(response.body);
+    }
+    return response;
+}
+
+// citiesResponse completes a prefix of a city name: GET /cities?prefix=P&limit=N
+inline HttpResponse citiesResponse(const CityIndex& cities, const HttpRequest& request) {
+    string limit = param(request, "limit");
+    if (!limit.empty() && (limit.find_first_not_of("0123456789") != string::npos || limit.size() > 4)) {
+        return errorResponse(400, "invalid limit");
+    }
+    HttpResponse response;
+    response.body = "[";
+    for (const City& city : cities.complete(param(request, "prefix"), limit.empty() ? 10 : atoi(limit.c_str()))) {
+        if (response.body.size() > 1) {
+            response.body += ',';
+        }
+        response.body += "{\"id\":";
+        appendInteger(response.body, city.id);
+        response.body += ",\"name\":";
+        appendJSONString(response.body, city.name);
+        response.body += '}';
+    }
+    response.body += "]";
+    return response;
+}
+
+// resolveCity replaces a typed city name with the name of its city, the id is 0
+// if the name resolves to none and is searched as it is
+inline int64_t resolveCity(const CityIndex* cities, string& name) {
+    City city;
+    if (!cities || name.empty() || !cities->resolve(name, city)) {
+        return 0;
+    }
+    name = city.name;
+    return city.id;
+}
+
+// aggregateResponse answers GET /routes/aggregate?source=S&destination=D&date=DAY&transport=T
+// from route aggregates, transport is optional
+inline HttpResponse aggregateResponse(RouteRepository& repo, const HttpRequest& request, QueryMetrics* metrics,
+                                      const CityIndex* cities) {
+    string source = param(request, "source");
+    string destination = param(request, "destination");
+    string date = param(request, "date");
+    int64_t departure;
+    if (!RouteImporter::normalizeDate(date) || !parseSQLiteTime(date, departure)) {
+        return errorResponse(400, "invalid date format");
+    }
+    int64_t sourceId = resolveCity(cities, source);
+    int64_t destinationId = resolveCity(cities, destination);
+    RouteAggregate aggregate;
+    auto start = chrono::steady_clock::now();
+    if (!repo.routeAggregate(sourceId, destinationId, departure / 86400, param(request, "transport"), aggregate)) {
+        return errorResponse(500, repo.error());
+    }
+    if (metrics) {
+        metrics->record("route_aggregate", nullptr,
+                        chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1);
+    }
+    HttpResponse response;
+    response.body = "{\"routes\":" + to_string(aggregate.routes) + ",\"available_routes\":" +
+        to_string(aggregate.availableRoutes) + ",\"seats_available\":" + to_string(aggregate.seats) +
+        ",\"min_price\":" + (aggregate.minPrice < 0 ? "null" : formatCents(aggregate.minPrice)) + "}";
+    return response;
+}
+
+// calendarResponse answers GET /routes/calendar?source=S&destination=D&from=DAY&to=DAY&transport=T
+// with the cheapest fare and number of routes with available seats of every
+// day, `to` defaults to 30 days from `from` and transport is optional
+inline HttpResponse calendarResponse(RouteRepository& repo, const HttpRequest& request, QueryMetrics* metrics,
+                                     const CityIndex* cities) {
+    string source = param(request, "source");
+    string destination = param(request, "destination");
+    string from = param(request, "from");
+    string to = param(request, "to");
+    int64_t first, last;
+    if (!RouteImporter::normalizeDate(from) || !parseSQLiteTime(from, first) ||
+        (!to.empty() && (!RouteImporter::normalizeDate(to) || !parseSQLiteTime(to, last)))) {
+        return errorResponse(400, "invalid date format");
+    }
+    if (to.empty()) {
+        last = first + 29 * 86400;
+    }
+    if (last < first || last - first >= 366 * 86400) {
+        return errorResponse(400, "invalid date range");
+    }
+    int64_t sourceId = resolveCity(cities, source);
+    int64_t destinationId = resolveCity(cities, destination);
+    vector<FareDay> days;
+    auto start = chrono::steady_clock::now();
+    if (!repo.fareCalendar(sourceId, destinationId, first / 86400, last / 86400, param(request, "transport"), days)) {
+        return errorResponse(500, repo.error());
+    }
+    if (metrics) {
+        metrics->record("fare_calendar", nullptr,
+                        chrono::duration<double>(chrono::steady_clock::now() - start).count(), days.size());
+    }
+    HttpResponse response;
+    response.body = "[";
+    for (const FareDay& day : days) {
+        if (response.body.size() > 1) {
+            response.body += ',';
+        }
+        response.body += "{\"date\":\"" + formatSQLiteTime(day.day * 86400).substr(0, 10) +
+            "\",\"available_routes\":" + to_string(day.availableRoutes) +
+            ",\"min_price\":" + (day.minPrice < 0 ? "null" : formatCents(day.minPrice)) + "}";
+    }
+    response.body += "]";
+    return response;
+}
+
+// boardLimit parses `limit` of the departure board, 10 routes by default
+inline bool boardLimit(const HttpRequest& request, size_t& limit) {
+    string value = param(request, "limit");
+    if (!value.empty() && (value.find_first_not_of("0123456789") != string::npos || value.size() > 4)) {
+        return false;
+    }
+    limit = value.empty() ? 10 : atoi(value.c_str());
+    return true;
+}
+
+// boardResponse answers GET /board?source=S&limit=N&after=TIME with the next
+// departures from a city at or after the time from the departure board without
+// reading the database. The board holds only routes that have not departed, so
+// `after` earlier than now, or none, means now: a past time gets the same
+// departures as the current one, not departed routes
+inline HttpResponse boardResponse(const DepartureBoard& board, const HttpRequest& request, QueryMetrics* metrics,
+                                  const CityIndex* cities) {
+    string source = param(request, "source");
+    string after = param(request, "after");
+    size_t limit = 0;
+    int64_t from = time(nullptr);
+    if (!boardLimit(request, limit)) {
+        return errorResponse(400, "invalid limit");
+    }
+    if (!after.empty() && (!RouteImporter::normalizeDate(after) || !parseSQLiteTime(after, from))) {
+        return errorResponse(400, "invalid date format");
+    }
+    int64_t sourceId = resolveCity(cities, source);
+    if (sourceId == 0) {
+        return errorResponse(404, "unknown city");
+    }
+    auto start = chrono::steady_clock::now();
+    HttpResponse response;
+    // Routes before now may still wait for removal by the board thread
+    const size_t rows = board.next(sourceId, max(from, int64_t(time(nullptr))), limit, response.body);
+    if (metrics) {
+        metrics->record("departure_board", nullptr,
+                        chrono::duration<double>(chrono::steady_clock::now() - start).count(), rows);
+    }
+    return response;
+}
+
+// priceKey normalizes a price for cache keys as it is bound, so "3000" and
+// "3000.0" share a result
+inline string priceKey(const string& price) {
+    int64_t cents;
+    return parseCents(price, cents) ? to_string(cents) : price;
+}
+
+// handleReadRequest answers GET requests, it runs on a worker's read connection.
+// Results are cached by the operation and its normalized parameters, queries
+// that run are recorded in `metrics`. With `index` lists are answered from it
+// instead and the connection is not used, pages are not supported then.
+// City names are resolved by `cities` and next departures are read from
+// `board` when they are given
+inline HttpResponse handleReadRequest(RouteRepository& repo, const HttpRequest& request, ResultCache* cache = nullptr,
+                                      QueryMetrics* metrics = nullptr, const RouteIndex* index = nullptr,
+                                      const CityIndex* cities = nullptr, const DepartureBoard* board = nullptr) {
+    if (request.method != "GET") {
+        return errorResponse(405, "method not allowed");
+    }
+    if (request.path == "/cache") {
+        return cacheStatsResponse(cache);
+    }
+    if (request.path == "/metrics") {
+        return metricsResponse(metrics);
+    }
+    if (request.path == "/cities") {
+        return cities ? citiesResponse(*cities, request) : errorResponse(404, "not found");
+    }
+    if (request.path == "/routes/aggregate") {
+        return index ? errorResponse(400, "aggregates are not supported by a snapshot")
+                     : aggregateResponse(repo, request, metrics, cities);
+    }
+    if (request.path == "/routes/calendar") {
+        return index ? errorResponse(400, "aggregates are not supported by a snapshot")
+                     : calendarResponse(repo, request, metrics, cities);
+    }
+    if (request.path == "/board" || request.path == "/board/stream") {
+        if (index) {
+            return errorResponse(400, "departure board is not supported by a snapshot");
+        }
+        return board && request.path == "/board" ? boardResponse(*board, request, metrics, cities)
+                                                 : errorResponse(404, "not found");
+    }
+    // Every list takes `limit` and `cursor` from X-Next-Cursor of the previous page
+    RoutePage page;
+    string limit = param(request, "limit");
+    page.cursor = param(request, "cursor");
+    if (!limit.empty() && (limit.find_first_not_of("0123456789") != string::npos || limit.size() > 9)) {
+        return errorResponse(400, "invalid limit");
+    }
+    page.limit = atoi(limit.c_str());
+    if (!page.cursor.empty() && (page.limit <= 0 || !RouteRepository::validCursor(page.cursor))) {
+        return errorResponse(400, "invalid cursor");
+    }
+    if (index && page.limit > 0) {
+        return errorResponse(400, "pages are not supported by a snapshot");
+    }
+    // Values are prefixed by their length, so no value can imitate a separator
+    string key = request.path;
+    auto addKey = [&key](const string& value) {
+        key += ' ' + to_string(value.size()) + ':' + value;
+    };
+    addKey(to_string(page.limit));
+    addKey(page.cursor);
+    function<sqlite3_stmt*()> query;
+    function<vector<uint32_t>()> select;
+    // Names of queries are the ones of the console, pages are other queries
+    const bool paged = page.limit > 0;
+    const char* queryName;
+    // Departure is printed day first by every list but all routes
+    bool dayFirstDeparture = true;
+    if (request.path == "/routes") {
+        dayFirstDeparture = false;
+        queryName = paged ? "all_routes_page" : "all_routes";
+        query = [&] { return repo.allRoutes(page); };
+        select = [index] { return index->allRoutes(false); };
+    } else if (request.path == "/routes/available") {
+        dayFirstDeparture = false;
+        queryName = paged ? "available_routes_page" : "available_routes";
+        query = [&] { return repo.allAvaliableRoutes(page); };
+        select = [index] { return index->allRoutes(true); };
+    } else if (request.path == "/routes/destination") {
+        string name = param(request, "name");
+        int64_t destinationId = resolveCity(cities, name);
+        addKey(name);
+        queryName = paged ? "routes_by_destination_page" : "routes_by_destination";
+        query = [&repo, name, &page, destinationId] { return repo.routesByDestination(name, page, destinationId); };
+        select = [index, name] { return index->routesByDestination(name); };
+    } else if (request.path == "/routes/transport") {
+        string name = param(request, "name");
+        addKey(name);
+        queryName = paged ? "routes_by_transport_page" : "routes_by_transport";
+        query = [&repo, name, &page] { return repo.routesByTransport(name, page); };
+        select = [index, name] { return index->routesByTransport(name); };
+    } else if (request.path == "/routes/price") {
+        string price = param(request, "max");
+        if (!RouteImporter::isNumber(price)) {
+            return errorResponse(400, "invalid price");
+        }
+        addKey(priceKey(price));
+        queryName = paged ? "routes_by_price_page" : "routes_by_price";
+        query = [&repo, price, &page] { return repo.routesByPrice(price, page); };
+        select = [index, price] { return index->routesByPrice(price); };
+    } else if (request.path == "/routes/search") {
+        RouteSearch search;
+        search.date = param(request, "date");
+        search.source = param(request, "source");
+        search.destination = param(request, "destination");
+        search.transportType = param(request, "transport");
+        search.ticketPrice = param(request, "price");
+        if (!search.date.empty() && !RouteImporter::normalizeDate(search.date)) {
+            return errorResponse(400, "invalid date format");
+        }
+        if (!search.ticketPrice.empty() && !RouteImporter::isNumber(search.ticketPrice)) {
+            return errorResponse(400, "invalid price");
+        }
+        search.sourceId = resolveCity(cities, search.source);
+        search.destinationId = resolveCity(cities, search.destination);
+        addKey(search.date);
+        addKey(search.source);
+        addKey(search.destination);
+        addKey(search.transportType);
+        addKey(search.ticketPrice.empty() ? "" : priceKey(search.ticketPrice));
+        queryName = paged ? "search_routes_page" : "search_routes";
+        query = [&repo, search, &page] { return repo.searchRoutes(search, page); };
+        select = [index, search] { return index->search(search); };
+    } else {
+        return errorResponse(404, "not found");
+    }
+    if (index) {
+        return indexResponse(*index, select, dayFirstDeparture, metrics, queryName);
+    }
+    return cachedRowsResponse(repo, cache, key, query, dayFirstDeparture, page, metrics, queryName);
+}
+
+// handleInsertRoute inserts a route from JSON body
+inline HttpResponse handleInsertRoute(RouteRepository& repo, const HttpRequest& request) {
+    RouteRecord record;
+    NewRoute route;
+    string error;
+    if (!RouteImporter::parseJSONRecord(request.body, record, error) ||
+        !RouteImporter::normalizeRecord(record, error)) {
+        return errorResponse(400, error);
+    }
+    RouteImporter::newRoute(record, route);
+    if (!repo.insertRoute(route)) {
+        return errorResponse(500, sqlite3_errmsg(repo.handle()));
+    }
+    HttpResponse response;
+    response.status = 201;
+    response.body = "{\"id\":" + to_string(sqlite3_last_insert_rowid(repo.handle())) + "}";
+    return response;
+}
+
+// bookingResponse renders result of a booking operation
+inline HttpResponse bookingResponse(const BookingResult& result, int status) {
+    switch (result.status) {
+        case BookingStatus::Done: break;
+        case BookingStatus::SoldOut:
+        case BookingStatus::AlreadyCancelled: return errorResponse(409, result.error);
+        case BookingStatus::NotFound: return errorResponse(404, result.error);
+        case BookingStatus::Invalid: return errorResponse(400, result.error);
+        case BookingStatus::Failed: return errorResponse(500, result.error);
+    }
+    HttpResponse response;
+    response.status = status;
+    response.body = "{\"booking_id\":" + to_string(result.bookingId) + ",\"route_ids\":[";
+    for (size_t i = 0; i < result.routeIds.size(); ++i) {
+        response.body += (i > 0 ? "," : "") + to_string(result.routeIds[i]);
+    }
+    response.body += "]}";
+    return response;
+}
+
+// bookingChanged adds legs of a done booking operation to `changed`
+inline const BookingResult& bookingChanged(const BookingResult& result, vector<sqlite3_int64>* changed) {
+    if (changed && result.status == BookingStatus::Done) {
+        changed->insert(changed->end(), result.routeIds.begin(), result.routeIds.end());
+    }
+    return result;
+}
+
+// handleBooking books seats: {"route_ids": [1, 2], "seats": 2}, a single leg may
+// be given as "route_id". Routes whose seats changed are added to `changed`
+inline HttpResponse handleBooking(RouteRepository& repo, const HttpRequest& request,
+                                  vector<sqlite3_int64>* changed = nullptr) {
+    string routes, seats = "1", error;
+    bool parsed = RouteImporter::parseJSONObject(request.body, error, [&](const string& key, const string& value) {
+        if (key == "route_ids" || key == "route_id") {
+            routes = value;
+        } else if (key == "seats") {
+            seats = value;
+        }
+    });
+    vector<sqlite3_int64> routeIds;
+    if (!parsed) {
+        return errorResponse(400, error);
+    }
+    if (!parseRouteIds(routes, routeIds)) {
+        return errorResponse(400, "invalid route_ids");
+    }
+    if (seats.empty() || seats.size() > 9 || seats.find_first_not_of("0123456789") != string::npos) {
+        return errorResponse(400, "invalid seats");
+    }
+    return bookingResponse(bookingChanged(bookSeats(repo, routeIds, atoi(seats.c_str())), changed), 201);
+}
+
+// handleCancelBooking cancels a booking: {"booking_id": 1}, routes whose seats
+// changed are added to `changed`
+inline HttpResponse handleCancelBooking(RouteRepository& repo, const HttpRequest& request,
+                                        vector<sqlite3_int64>* changed = nullptr) {
+    string booking, error;
+    if (!RouteImporter::parseJSONObject(request.body, error, [&booking](const string& key, const string& value) {
+            if (key == "booking_id") {
+                booking = value;
+            }
+        })) {
+        return errorResponse(400, error);
+    }
+    if (booking.empty() || booking.size() > 18 || booking.find_first_not_of("0123456789") != string::npos) {
+        return errorResponse(400, "invalid booking_id");
+    }
+    return bookingResponse(bookingChanged(cancelBooking(repo, strtoll(booking.c_str(), nullptr, 10)), changed), 200);
+}
+
+// handleWriteRequest executes a request changing data, it runs on the single
+// writer connection inside a group commit. Successful writes are recorded in
+// `metrics` without the commit, which is shared by the group. Routes whose
+// seats changed are added to `changed`
+inline HttpResponse handleWriteRequest(RouteRepository& repo, const HttpRequest& request,
+                                       QueryMetrics* metrics = nullptr, vector<sqlite3_int64>* changed = nullptr) {
+    auto start = chrono::steady_clock::now();
+    const char* name = "insert_route";
+    HttpResponse response;
+    if (request.path == "/bookings") {
+        name = "book_seats";
+        response = handleBooking(repo, request, changed);
+    } else if (request.path == "/bookings/cancel") {
+        name = "cancel_booking";
+        response = handleCancelBooking(repo, request, changed);
+    } else {
+        response = handleInsertRoute(repo, request);
+    }
+    if (metrics && response.status < 300) {
+        metrics->record(name, nullptr, chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1);
+    }
+    return response;
+}
+
+// isWriteRequest reports whether request goes to the writer connection
+inline bool isWriteRequest(const HttpRequest& request) {
+    return request.method == "POST" &&
+        (request.path == "/routes" || request.path == "/bookings" || request.path == "/bookings/cancel");
+}
+
+// heavyQueryName returns the query of a read that may scan a large part of
+// routes: a whole list or a search without cities. Pages, searches between
+// cities and other lookups get nullptr
+inline const char* heavyQueryName(const HttpRequest& request) {
+    if (request.method != "GET" || atoi(param(request, "limit").c_str()) > 0) {
+        return nullptr;
+    }
+    if (request.path == "/routes") {
+        return "all_routes";
+    }
+    if (request.path == "/routes/available") {
+        return "available_routes";
+    }
+    if (request.path == "/routes/destination") {
+        return "routes_by_destination";
+    }
+    if (request.path == "/routes/transport") {
+        return "routes_by_transport";
+    }
+    if (request.path == "/routes/price") {
+        return "routes_by_price";
+    }
+    if (request.path == "/routes/search" && param(request, "source").empty() &&
+        param(request, "destination").empty()) {
+        return "search_routes";
+    }
+    return nullptr;
+}
+
+// ServerTask is a parsed request waiting for a worker
+struct ServerTask {
+    uint64_t connection;
+    HttpRequest request;
+    bool heavy = false; // admitted as a heavy query
+};
+
+// TaskQueue is a blocking FIFO shared by the event loop and worker threads
+template <typename T>
+class TaskQueue {
+public:
+    TaskQueue() : closed(false) {}
+
+    void push(T task) {
+        {
+            lock_guard<mutex> lock(guard);
+            tasks.push_back(move(task));
+        }
+        ready.notify_one();
+    }
+
+    // pop waits for a task, returns false when the queue is closed and empty
+    bool pop(T& task) {
+        unique_lock<mutex> lock(guard);
+        ready.wait(lock, [this] { return closed || !tasks.empty(); });
+        if (tasks.empty()) {
+            return false;
+        }
+        task = move(tasks.front());
+        tasks.pop_front();
+        return true;
+    }
+
+    // popBatch waits for a task and takes up to `limit` queued tasks at once,
+    // returns false when the queue is closed and empty
+    bool popBatch(vector<T>& batch, size_t limit) {
+        batch.clear();
+        unique_lock<mutex> lock(guard);
+        ready.wait(lock, [this] { return closed || !tasks.empty(); });
+        while (!tasks.empty() && batch.size() < limit) {
+            batch.push_back(move(tasks.front()));
+            tasks.pop_front();
+        }
+        return !batch.empty();
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lock(guard);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+private:
+    mutex guard;
+    condition_variable ready;
+    deque<T> tasks;
+    bool closed;
+};
+
+// MaxStreamBuffer is the most unsent bytes of a board subscriber
+const size_t MaxStreamBuffer = 4 << 20;
+
+// serverStopping is set by signal handlers to stop the event loop
+volatile sig_atomic_t serverStopping = 0;
+
+// RouteServer serves route operations over HTTP/JSON on localhost. A single
+// epoll event loop owns all sockets, parsed requests are executed by a fixed
+// pool of workers, each with its own read connection, while inserts and
+// bookings go to a single serialized writer connection. The writer commits
+// every write queued meanwhile in one transaction, so a burst of bookings pays
+// for one fsync instead of one per booking. The database runs in WAL mode, so
+// readers never wait for the writer. Rendered results of reads are cached
+// until the next write. A read-only replica answers lists from an in-memory
+// index such as a mapped snapshot, opens no database and refuses writes.
+// Next departures from a city after a time, never earlier than now, are answered
+// from a departure board in memory, GET /board/stream keeps the connection open
+// and pushes its changes as server-sent events: a board thread adds inserted routes, seats of routes
+// booked by the writer and removes departed routes every second. Seats booked
+// by other processes are not pushed, their inserts are. A read running longer
+// than the timeout is stopped and answered with 504. Heavy reads, see
+// heavyQueryName, take at most `heavy` workers at once, so the others stay free
+// for cheap lookups: more of them wait in a bounded queue of the event loop and
+// the rest are refused with 503
+class RouteServer {
+public:
+    // batch is the most writes committed together, 1 commits every write on its own,
+    // cacheBytes bounds the result cache, 0 disables it, slowSeconds is the slow
+    // query threshold, 0 disables the slow query log, `index` makes a read-only replica,
+    // timeoutSeconds is the deadline of a read, 0 sets none, `heavy` is the most heavy
+    // reads run at once, 0 or more than workers - 1 leaves one worker for other reads,
+    // and `heavyQueue` the most heavy reads waiting for them. At least 2 workers run,
+    // so a heavy read never takes the only one
+    RouteServer(const string& path, int port, int workers, int batch = 64, size_t cacheBytes = 64 << 20,
+                double slowSeconds = 0, const RouteIndex* index = nullptr, double timeoutSeconds = 0,
+                int heavy = 0, size_t heavyQueue = 64)
+        : path(path), port(port), workers(max(2, workers)), batch(batch > 0 ? batch : 1),
+          cache(cacheBytes), metrics(slowSeconds), index(index), timeoutSeconds(timeoutSeconds),
+          heavyLimit(heavy > 0 ? min(heavy, this->workers - 1) : this->workers - 1), heavyQueue(heavyQueue),
+          heavyRunning(0), writerCommits(0), listenFd(-1), epollFd(-1), wakeFd(-1), nextConnection(1), boardStopping(false) {}
+
+    ~RouteServer() {
+        for (auto& entry : connections) {
+            ::close(entry.first);
+        }
+        if (listenFd >= 0) ::close(listenFd);
+        if (epollFd >= 0) ::close(epollFd);
+        if (wakeFd >= 0) ::close(wakeFd);
+    }
+
+    // run serves requests until SIGINT or SIGTERM
+    bool run() {
+        if ((!index && !prepareDatabase()) || !listenSocket()) {
+            return false;
+        }
+        if (index) {
+            cities.load(*index);
+        }
+        vector<thread> threads;
+        atomic<int> failures(0);
+        for (int i = 0; i < workers; ++i) {
+            threads.emplace_back([this, &failures] { serve(failures); });
+        }
+        if (!index) {
+            threads.emplace_back([this, &failures] { serveWrites(failures); });
+            threads.emplace_back([this, &failures] { serveBoard(failures); });
+        }
+        cout << "Listening on 127.0.0.1:" << port << " with " << workers << " workers\n" << flush;
+        bool ok = eventLoop(failures);
+        readTasks.close();
+        writeTasks.close();
+        {
+            lock_guard<mutex> lock(boardGuard);
+            boardStopping = true;
+        }
+        boardChanged.notify_all();
+        for (thread& t : threads) {
+            t.join();
+        }
+        return ok && failures == 0;
+    }
+
+private:
+    struct Connection {
+        uint64_t id;
+        string in;
+        string out;
+        bool busy = false;
+        bool keepAlive = true;
+        bool writing = false;
+        bool streaming = false; // subscribed to the departure board
+    };
+
+    struct Completion {
+        uint64_t connection;
+        string response;
+        bool keepAlive;
+        bool heavy;
+    };
+
+    // prepareDatabase switches database into WAL mode once, the mode is persistent,
+    // and checks its schema version
+    bool prepareDatabase() {
+        RouteRepository repo;
+        if (!repo.open(path.c_str()) || !repo.configure("PRAGMA journal_mode=WAL;")) {
+            cerr << "error: cannot open database: " << repo.error() << "\n";
+            return false;
+        }
+        if (repo.schemaVersion() < RouteSchemaVersion) {
+            cerr << "error: database schema is outdated, run `main migrate` first\n";
+            return false;
+        }
+        if (!cities.load(repo)) {
+            cerr << "error: cannot load cities: " << repo.error() << "\n";
+            return false;
+        }
+        if (!board.load(repo, time(nullptr))) {
+            cerr << "error: cannot load departure board: " << repo.error() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool listenSocket() {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int enable = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listenFd < 0 ||
+            ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listenFd, SOMAXCONN) != 0) {
+            cerr << "error: cannot listen on port " << port << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        return watch(listenFd, EPOLLIN, EPOLL_CTL_ADD) && watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    bool watch(int fd, uint32_t events, int operation) {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epollFd, operation, fd, &event) == 0;
+    }
+
+    // openConnection opens a connection of a worker, a failure stops the server
+    bool openConnection(RouteRepository& repo, const string& pragmas, atomic<int>& failures) {
+        if (!repo.open(path.c_str()) || !repo.configure(pragmas)) {
+            cerr << "error: cannot open database: " << repo.error() << "\n";
+            ++failures;
+            serverStopping = 1;
+            return false;
+        }
+        return true;
+    }
+
+    // complete hands the response over to the event loop
+    void complete(const ServerTask& task, const HttpResponse& response) {
+        Completion completion{task.connection,
+                              serializeHttpResponse(response, task.request.keepAlive),
+                              task.request.keepAlive, task.heavy};
+        {
+            lock_guard<mutex> lock(completionsGuard);
+            completions.push_back(move(completion));
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // Event loop is woken up by the previous completion anyway
+        }
+    }
+
+    // serve executes read tasks on its own read connection. Writes of other
+    // processes, e.g. an import, are noticed by data_version of the connection
+    // and invalidate the cache as writes of the server do. data_version changes
+    // with commits of the writer too, they have invalidated the cache already, so
+    // a change is only taken for another process when the writer committed
+    // nothing since the last read. Another process committing right after the
+    // writer is noticed with the next commit of either
+    void serve(atomic<int>& failures) {
+        RouteRepository repo;
+        ServerTask task;
+        if (index) {
+            while (readTasks.pop(task)) {
+                complete(task, handleReadRequest(repo, task.request, nullptr, &metrics, index, &cities));
+            }
+            return;
+        }
+        if (!openConnection(repo, "PRAGMA query_only = ON;", failures)) {
+            return;
+        }
+        sqlite3_int64 dataVersion = -1;
+        uint64_t seenCommits = 0;
+        while (readTasks.pop(task)) {
+            // Read before data_version, so a commit in between is taken for another process
+            uint64_t commits = writerCommits.load();
+            sqlite3_stmt* stmt = repo.statement("PRAGMA data_version;");
+            if (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+                sqlite3_int64 version = sqlite3_column_int64(stmt, 0);
+                if (dataVersion >= 0 && version != dataVersion && commits == seenCommits) {
+                    cache.invalidate();
+                }
+                // Writes may add cities, a refresh reads only the new ones
+                if (version != dataVersion && !cities.refresh(repo)) {
+                    cerr << "error: cannot refresh cities: " << repo.error() << "\n";
+                }
+                dataVersion = version;
+            } else {
+                cache.invalidate();
+            }
+            seenCommits = commits;
+            if (stmt) {
+                sqlite3_reset(stmt);
+            }
+            QueryDeadline deadline(repo.handle(), timeoutSeconds);
+            HttpResponse response = handleReadRequest(repo, task.request, &cache, &metrics, nullptr, &cities, &board);
+            // Aggregates report a stopped statement as any failure
+            if (deadline.timedOut() && response.status == 500) {
+                response = errorResponse(504, "query timed out");
+            }
+            complete(task, response);
+        }
+    }
+
+    // serveWrites executes write tasks in group commits: everything queued while
+    // the previous transaction was committing goes into the next one. Every task
+    // runs in its own savepoint, so a rejected booking does not undo the others,
+    // and responses are sent only after the commit is durable
+    void serveWrites(atomic<int>& failures) {
+        RouteRepository repo;
+        if (!openConnection(repo, "PRAGMA busy_timeout = 5000;", failures)) {
+            return;
+        }
+        vector<ServerTask> tasks;
+        vector<HttpResponse> responses;
+        vector<sqlite3_int64> changed;
+        while (writeTasks.popBatch(tasks, batch)) {
+            responses.clear();
+            changed.clear();
+            if (!repo.execute("BEGIN IMMEDIATE;")) {
+                responses.assign(tasks.size(), errorResponse(500, sqlite3_errmsg(repo.handle())));
+            } else {
+                for (const ServerTask& task : tasks) {
+                    if (!repo.execute("SAVEPOINT request;")) {
+                        responses.push_back(errorResponse(500, sqlite3_errmsg(repo.handle())));
+                        continue;
+                    }
+                    responses.push_back(handleWriteRequest(repo, task.request, &metrics, &changed));
+                    if (responses.back().status >= 300) {
+                        repo.execute("ROLLBACK TO request;");
+                    }
+                    repo.execute("RELEASE request;");
+                }
+                if (!repo.execute("COMMIT;")) {
+                    HttpResponse failed = errorResponse(500, sqlite3_errmsg(repo.handle()));
+                    repo.execute("ROLLBACK;");
+                    responses.assign(tasks.size(), failed);
+                    changed.clear();
+                }
+                // Inserts and seat changes are visible now
+                cache.invalidate();
+                ++writerCommits;
+                {
+                    lock_guard<mutex> lock(boardGuard);
+                    boardRoutes.insert(boardRoutes.end(), changed.begin(), changed.end());
+                }
+                boardChanged.notify_one();
+            }
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                complete(tasks[i], responses[i]);
+            }
+        }
+    }
+
+    // serveBoard keeps the departure board up to date on its own read connection
+    // and hands its events over to the event loop. It wakes up every second to
+    // remove departed routes or earlier when the writer commits
+    void serveBoard(atomic<int>& failures) {
+        RouteRepository repo;
+        if (!openConnection(repo, "PRAGMA query_only = ON;", failures)) {
+            return;
+        }
+        sqlite3_int64 dataVersion = -1;
+        vector<sqlite3_int64> changed;
+        vector<BoardEvent> events;
+        unique_lock<mutex> lock(boardGuard);
+        while (!boardStopping) {
+            boardChanged.wait_for(lock, chrono::seconds(1), [this] { return boardStopping || !boardRoutes.empty(); });
+            changed.swap(boardRoutes);
+            lock.unlock();
+            events.clear();
+            // Inserts of the writer and of other processes are read by id
+            sqlite3_stmt* stmt = repo.statement("PRAGMA data_version;");
+            if (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+                sqlite3_int64 version = sqlite3_column_int64(stmt, 0);
+                if (version != dataVersion && !board.refresh(repo, events)) {
+                    cerr << "error: cannot refresh departure board: " << repo.error() << "\n";
+                }
+                dataVersion = version;
+            }
+            if (stmt) {
+                sqlite3_reset(stmt);
+            }
+            if (!changed.empty() && !board.update(repo, changed, events)) {
+                cerr << "error: cannot update departure board: " << repo.error() << "\n";
+            }
+            changed.clear();
+            board.expire(time(nullptr), events);
+            if (!events.empty()) {
+                {
+                    lock_guard<mutex> completionsLock(completionsGuard);
+                    for (BoardEvent& event : events) {
+                        boardEvents.push_back(move(event));
+                    }
+                }
+                uint64_t one = 1;
+                if (write(wakeFd, &one, sizeof(one)) < 0) {
+                    // Event loop is woken up by the previous completion anyway
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    bool eventLoop(atomic<int>& failures) {
+        epoll_event events[256];
+        while (!serverStopping) {
+            int count = epoll_wait(epollFd, events, 256, 200);
+            if (count < 0 && errno != EINTR) {
+                cerr << "error: epoll_wait: " << strerror(errno) << "\n";
+                return false;
+            }
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptConnections();
+                } else if (fd == wakeFd) {
+                    uint64_t value;
+                    while (read(wakeFd, &value, sizeof(value)) > 0) {
+                    }
+                    deliverCompletions();
+                } else {
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        readConnection(fd);
+                    }
+                    if ((events[i].events & EPOLLOUT) && connections.count(fd)) {
+                        writeConnection(fd);
+                    }
+                }
+            }
+        }
+        return failures == 0;
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) {
+                return;
+            }
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            Connection& connection = connections[fd];
+            connection.id = nextConnection++;
+            connectionFds[connection.id] = fd;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void closeConnection(int fd) {
+        auto it = connections.find(fd);
+        if (it != connections.end()) {
+            if (it->second.streaming) {
+                board.unsubscribe(it->second.id);
+            }
+            connectionFds.erase(it->second.id);
+            connections.erase(it);
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+    }
+
+    void readConnection(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
+        }
+        char buffer[16 * 1024];
+        while (true) {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                it->second.in.append(buffer, received);
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            // Peer closed connection or failed, an in-flight response is dropped
+            closeConnection(fd);
+            return;
+        }
+        dispatch(fd);
+    }
+
+    // dispatch sends the next complete request of the connection to a worker,
+    // requests of a connection are executed one by one
+    void dispatch(int fd) {
+        Connection& connection = connections[fd];
+        if (connection.streaming) {
+            connection.in.clear(); // a subscriber sends nothing more
+            return;
+        }
+        if (connection.busy || connection.writing) {
+            return;
+        }
+        ServerTask task;
+        int parsed = parseHttpRequest(connection.in, task.request);
+        if (parsed == 0) {
+            return;
+        }
+        if (parsed < 0) {
+            connection.out = serializeHttpResponse(errorResponse(400, "malformed request"), false);
+            connection.keepAlive = false;
+            writeConnection(fd);
+            return;
+        }
+        if (index && isWriteRequest(task.request)) {
+            connection.out = serializeHttpResponse(errorResponse(405, "snapshot is read-only"), task.request.keepAlive);
+            connection.keepAlive = task.request.keepAlive;
+            writeConnection(fd);
+            return;
+        }
+        if (!index && task.request.method == "GET" && task.request.path == "/board/stream") {
+            subscribe(fd, task.request);
+            return;
+        }
+        const char* heavy = heavyQueryName(task.request);
+        if (heavy && heavyRunning >= heavyLimit && heavyWaiting.size() >= heavyQueue) {
+            metrics.recordShed(heavy);
+            connection.out = serializeHttpResponse(errorResponse(503, "too many heavy queries, retry later"),
+                                                   task.request.keepAlive);
+            connection.keepAlive = task.request.keepAlive;
+            writeConnection(fd);
+            return;
+        }
+        connection.busy = true;
+        connection.keepAlive = task.request.keepAlive;
+        task.connection = connection.id;
+        task.heavy = heavy != nullptr;
+        if (isWriteRequest(task.request)) {
+            writeTasks.push(move(task));
+        } else if (heavy) {
+            heavyWaiting.push_back(move(task));
+            admitHeavy();
+        } else {
+            readTasks.push(move(task));
+        }
+    }
+
+    // admitHeavy hands waiting heavy reads to workers while fewer than the limit
+    // run, reads of closed connections are dropped
+    void admitHeavy() {
+        while (heavyRunning < heavyLimit && !heavyWaiting.empty()) {
+            ServerTask task = move(heavyWaiting.front());
+            heavyWaiting.pop_front();
+            if (connectionFds.count(task.connection)) {
+                ++heavyRunning;
+                readTasks.push(move(task));
+            }
+        }
+    }
+
+    // subscribe answers GET /board/stream?source=S&limit=N on the event loop: the
+    // first N departures from the city are sent as a "board" event and the
+    // connection stays open for their changes
+    void subscribe(int fd, const HttpRequest& request) {
+        Connection& connection = connections[fd];
+        string source = param(request, "source");
+        const int64_t sourceId = resolveCity(&cities, source);
+        size_t limit = 0;
+        HttpResponse error;
+        if (!boardLimit(request, limit)) {
+            error = errorResponse(400, "invalid limit");
+        } else if (sourceId == 0) {
+            error = errorResponse(404, "unknown city");
+        }
+        if (error.status != 200) {
+            connection.out = serializeHttpResponse(error, request.keepAlive);
+            connection.keepAlive = request.keepAlive;
+            writeConnection(fd);
+            return;
+        }
+        connection.streaming = true;
+        connection.out = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                         "Connection: keep-alive\r\n\r\n";
+        connection.out += board.subscribe(connection.id, sourceId, limit);
+        writeConnection(fd);
+    }
+
+    void deliverCompletions() {
+        deque<Completion> ready;
+        deque<BoardEvent> events;
+        {
+            lock_guard<mutex> lock(completionsGuard);
+            ready.swap(completions);
+            events.swap(boardEvents);
+        }
+        for (BoardEvent& event : events) {
+            auto it = connectionFds.find(event.subscriber);
+            if (it == connectionFds.end()) {
+                continue;
+            }
+            const int fd = it->second;
+            Connection& connection = connections[fd];
+            // A subscriber that does not read its events is dropped
+            if (connection.out.size() > MaxStreamBuffer) {
+                closeConnection(fd);
+                continue;
+            }
+            connection.out += event.data;
+            writeConnection(fd);
+        }
+        for (Completion& completion : ready) {
+            if (completion.heavy) {
+                --heavyRunning;
+                admitHeavy();
+            }
+            auto it = connectionFds.find(completion.connection);
+            if (it == connectionFds.end()) {
+                continue; // connection was closed meanwhile
+            }
+            Connection& connection = connections[it->second];
+            connection.busy = false;
+            connection.out += completion.response;
+            connection.keepAlive = completion.keepAlive;
+            writeConnection(it->second);
+        }
+    }
+
+    void writeConnection(int fd) {
+        Connection& connection = connections[fd];
+        while (!connection.out.empty()) {
+            ssize_t sent = send(fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+            if (sent > 0) {
+                connection.out.erase(0, sent);
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!connection.writing) {
+                    connection.writing = true;
+                    watch(fd, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+                }
+                return;
+            }
+            closeConnection(fd);
+            return;
+        }
+        if (connection.writing) {
+            connection.writing = false;
+            watch(fd, EPOLLIN, EPOLL_CTL_MOD);
+        }
+        if (connection.streaming) {
+            return;
+        }
+        if (!connection.keepAlive) {
+            closeConnection(fd);
+            return;
+        }
+        dispatch(fd);
+    }
+
+    string path;
+    int port;
+    int workers;
+    size_t batch;
+    ResultCache cache;
+    QueryMetrics metrics;
+    CityIndex cities;
+    const RouteIndex* index;
+    const double timeoutSeconds;
+    const int heavyLimit;
+    const size_t heavyQueue;
+    int heavyRunning;                // heavy reads handed to workers, owned by the event loop
+    deque<ServerTask> heavyWaiting;  // heavy reads waiting for admission
+    atomic<uint64_t> writerCommits;  // transactions of the writer, the cache is invalidated after each
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    uint64_t nextConnection;
+    unordered_map<int, Connection> connections;
+    unordered_map<uint64_t, int> connectionFds;
+    TaskQueue<ServerTask> readTasks;
+    TaskQueue<ServerTask> writeTasks;
+    mutex completionsGuard;
+    deque<Completion> completions;
+    deque<BoardEvent> boardEvents; // guarded by completionsGuard
+    DepartureBoard board;
+    mutex boardGuard;
+    condition_variable boardChanged;
+    vector<sqlite3_int64> boardRoutes; // routes booked since the board was updated
+    bool boardStopping;
+};
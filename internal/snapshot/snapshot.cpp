@@ -0,0 +1,497 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "columnar.cpp"
+#include "repository.cpp"
+#include "timeutil.cpp"
+using namespace std;
+
+// Snapshot file layout: a SnapshotHeader followed by sections, every section is
+// a fixed-width little-endian array starting at a multiple of 8 bytes. Route
+// columns are indexed by row in id order, names are indexed by their ids through
+// an offset table of ends, and lists are permutations of rows in query order
+const char SnapshotMagic[8] = {'R', 'T', 'S', 'N', 'A', 'P', '\r', '\n'};
+const uint32_t SnapshotVersion = 1;
+const uint32_t SnapshotByteOrder = 0x01020304;
+
+enum SnapshotSection {
+    SnapshotIds,              // int64 per route
+    SnapshotSourceIds,        // int32 per route
+    SnapshotDestinationIds,   // int32 per route
+    SnapshotTransportIds,     // int32 per route
+    SnapshotDepartures,       // int64 per route, epoch seconds
+    SnapshotArrivals,         // int64 per route, epoch seconds
+    SnapshotPrices,           // int32 per route, cents
+    SnapshotSeats,            // int32 per route
+    SnapshotDistances,        // int32 per route
+    SnapshotFlightEnds,       // uint32 per route, end of the flight in SnapshotFlights
+    SnapshotFlights,          // bytes
+    SnapshotCityEnds,         // uint32 per city id, a missing id has an empty name
+    SnapshotCityNames,        // bytes
+    SnapshotCitiesByName,     // int32 ids of named cities sorted by name
+    SnapshotTransportEnds,    // uint32 per transport id
+    SnapshotTransportNames,   // bytes
+    SnapshotTransportsByName, // int32 ids of named transports sorted by name
+    SnapshotByPrice,          // uint32 rows ordered by price, id
+    SnapshotByDeparture,      // uint32 rows ordered by departure, id
+    SnapshotByTransport,      // uint32 rows ordered by transport name, id
+    SnapshotSectionCount,
+};
+
+struct SnapshotSectionEntry {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t routes;
+    uint64_t cities;             // entries of SnapshotCityEnds
+    uint64_t transports;         // entries of SnapshotTransportEnds
+    uint64_t createdAt;          // epoch seconds
+    uint32_t streamWidths[10];   // result of SelectRouteWidthsQuery
+    uint64_t fileBytes;
+    uint64_t checksum;           // fnv1a64 of everything after the header
+    SnapshotSectionEntry sections[SnapshotSectionCount];
+    uint64_t headerChecksum;     // fnv1a64 of the header before this field
+};
+
+// fnv1a64 continues FNV-1a hash `hash` over bytes
+inline uint64_t fnv1a64(const void* data, size_t bytes, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// SnapshotStats describe a written snapshot
+struct SnapshotStats {
+    uint64_t routes = 0;
+    uint64_t bytes = 0;
+    uint64_t checksum = 0;
+    double seconds = 0;
+};
+
+// writeSnapshot exports routes with their names into a snapshot file. The file
+// is written aside and renamed over `path`, so processes that mapped the previous
+// snapshot keep reading it until they reopen
+inline bool writeSnapshot(RouteRepository& repo, const string& path, SnapshotStats& stats, string& error) {
+    auto start = chrono::steady_clock::now();
+    vector<int64_t> ids, departures, arrivals;
+    vector<int32_t> sourceIds, destinationIds, transportIds, prices, seats, distances;
+    vector<uint32_t> flightEnds;
+    string flights;
+    vector<string> cityNames, transportNames;
+    auto addName = [](vector<string>& names, int64_t id, string_view name) {
+        if (names.size() <= size_t(id)) {
+            names.resize(id + 1);
+        }
+        names[id] = name;
+    };
+    sqlite3_stmt* stmt = repo.routesStatement(SelectRouteColumnsQuery);
+    if (!stmt) {
+        error = repo.error();
+        return false;
+    }
+    KeyedRoute route;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        KeyedRouteColumns::read(stmt, route);
+        ids.push_back(route.id);
+        sourceIds.push_back(route.sourceId);
+        destinationIds.push_back(route.destinationId);
+        transportIds.push_back(route.transportId);
+        departures.push_back(route.departure);
+        arrivals.push_back(route.arrival);
+        prices.push_back(route.priceCents);
+        seats.push_back(route.seats);
+        distances.push_back(route.distance);
+        flights.append(route.flight.data(), route.flight.size());
+        flightEnds.push_back(flights.size());
+        addName(cityNames, route.sourceId, route.source);
+        addName(cityNames, route.destinationId, route.destination);
+        addName(transportNames, route.transportId, route.transport);
+    }
+    if (rc != SQLITE_DONE) {
+        error = repo.error();
+        return false;
+    }
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    stmt = repo.routesStatement(SelectRouteWidthsQuery);
+    if (!stmt || sqlite3_step(stmt) != SQLITE_ROW) {
+        error = repo.error();
+        return false;
+    }
+    for (int i = 0; i < 10; ++i) {
+        header.streamWidths[i] = sqlite3_column_int(stmt, i);
+    }
+    sqlite3_reset(stmt);
+
+    // Names are stored by id with an offset table and looked up by binary search
+    auto encodeNames = [](const vector<string>& names, vector<uint32_t>& ends, string& bytes, vector<int32_t>& byName) {
+        for (size_t id = 0; id < names.size(); ++id) {
+            bytes += names[id];
+            ends.push_back(bytes.size());
+            if (!names[id].empty()) {
+                byName.push_back(id);
+            }
+        }
+        sort(byName.begin(), byName.end(), [&names](int32_t a, int32_t b) { return names[a] < names[b]; });
+    };
+    vector<uint32_t> cityEnds, transportEnds;
+    string cityBytes, transportBytes;
+    vector<int32_t> citiesByName, transportsByName;
+    encodeNames(cityNames, cityEnds, cityBytes, citiesByName);
+    encodeNames(transportNames, transportEnds, transportBytes, transportsByName);
+
+    // Permutations are the orders of the SQL queries, as the columnar index sorts them
+    vector<uint32_t> byPrice(ids.size()), byDeparture(ids.size()), byTransport(ids.size());
+    vector<int32_t> transportRanks(transportNames.size(), 0);
+    for (size_t rank = 0; rank < transportsByName.size(); ++rank) {
+        transportRanks[transportsByName[rank]] = rank;
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+        byPrice[i] = byDeparture[i] = byTransport[i] = i;
+    }
+    sort(byPrice.begin(), byPrice.end(), [&](uint32_t a, uint32_t b) {
+        return prices[a] != prices[b] ? prices[a] < prices[b] : ids[a] < ids[b];
+    });
+    sort(byDeparture.begin(), byDeparture.end(), [&](uint32_t a, uint32_t b) {
+        return departures[a] != departures[b] ? departures[a] < departures[b] : ids[a] < ids[b];
+    });
+    sort(byTransport.begin(), byTransport.end(), [&](uint32_t a, uint32_t b) {
+        int32_t rankA = transportRanks[transportIds[a]];
+        int32_t rankB = transportRanks[transportIds[b]];
+        return rankA != rankB ? rankA < rankB : ids[a] < ids[b];
+    });
+
+    const void* data[SnapshotSectionCount] = {
+        ids.data(), sourceIds.data(), destinationIds.data(), transportIds.data(), departures.data(),
+        arrivals.data(), prices.data(), seats.data(), distances.data(), flightEnds.data(), flights.data(),
+        cityEnds.data(), cityBytes.data(), citiesByName.data(), transportEnds.data(), transportBytes.data(),
+        transportsByName.data(), byPrice.data(), byDeparture.data(), byTransport.data()};
+    const size_t n = ids.size();
+    const uint64_t bytes[SnapshotSectionCount] = {
+        8 * n, 4 * n, 4 * n, 4 * n, 8 * n, 8 * n, 4 * n, 4 * n, 4 * n, 4 * n, flights.size(),
+        4 * cityEnds.size(), cityBytes.size(), 4 * citiesByName.size(), 4 * transportEnds.size(),
+        transportBytes.size(), 4 * transportsByName.size(), 4 * n, 4 * n, 4 * n};
+    memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+    header.version = SnapshotVersion;
+    header.byteOrder = SnapshotByteOrder;
+    header.routes = n;
+    header.cities = cityEnds.size();
+    header.transports = transportEnds.size();
+    header.createdAt = time(nullptr);
+    uint64_t offset = sizeof(SnapshotHeader);
+    uint64_t checksum = fnv1a64(nullptr, 0);
+    static const char padding[8] = {0};
+    for (int i = 0; i < SnapshotSectionCount; ++i) {
+        offset = (offset + 7) / 8 * 8;
+        header.sections[i].offset = offset;
+        header.sections[i].bytes = bytes[i];
+        offset += bytes[i];
+    }
+    header.fileBytes = offset;
+
+    const string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file) {
+        error = "cannot create " + temporary;
+        return false;
+    }
+    // Header goes last, once the checksum of sections is known
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t position = sizeof(SnapshotHeader);
+    for (int i = 0; i < SnapshotSectionCount; ++i) {
+        const uint64_t pad = header.sections[i].offset - position;
+        file.write(padding, pad);
+        checksum = fnv1a64(padding, pad, checksum);
+        file.write(static_cast<const char*>(data[i]), bytes[i]);
+        checksum = fnv1a64(data[i], bytes[i], checksum);
+        position = header.sections[i].offset + bytes[i];
+    }
+    header.checksum = checksum;
+    header.headerChecksum = fnv1a64(&header, offsetof(SnapshotHeader, headerChecksum));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file || rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "cannot write " + path;
+        remove(temporary.c_str());
+        return false;
+    }
+    stats.routes = n;
+    stats.bytes = header.fileBytes;
+    stats.checksum = checksum;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// RouteSnapshot answers the searches of ColumnarRouteIndex from a mapped snapshot
+// file. Nothing is parsed or copied on open: columns are read where they lie in
+// the mapping, so startup does not depend on the number of routes and pages of
+// the file are shared by every process mapping it. Opening checks the header
+// and bounds of sections only, verify reads the whole file
+class RouteSnapshot : public RouteIndex {
+public:
+    RouteSnapshot() : data(nullptr), bytes(0), header(nullptr) {}
+
+    ~RouteSnapshot() {
+        close();
+    }
+
+    bool open(const string& path, string& error) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error = "cannot open " + path + ": " + strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        bytes = info.st_size;
+        void* mapped = bytes >= sizeof(SnapshotHeader) ? mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            error = path + " is not a snapshot";
+            bytes = 0;
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+        header = reinterpret_cast<const SnapshotHeader*>(data);
+        if (!checkHeader(error)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap(const_cast<char*>(data), bytes);
+        }
+        data = nullptr;
+        header = nullptr;
+        bytes = 0;
+    }
+
+    // verify compares checksum of the whole file with the one of the header
+    bool verify(string& error) const {
+        if (fnv1a64(data + sizeof(SnapshotHeader), bytes - sizeof(SnapshotHeader)) != header->checksum) {
+            error = "checksum mismatch";
+            return false;
+        }
+        return true;
+    }
+
+    size_t size() const {
+        return header->routes;
+    }
+
+    uint64_t checksum() const {
+        return header->checksum;
+    }
+
+    int64_t createdAt() const {
+        return header->createdAt;
+    }
+
+    // streamWidths are widths of Stream output columns of the exported database
+    vector<size_t> streamWidths() const {
+        return vector<size_t>(header->streamWidths, header->streamWidths + 10);
+    }
+
+    // allRoutes mirrors SelectAllRoutesQuery and SelectAllAvaliableRoutesQuery
+    vector<uint32_t> allRoutes(bool avaliableOnly) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (avaliableOnly) {
+            filterGreater(section<int32_t>(SnapshotSeats), size(), 0, mask.data());
+        }
+        return collectRows(section<uint32_t>(SnapshotByPrice), size(), mask);
+    }
+
+    // search mirrors buildSelectRoutesQuery
+    vector<uint32_t> search(const RouteSearch& search) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (search.sourceId > 0) {
+            filterEqual(section<int32_t>(SnapshotSourceIds), size(), cityCode(search.sourceId), mask.data());
+        } else if (!search.source.empty() &&
+                   !filterName(SnapshotCitiesByName, search.source, SnapshotSourceIds, mask)) {
+            return vector<uint32_t>();
+        }
+        if (search.destinationId > 0) {
+            filterEqual(section<int32_t>(SnapshotDestinationIds), size(), cityCode(search.destinationId), mask.data());
+        } else if (!search.destination.empty() &&
+                   !filterName(SnapshotCitiesByName, search.destination, SnapshotDestinationIds, mask)) {
+            return vector<uint32_t>();
+        }
+        if (!search.date.empty()) {
+            int64_t epoch;
+            if (!parseSQLiteTime(search.date, epoch)) {
+                return vector<uint32_t>();
+            }
+            filterGreaterEqual(section<int64_t>(SnapshotDepartures), size(), epoch, mask.data());
+        }
+        if (!search.transportType.empty() &&
+            !filterName(SnapshotTransportsByName, search.transportType, SnapshotTransportIds, mask)) {
+            return vector<uint32_t>();
+        }
+        if (!search.ticketPrice.empty()) {
+            filterLessEqual(section<int32_t>(SnapshotPrices), size(), priceLimit(search.ticketPrice), mask.data());
+        }
+        return collectRows(section<uint32_t>(SnapshotByDeparture), size(), mask);
+    }
+
+    // routesByTransport mirrors SelectRoutesByTransportTypeQuery
+    vector<uint32_t> routesByTransport(const string& transportType) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (!filterName(SnapshotTransportsByName, transportType, SnapshotTransportIds, mask)) {
+            return vector<uint32_t>();
+        }
+        return collectRows(section<uint32_t>(SnapshotByTransport), size(), mask);
+    }
+
+    // routesByDestination mirrors SelectRoutesByDestinationQuery
+    vector<uint32_t> routesByDestination(const string& destination) const override {
+        vector<uint8_t> mask(size(), 1);
+        if (!filterName(SnapshotCitiesByName, destination, SnapshotDestinationIds, mask)) {
+            return vector<uint32_t>();
+        }
+        return collectRows(section<uint32_t>(SnapshotByTransport), size(), mask);
+    }
+
+    // routesByPrice mirrors SelectRoutesByTicketPriceQuery
+    vector<uint32_t> routesByPrice(const string& ticketPrice) const override {
+        vector<uint8_t> mask(size(), 1);
+        filterLessEqual(section<int32_t>(SnapshotPrices), size(), priceLimit(ticketPrice), mask.data());
+        return collectRows(section<uint32_t>(SnapshotByPrice), size(), mask);
+    }
+
+    // route returns a selected row, its names point into the mapping
+    Route route(uint32_t position) const override {
+        Route route;
+        route.id = section<int64_t>(SnapshotIds)[position];
+        route.flight = text(SnapshotFlightEnds, SnapshotFlights, position);
+        route.source = text(SnapshotCityEnds, SnapshotCityNames, section<int32_t>(SnapshotSourceIds)[position]);
+        route.destination =
+            text(SnapshotCityEnds, SnapshotCityNames, section<int32_t>(SnapshotDestinationIds)[position]);
+        route.distance = section<int32_t>(SnapshotDistances)[position];
+        route.departure = section<int64_t>(SnapshotDepartures)[position];
+        route.arrival = section<int64_t>(SnapshotArrivals)[position];
+        route.priceCents = section<int32_t>(SnapshotPrices)[position];
+        route.seats = section<int32_t>(SnapshotSeats)[position];
+        route.transport =
+            text(SnapshotTransportEnds, SnapshotTransportNames, section<int32_t>(SnapshotTransportIds)[position]);
+        return route;
+    }
+
+    void forEachCity(const function<void(int64_t, string_view)>& visit) const override {
+        for (size_t id = 0; id < header->cities; ++id) {
+            string_view name = text(SnapshotCityEnds, SnapshotCityNames, id);
+            if (!name.empty()) {
+                visit(id, name);
+            }
+        }
+    }
+
+private:
+    RouteSnapshot(const RouteSnapshot&) = delete;
+    RouteSnapshot& operator=(const RouteSnapshot&) = delete;
+
+    template <typename T>
+    const T* section(SnapshotSection id) const {
+        return reinterpret_cast<const T*>(data + header->sections[id].offset);
+    }
+
+    // text returns value i of names stored as an offset table of ends and bytes
+    string_view text(SnapshotSection ends, SnapshotSection values, size_t i) const {
+        const uint32_t* end = section<uint32_t>(ends);
+        const uint32_t begin = i == 0 ? 0 : end[i - 1];
+        return string_view(section<char>(values) + begin, end[i] - begin);
+    }
+
+    // filterName keeps rows whose `column` is the id of `name`, false if there is no such name
+    bool filterName(SnapshotSection byName, const string& name, SnapshotSection column, vector<uint8_t>& mask) const {
+        const bool cities = byName == SnapshotCitiesByName;
+        const SnapshotSection ends = cities ? SnapshotCityEnds : SnapshotTransportEnds;
+        const SnapshotSection values = cities ? SnapshotCityNames : SnapshotTransportNames;
+        const int32_t* first = section<int32_t>(byName);
+        const int32_t* last = first + header->sections[byName].bytes / 4;
+        const int32_t* it = lower_bound(first, last, name, [&](int32_t id, const string& value) {
+            return text(ends, values, id) < value;
+        });
+        if (it == last || text(ends, values, *it) != name) {
+            return false;
+        }
+        filterEqual(section<int32_t>(column), size(), *it, mask.data());
+        return true;
+    }
+
+    // checkHeader validates the header and bounds of sections, so no later read
+    // leaves the mapping
+    bool checkHeader(string& error) const {
+        if (memcmp(header->magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0) {
+            error = "not a snapshot";
+            return false;
+        }
+        if (header->version != SnapshotVersion || header->byteOrder != SnapshotByteOrder) {
+            error = "unsupported snapshot version " + to_string(header->version);
+            return false;
+        }
+        if (header->headerChecksum != fnv1a64(header, offsetof(SnapshotHeader, headerChecksum)) ||
+            header->fileBytes != bytes) {
+            error = "snapshot is damaged or truncated";
+            return false;
+        }
+        const uint64_t n = header->routes;
+        const uint64_t expected[SnapshotSectionCount] = {
+            8 * n, 4 * n, 4 * n, 4 * n, 8 * n, 8 * n, 4 * n, 4 * n, 4 * n, 4 * n, 0,
+            4 * header->cities, 0, 0, 4 * header->transports, 0, 0, 4 * n, 4 * n, 4 * n};
+        for (int i = 0; i < SnapshotSectionCount; ++i) {
+            const SnapshotSectionEntry& entry = header->sections[i];
+            if (entry.offset % 8 != 0 || entry.offset > bytes || entry.bytes > bytes - entry.offset ||
+                (expected[i] > 0 && entry.bytes != expected[i])) {
+                error = "snapshot section " + to_string(i) + " is out of bounds";
+                return false;
+            }
+        }
+        // Offset tables must end inside their bytes
+        const SnapshotSection tables[3][2] = {{SnapshotFlightEnds, SnapshotFlights},
+                                              {SnapshotCityEnds, SnapshotCityNames},
+                                              {SnapshotTransportEnds, SnapshotTransportNames}};
+        for (const auto& table : tables) {
+            const uint64_t count = header->sections[table[0]].bytes / 4;
+            if (count > 0 && section<uint32_t>(table[0])[count - 1] != header->sections[table[1]].bytes) {
+                error = "snapshot names are damaged";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char* data;
+    size_t bytes;
+    const SnapshotHeader* header;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+using namespace std;
+
+// daysFromCivil returns number of days since 1970-01-01 for a Gregorian date
+inline int64_t daysFromCivil(int64_t year, int64_t month, int64_t day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yearOfEra = year - era * 400;
+    const int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// civilFromDays is the inverse of daysFromCivil
+inline void civilFromDays(int64_t days, int& year, int& month, int& day) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t dayOfEra = days - era * 146097;
+    const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = yearOfEra + era * 400 + (month <= 2);
+}
+
+// parseSQLiteTime converts "yyyy-mm-dd[ HH:MM[:SS]]" into epoch seconds
+inline bool parseSQLiteTime(const string& value, int64_t& epoch) {
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    int fields = sscanf(value.c_str(), "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second);
+    if (fields < 3) {
+        return false;
+    }
+    epoch = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// formatTime writes epoch seconds as "yyyy-mm-dd HH:MM:SS" or, when `dayFirst`
+// is set, as "dd.mm.yyyy HH:MM:SS" into buffer of 32 bytes, returns length
+inline size_t formatTime(int64_t epoch, bool dayFirst, char* buffer) {
+    int64_t days = epoch >= 0 ? epoch / 86400 : (epoch - 86399) / 86400;
+    int64_t seconds = epoch - days * 86400;
+    int year, month, day;
+    civilFromDays(days, year, month, day);
+    const int hour = seconds / 3600, minute = seconds / 60 % 60, second = seconds % 60;
+    int length = dayFirst
+        ? snprintf(buffer, 32, "%02d.%02d.%04d %02d:%02d:%02d", day, month, year, hour, minute, second)
+        : snprintf(buffer, 32, "%04d-%02d-%02d %02d:%02d:%02d", year, month, day, hour, minute, second);
+    return length > 0 ? length : 0;
+}
+
+// formatEpoch converts epoch seconds into "dd.mm.yyyy HH:MM:SS"
+inline string formatEpoch(int64_t epoch) {
+    char buffer[32];
+    return string(buffer, formatTime(epoch, true, buffer));
+}
+
+// formatSQLiteTime converts epoch seconds into "yyyy-mm-dd HH:MM:SS"
+inline string formatSQLiteTime(int64_t epoch) {
+    char buffer[32];
+    return string(buffer, formatTime(epoch, false, buffer));
+}